@@ -0,0 +1,12 @@
+#pragma once
+#include <string>
+
+// C-like source of `lines` lines for the benchmarks to open and edit, every line
+// declaring a distinct variable
+inline std::string sourceText(int lines)
+{
+      std::string content;
+      for (int i = 0; i < lines; i++)
+            content += "      int variable_" + std::to_string(i) + " = compute(" + std::to_string(i) + ");\n";
+      return content;
+}
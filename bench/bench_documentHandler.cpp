@@ -0,0 +1,163 @@
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Server.hpp"
+
+// Previous layout: every document behind one lock, kept as a baseline for comparison
+class SingleLockHandler
+{
+      std::map<std::string, std::shared_ptr<const textDocument>> m_documents;
+      mutable std::shared_mutex m_mutex;
+
+public:
+      void openDocument(const std::string &uri, const std::string &text)
+      {
+            std::unique_lock<std::shared_mutex> lock(m_mutex);
+            m_documents.emplace(uri, std::make_shared<const textDocument>(text));
+      }
+      void updateDocument(const std::string &uri, const DidChangeTextDocumentParams &params)
+      {
+            std::unique_lock<std::shared_mutex> lock(m_mutex);
+            auto document = std::make_shared<textDocument>(*m_documents.at(uri));
+            const Range &range = params.contentChanges[0].range.value();
+            int start = document->findPos(range.start.line, range.start.character, PositionEncoding::UTF16);
+            int end = document->findPos(range.end.line, range.end.character, PositionEncoding::UTF16);
+            document->replace(start, end - start, params.contentChanges[0].text);
+            m_documents[uri] = std::move(document);
+      }
+      std::shared_ptr<const textDocument> getOpenDocument(const std::string &uri) const
+      {
+            std::shared_lock<std::shared_mutex> lock(m_mutex);
+            auto it = m_documents.find(uri);
+            return it == m_documents.end() ? nullptr : it->second;
+      }
+};
+
+static std::string uriFor(int i)
+{
+      return "file:///workspace/module_" + std::to_string(i % 97) + "/source_" + std::to_string(i) + ".cpp";
+}
+
+static DidChangeTextDocumentParams editFor(const std::string &uri, int i)
+{
+      DidChangeTextDocumentParams params;
+      params.textDocument.uri = uri;
+      params.textDocument.version = i;
+      uint line = i % 40;
+      params.contentChanges.push_back({Range{{line, 6}, {line, 7}}, std::nullopt, "x"});
+      return params;
+}
+
+// Readers look up random documents while writers keep editing others, for a fixed duration.
+// Returns the lookups per second achieved by the readers.
+template <typename Handler, typename Lookup>
+static double lookupsPerSecond(Handler &handler, int documents, int readers, int writers, std::chrono::milliseconds duration, Lookup &&lookup)
+{
+      std::atomic<bool> running(true);
+      std::atomic<uint64_t> lookups(0);
+      std::vector<std::thread> threads;
+
+      for (int r = 0; r < readers; r++)
+      {
+            threads.emplace_back([&, r]
+                                 {
+                                       uint64_t done = 0;
+                                       unsigned next = r * 7919 + 1;
+                                       while (running.load(std::memory_order_relaxed))
+                                       {
+                                             next = next * 1103515245u + 12345u;
+                                             lookup(handler, uriFor(next % documents), next);
+                                             done++;
+                                       }
+                                       lookups += done; });
+      }
+      for (int w = 0; w < writers; w++)
+      {
+            threads.emplace_back([&, w]
+                                 {
+                                       // Each writer owns a disjoint set of documents, as the listener thread would
+                                       for (int i = 0; running.load(std::memory_order_relaxed); i++)
+                                       {
+                                             int document = (i * writers + w) % documents;
+                                             std::string uri = uriFor(document);
+                                             handler.updateDocument(uri, editFor(uri, i));
+                                       } });
+      }
+
+      std::this_thread::sleep_for(duration);
+      running = false;
+      for (auto &thread : threads)
+            thread.join();
+      return lookups.load() / std::chrono::duration<double>(duration).count();
+}
+
+// Microseconds per didChange on a document of `lines` lines with identifier indexing on.
+// Each edit only re-indexes the lines it touches, so this should not grow with the document.
+static double microsecondsPerIndexedEdit(int lines, int edits)
+{
+      std::string content;
+      for (int i = 0; i < lines; i++)
+            content += "      int variable_" + std::to_string(i % 500) + " = compute(" + std::to_string(i) + ");\n";
+
+      DocumentHandler handler;
+      handler.enableIdentifierIndex();
+      const DocumentHandle handle = handler.handleFor("file:///workspace/indexed.cpp");
+      handler.openDocument(handle, content, 0);
+
+      auto start = std::chrono::steady_clock::now();
+      for (int i = 0; i < edits; i++)
+      {
+            DidChangeTextDocumentParams params;
+            params.textDocument.uri = "file:///workspace/indexed.cpp";
+            params.textDocument.version = i + 1;
+            // Spread over the document, alternating between editing a line and splitting one
+            uint line = static_cast<uint>((i * 7919L) % (lines - 1));
+            params.contentChanges.push_back({Range{{line, 10}, {line, 11}}, std::nullopt, i % 2 ? "v" : "\n"});
+            handler.updateDocument(handle, params);
+      }
+      return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / edits;
+}
+
+int main(int argc, char **argv)
+{
+      const int documents = argc > 1 ? std::stoi(argv[1]) : 5000;
+      const int readers = argc > 2 ? std::stoi(argv[2]) : std::max(2u, std::thread::hardware_concurrency());
+      const int writers = argc > 3 ? std::stoi(argv[3]) : 2;
+      const std::chrono::milliseconds duration(argc > 4 ? std::stoi(argv[4]) : 1000);
+
+      std::string content;
+      for (int i = 0; i < 40; i++)
+            content += "      int variable_" + std::to_string(i) + " = compute(" + std::to_string(i) + ");\n";
+
+      DocumentHandler sharded;
+      SingleLockHandler single;
+      for (int i = 0; i < documents; i++)
+      {
+            sharded.openDocument(uriFor(i), content, 0);
+            single.openDocument(uriFor(i), content);
+      }
+
+      double singleRate = lookupsPerSecond(single, documents, readers, writers, duration, [](const SingleLockHandler &h, const std::string &uri, unsigned seed)
+                                           {
+                                                 auto document = h.getOpenDocument(uri);
+                                                 if (document)
+                                                       document->wordUnderCursor(seed % 40, 12, PositionEncoding::UTF16); });
+      double shardedRate = lookupsPerSecond(sharded, documents, readers, writers, duration, [](const DocumentHandler &h, const std::string &uri, unsigned seed)
+                                            {
+                                                  auto document = h.getOpenDocument(uri);
+                                                  if (document)
+                                                        document->get().wordUnderCursor(seed % 40, 12, PositionEncoding::UTF16); });
+
+      std::cout << "documents: " << documents << ", readers: " << readers << ", writers: " << writers << '\n'
+                << "single lock: " << singleRate << " lookups/s\n"
+                << "sharded:     " << shardedRate << " lookups/s\n";
+
+      for (int lines : {1000, 10000, 100000})
+            std::cout << "indexed edit, " << lines << " lines: " << microsecondsPerIndexedEdit(lines, 2000) << " us\n";
+      return 0;
+}
@@ -0,0 +1,71 @@
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include "textDocument.hpp"
+
+// Previous findPos implementation, kept as a baseline for comparison
+static int findPosRescan(const std::string &content, const int line, const int character)
+{
+      std::istringstream stream(content);
+      std::string lineContents;
+      int result = 0;
+
+      for (int l = 0; l < line; l++)
+      {
+            std::getline(stream, lineContents);
+            result += lineContents.length() + 1;
+      }
+      return result + character;
+}
+
+template <typename F>
+static double nsPerOp(int iterations, F &&f)
+{
+      auto start = std::chrono::steady_clock::now();
+      for (int i = 0; i < iterations; i++)
+            f(i);
+      auto elapsed = std::chrono::steady_clock::now() - start;
+      return std::chrono::duration<double, std::nano>(elapsed).count() / iterations;
+}
+
+int main(int argc, char **argv)
+{
+      const int lines = argc > 1 ? std::stoi(argv[1]) : 20000;
+      const int iterations = argc > 2 ? std::stoi(argv[2]) : 2000;
+
+      std::string content;
+      for (int i = 0; i < lines; i++)
+            content += "      int variable_" + std::to_string(i) + " = compute(" + std::to_string(i) + ");\n";
+
+      textDocument document(content);
+
+      // Simulates a keystroke burst: two position lookups and a one character replace per edit
+      double rescan = nsPerOp(iterations, [&](int i)
+                              {
+                                    int line = (i * 7919) % lines;
+                                    int start = findPosRescan(content, line, 6);
+                                    int end = findPosRescan(content, line, 7);
+                                    content.replace(start, end - start, "x"); });
+
+      double indexed = nsPerOp(iterations, [&](int i)
+                               {
+                                     int line = (i * 7919) % lines;
+                                     int start = document.findPos(line, 6, PositionEncoding::UTF16);
+                                     int end = document.findPos(line, 7, PositionEncoding::UTF16);
+                                     document.replace(start, end - start, "x"); });
+
+      // Edits close to the top of the file move the whole tail of a contiguous buffer
+      std::string flat = document.getContent();
+      double flatTop = nsPerOp(iterations, [&](int i)
+                               { flat.insert(i % 64, "y"); });
+      double pieceTop = nsPerOp(iterations, [&](int i)
+                                { document.replace(i % 64, 0, "y"); });
+
+      std::cout << "lines: " << lines << ", bytes: " << document.length() << ", edits: " << iterations << '\n'
+                << "rescan  (istringstream): " << rescan << " ns/edit\n"
+                << "indexed (piece table):   " << indexed << " ns/edit\n"
+                << "top of file, std::string: " << flatTop << " ns/edit\n"
+                << "top of file, piece table: " << pieceTop << " ns/edit\n";
+      return 0;
+}
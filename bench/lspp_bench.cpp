@@ -0,0 +1,498 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "Server.hpp"
+#include "FrameReader.hpp"
+#include "SourceText.hpp"
+
+// Microbenchmarks of the framing, document sync, dispatch and tracing paths. Every benchmark is
+// run with a growing iteration count until it takes --min-time, then reports ns/op,
+// throughput and heap allocations per op. --json writes the results for a later
+// --compare, which flags benchmarks that got slower by more than --threshold percent.
+//
+//     lspp_bench --json > before.json
+//     lspp_bench --compare before.json
+
+// Results are added here so the compiler cannot drop the work producing them
+static volatile size_t g_sink;
+
+// Every operator new of the process, the library's and worker threads' included
+static std::atomic<uint64_t> g_allocations(0);
+
+// Counted allocation, aligned to `alignment` or the default. Every form of operator new
+// and delete goes through this pair, so the compiler only ever sees matching calls.
+static void *allocate(size_t size, size_t alignment)
+{
+      g_allocations.fetch_add(1, std::memory_order_relaxed);
+      size = std::max<size_t>(size, 1);
+      void *p;
+      if (alignment <= __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+            p = std::malloc(size);
+      else // aligned_alloc wants a multiple of the alignment
+            p = std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+      if (!p)
+            throw std::bad_alloc();
+      return p;
+}
+static void deallocate(void *p) noexcept
+{
+      std::free(p);
+}
+
+void *operator new(size_t size)
+{
+      return allocate(size, 0);
+}
+void *operator new[](size_t size)
+{
+      return allocate(size, 0);
+}
+// alignas types above the default alignment come here instead
+void *operator new(size_t size, std::align_val_t alignment)
+{
+      return allocate(size, static_cast<size_t>(alignment));
+}
+void *operator new[](size_t size, std::align_val_t alignment)
+{
+      return allocate(size, static_cast<size_t>(alignment));
+}
+void operator delete(void *p) noexcept
+{
+      deallocate(p);
+}
+void operator delete[](void *p) noexcept
+{
+      deallocate(p);
+}
+void operator delete(void *p, size_t) noexcept
+{
+      deallocate(p);
+}
+void operator delete[](void *p, size_t) noexcept
+{
+      deallocate(p);
+}
+void operator delete(void *p, std::align_val_t) noexcept
+{
+      deallocate(p);
+}
+void operator delete[](void *p, std::align_val_t) noexcept
+{
+      deallocate(p);
+}
+void operator delete(void *p, size_t, std::align_val_t) noexcept
+{
+      deallocate(p);
+}
+void operator delete[](void *p, size_t, std::align_val_t) noexcept
+{
+      deallocate(p);
+}
+
+struct Result
+{
+      std::string name;
+      std::string params;
+      uint64_t iterations;
+      double nsPerOp;
+      double opsPerSecond;
+      double bytesPerSecond; // 0 when the benchmark does not process a payload
+      double allocationsPerOp;
+};
+
+struct Options
+{
+      std::string filter;
+      std::chrono::milliseconds minTime{200};
+      bool json = false;
+      std::string compare;
+      double threshold = 10;
+      bool help = false;
+};
+
+// A benchmark body runs `iterations` operations inside timed() and returns what it
+// measured, so per-run setup stays out of both the time and the allocation count
+using Body = std::function<double(uint64_t iterations)>;
+
+// Allocations made during the last timed() call
+static uint64_t g_timedAllocations;
+
+template <typename F>
+static double timed(F &&f)
+{
+      const uint64_t allocations = g_allocations.load();
+      auto start = std::chrono::steady_clock::now();
+      f();
+      auto elapsed = std::chrono::steady_clock::now() - start;
+      g_timedAllocations = g_allocations.load() - allocations;
+      return std::chrono::duration<double, std::nano>(elapsed).count();
+}
+
+class Suite
+{
+      Options m_options;
+      std::vector<Result> m_results;
+
+public:
+      explicit Suite(Options options) : m_options(std::move(options)) {}
+
+      bool selected(const std::string &name, const std::string &params) const
+      {
+            return (name + "/" + params).find(m_options.filter) != std::string::npos;
+      }
+
+      void run(const std::string &name, const std::string &params, size_t bytesPerOp, const Body &body)
+      {
+            const double minTime = std::chrono::duration<double, std::nano>(m_options.minTime).count();
+            uint64_t iterations = 1;
+            double elapsed;
+            uint64_t allocations;
+            body(1); // Warm up caches and lazily built state
+            while (true)
+            {
+                  elapsed = body(iterations);
+                  allocations = g_timedAllocations;
+                  if (elapsed >= minTime || iterations >= (uint64_t(1) << 32))
+                        break;
+                  // Aim a little past the target so the next run usually is the last
+                  double factor = elapsed > 0 ? std::min(100.0, 1.4 * minTime / elapsed) : 100.0;
+                  iterations = std::max(iterations + 1, static_cast<uint64_t>(iterations * factor));
+            }
+
+            const double ns = elapsed / iterations;
+            Result result{name, params, iterations, ns, 1e9 / ns, bytesPerOp ? bytesPerOp * 1e9 / ns : 0, double(allocations) / iterations};
+            if (!m_options.json)
+                  print(result);
+            m_results.push_back(std::move(result));
+      }
+
+      static void print(const Result &r)
+      {
+            std::cout << std::left << std::setw(48) << (r.name + "/" + r.params) << std::right
+                      << std::setw(14) << std::fixed << std::setprecision(1) << r.nsPerOp << " ns/op"
+                      << std::setw(14) << std::setprecision(0) << r.opsPerSecond << " op/s";
+            if (r.bytesPerSecond > 0)
+                  std::cout << std::setw(10) << std::setprecision(1) << r.bytesPerSecond / (1 << 20) << " MiB/s";
+            else
+                  std::cout << std::setw(16) << "";
+            std::cout << std::setw(10) << std::setprecision(2) << r.allocationsPerOp << " allocs/op\n";
+      }
+
+      nlohmann::json toJson() const
+      {
+            nlohmann::json out = nlohmann::json::array();
+            for (const Result &r : m_results)
+                  out.push_back({{"name", r.name}, {"params", r.params}, {"iterations", r.iterations}, {"ns_per_op", r.nsPerOp}, {"ops_per_second", r.opsPerSecond}, {"bytes_per_second", r.bytesPerSecond}, {"allocations_per_op", r.allocationsPerOp}});
+            return {{"benchmarks", out}};
+      }
+
+      // Returns the number of benchmarks slower than the baseline by more than the threshold
+      int compare(const nlohmann::json &baseline) const
+      {
+            int regressions = 0;
+            for (const Result &r : m_results)
+            {
+                  const std::string id = r.name + "/" + r.params;
+                  auto old = std::find_if(baseline["benchmarks"].begin(), baseline["benchmarks"].end(), [&](const nlohmann::json &b)
+                                          { return b.value("name", "") + "/" + b.value("params", "") == id; });
+                  if (old == baseline["benchmarks"].end())
+                        continue;
+
+                  const double change = 100.0 * (r.nsPerOp / (*old)["ns_per_op"].get<double>() - 1);
+                  const double allocations = r.allocationsPerOp - (*old)["allocations_per_op"].get<double>();
+                  const bool regressed = change > m_options.threshold;
+                  regressions += regressed;
+                  std::cout << std::left << std::setw(48) << id << std::right << std::showpos << std::fixed
+                            << std::setw(10) << std::setprecision(1) << change << "% time"
+                            << std::setw(10) << std::setprecision(2) << allocations << " allocs/op" << std::noshowpos
+                            << (regressed ? "   REGRESSION" : "") << '\n';
+            }
+            return regressions;
+      }
+};
+
+static std::string frame(const std::string &payload)
+{
+      return "Content-Length: " + std::to_string(payload.size()) + "\r\n\r\n" + payload;
+}
+
+// Frames are read from a stream holding a few MiB of copies, restarted when it runs dry
+static void benchReadMessage(Suite &suite)
+{
+      for (size_t size : {64, 1024, 64 * 1024})
+      {
+            const std::string params = "bytes:" + std::to_string(size);
+            if (!suite.selected("framing/readMessage", params))
+                  continue;
+
+            std::string prefix = R"({"jsonrpc": "2.0", "method": "textDocument/didChange", "params": {"textDocument": {"uri": "file:///a.cpp", "version": 1}, "contentChanges": [{"text": ")";
+            std::string payload = prefix + std::string(size > prefix.size() + 8 ? size - prefix.size() - 8 : 1, 'x') + R"("}]}})";
+            const size_t copies = std::max<size_t>(1, (4 << 20) / payload.size());
+            std::string wire;
+            for (size_t i = 0; i < copies; i++)
+                  wire += frame(payload);
+
+            suite.run("framing/readMessage", params, payload.size(), [&](uint64_t iterations)
+                      {
+                            std::istringstream in(wire);
+                            auto reader = std::make_unique<FrameReader>(in);
+                            Message message;
+                            return timed([&]
+                                         {
+                                               for (uint64_t i = 0; i < iterations; i++)
+                                               {
+                                                     if (message.readMessage(*reader) < 0)
+                                                     {
+                                                           in.clear();
+                                                           in.seekg(0);
+                                                           reader = std::make_unique<FrameReader>(in);
+                                                           message.readMessage(*reader);
+                                                     }
+                                               }
+                                         }); });
+      }
+}
+
+static void benchResponseToString(Suite &suite)
+{
+      for (size_t count : {1, 100, 10000})
+      {
+            const std::string params = "locations:" + std::to_string(count);
+            if (!suite.selected("framing/Response::toString", params))
+                  continue;
+
+            std::vector<Location> locations;
+            for (size_t i = 0; i < count; i++)
+                  locations.push_back({"file:///workspace/src/module_" + std::to_string(i % 50) + ".cpp", {{uint(i), 4}, {uint(i), 12}}});
+            Response response(std::optional<int>(7));
+            LSPServer::setCallbackResult(response, locations);
+            const size_t bytes = response.toString().size();
+
+            suite.run("framing/Response::toString", params, bytes, [&](uint64_t iterations)
+                      { return timed([&]
+                                     {
+                                           for (uint64_t i = 0; i < iterations; i++)
+                                           {
+                                                 g_sink = g_sink + response.toString().size();
+                                           } }); });
+      }
+}
+
+static void benchDocumentLookups(Suite &suite)
+{
+      for (int lines : {1000, 10000, 100000})
+      {
+            const std::string params = "lines:" + std::to_string(lines);
+            textDocument document(sourceText(lines));
+
+            if (suite.selected("sync/findPos", params))
+                  suite.run("sync/findPos", params, 0, [&](uint64_t iterations)
+                            {
+                                  size_t sink = 0;
+                                  double ns = timed([&]
+                                                    {
+                                                          for (uint64_t i = 0; i < iterations; i++)
+                                                                sink += document.findPos((i * 7919) % lines, 10, PositionEncoding::UTF16); });
+                                  g_sink = sink;
+                                  return ns; });
+
+            if (suite.selected("sync/wordUnderCursor", params))
+                  suite.run("sync/wordUnderCursor", params, 0, [&](uint64_t iterations)
+                            {
+                                  size_t sink = 0;
+                                  double ns = timed([&]
+                                                    {
+                                                          for (uint64_t i = 0; i < iterations; i++)
+                                                                sink += document.wordUnderCursor((i * 7919) % lines, 12, PositionEncoding::UTF16).size(); });
+                                  g_sink = sink;
+                                  return ns; });
+      }
+}
+
+// The edit a client sends for the i-th change of each pattern
+static TextDocumentContentChangeEvent editFor(const std::string &pattern, uint64_t i, int lines)
+{
+      const uint line = (i * 7919) % lines;
+      if (pattern == "typing")
+      {
+            // One character after another on a line near the middle
+            const uint column = 6 + i % 24;
+            return {Range{{uint(lines / 2), column}, {uint(lines / 2), column}}, std::nullopt, "a"};
+      }
+      if (pattern == "scattered")
+            return {Range{{line, 6}, {line, 7}}, std::nullopt, "x"};
+      if (pattern == "paste")
+            return {Range{{line, 0}, {line, 0}}, std::nullopt, sourceText(20)};
+      // Full sync: the whole text again
+      return {std::nullopt, std::nullopt, sourceText(lines)};
+}
+
+static void benchUpdateDocument(Suite &suite)
+{
+      for (int lines : {1000, 100000})
+      {
+            for (std::string pattern : {"typing", "scattered", "paste", "full"})
+            {
+                  const std::string params = "lines:" + std::to_string(lines) + ",edit:" + pattern;
+                  if (!suite.selected("sync/updateDocument", params) || (pattern == "full" && lines > 10000))
+                        continue;
+
+                  const std::string text = sourceText(lines);
+                  const TextDocumentContentChangeEvent sample = editFor(pattern, 0, lines);
+                  suite.run("sync/updateDocument", params, sample.text.size(), [&](uint64_t iterations)
+                            {
+                                  DocumentHandler documents;
+                                  DocumentHandle handle = documents.handleFor("file:///bench.cpp");
+                                  documents.openDocument(handle, text, 0);
+                                  // Built before timing, the client would have sent them anyway
+                                  std::vector<DidChangeTextDocumentParams> edits(std::min<uint64_t>(iterations, 1024));
+                                  for (size_t i = 0; i < edits.size(); i++)
+                                  {
+                                        edits[i].textDocument.uri = "file:///bench.cpp";
+                                        edits[i].contentChanges.push_back(editFor(pattern, i, lines));
+                                  }
+                                  return timed([&]
+                                               {
+                                                     for (uint64_t i = 0; i < iterations; i++)
+                                                     {
+                                                           auto &edit = edits[i % edits.size()];
+                                                           edit.textDocument.version = static_cast<int>(i + 1);
+                                                           documents.updateDocument(handle, edit);
+                                                     } }); });
+            }
+      }
+}
+
+// processRequest on an initialized server, from method lookup to the serialized result
+static void benchDispatch(Suite &suite)
+{
+      if (!suite.selected("dispatch/processRequest", "hover"))
+            return;
+
+      LSPServer server;
+      server.registerCallback<hoverParams, hoverResult>(Message::Method::HOVER, [](const hoverParams &params)
+                                                        { return hoverResult{{MarkupKind::PlainText, "hover"}, Range{params.position, params.position}}; });
+      std::istringstream in(frame(R"({"jsonrpc": "2.0", "id": 1, "method": "initialize", "params": {}})"));
+      std::ostringstream out;
+      server.init(ServerCapabilities::hoverProvider, in, out, 1);
+
+      std::istringstream request(frame(R"({"jsonrpc": "2.0", "id": 2, "method": "textDocument/hover", "params": {"textDocument": {"uri": "file:///a.cpp"}, "position": {"line": 3, "character": 7}}})"));
+      const Message message(request);
+      suite.run("dispatch/processRequest", "hover", message.payload().size(), [&](uint64_t iterations)
+                { return timed([&]
+                               {
+                                     for (uint64_t i = 0; i < iterations; i++)
+                                     {
+                                           Response response = server.processRequest(message);
+                                           g_sink = g_sink + 1;
+                                     } }); });
+      server.exit();
+}
+
+// Cost of one TraceSpan, with tracing off and on. The tracer is reopened before a
+// thread's buffer fills up, so the enabled case never measures dropped spans.
+static void benchTraceSpan(Suite &suite)
+{
+      const std::string path = (std::filesystem::temp_directory_path() / "lspp_bench_trace.json").string();
+      for (bool enabled : {false, true})
+      {
+            const std::string params = enabled ? "enabled" : "disabled";
+            if (!suite.selected("trace/span", params))
+                  continue;
+
+            Tracer tracer;
+            TraceContext context(1, Message::Method::HOVER);
+            suite.run("trace/span", params, 0, [&](uint64_t iterations)
+                      { return timed([&]
+                                     {
+                                           for (uint64_t i = 0; i < iterations; i++)
+                                           {
+                                                 if (enabled && i % (Tracer::MAX_EVENTS_PER_THREAD / 2) == 0)
+                                                       tracer.open(path);
+                                                 TraceSpan span(tracer, "span");
+                                           } }); });
+      }
+      std::filesystem::remove(path);
+}
+
+static void usage(std::ostream &out, const char *program)
+{
+      out << "usage: " << program << " [--json] [--filter text] [--min-time ms] [--compare baseline.json [--threshold percent]]\n";
+}
+
+static bool parseOptions(int argc, char **argv, Options &options)
+{
+      for (int i = 1; i < argc; i++)
+      {
+            std::string arg = argv[i];
+            auto value = [&]() -> std::string
+            { return i + 1 < argc ? argv[++i] : ""; };
+            if (arg == "--json")
+                  options.json = true;
+            else if (arg == "--filter")
+                  options.filter = value();
+            else if (arg == "--min-time")
+                  options.minTime = std::chrono::milliseconds(std::atoi(value().c_str()));
+            else if (arg == "--compare")
+                  options.compare = value();
+            else if (arg == "--threshold")
+                  options.threshold = std::atof(value().c_str());
+            else if (arg == "--help" || arg == "-h")
+                  options.help = true;
+            else
+            {
+                  usage(std::cerr, argv[0]);
+                  return false;
+            }
+      }
+      return true;
+}
+
+int main(int argc, char **argv)
+{
+      Options options;
+      if (!parseOptions(argc, argv, options))
+            return 2;
+      if (options.help)
+      {
+            usage(std::cout, argv[0]);
+            return 0;
+      }
+
+      nlohmann::json baseline;
+      if (!options.compare.empty())
+      {
+            std::ifstream file(options.compare);
+            baseline = nlohmann::json::parse(file, nullptr, false);
+            if (baseline.is_discarded() || !baseline.contains("benchmarks"))
+            {
+                  std::cerr << "cannot read baseline " << options.compare << '\n';
+                  return 2;
+            }
+            // The comparison replaces the plain listing
+            options.json = true;
+      }
+
+      Suite suite(options);
+      benchReadMessage(suite);
+      benchResponseToString(suite);
+      benchDocumentLookups(suite);
+      benchUpdateDocument(suite);
+      benchDispatch(suite);
+      benchTraceSpan(suite);
+
+      if (!options.compare.empty())
+            return suite.compare(baseline) ? 1 : 0;
+      if (options.json)
+            std::cout << suite.toJson().dump(2) << '\n';
+      return 0;
+}
@@ -0,0 +1,570 @@
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <condition_variable>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "Server.hpp"
+#include "JsonReader.hpp"
+#include "TestClient.hpp"
+#include "SourceText.hpp"
+
+// Load generator: simulated editors type into their own document at a fixed rate and
+// send what a real editor would for every keystroke: a didChange, a completion request
+// that cancels the previous one if it is still running, and now and then a hover. The
+// editors talk to one or more server processes over pipes and every response's
+// latency is measured from the moment its request was written.
+//
+// By default the servers are this binary started with --serve, which answers
+// completion by scanning the document for matching identifiers, so the cost grows with
+// the document. --server runs any other server command instead.
+//
+//     lspp_load --clients 16 --rate 20 --workers 4 --lines 5000
+//     lspp_load --sweep --workers-list 1,2,4,8 --lines-list 1000,10000,100000
+//
+// --sweep doubles the typing rate for every worker count and document size until the
+// completion p99 exceeds --slo or requests go unanswered, and reports the last rate
+// that held as the saturation point.
+
+using Clock = std::chrono::steady_clock;
+
+struct LoadConfig
+{
+      size_t clients = 8;
+      size_t servers = 1;
+      size_t workers = 4;
+      int lines = 2000;
+      double rate = 10; // Keystrokes per second of each editor
+      std::chrono::milliseconds duration{3000};
+      int hoverEvery = 20; // Keystrokes between hovers
+      std::vector<std::string> serverCommand;
+};
+
+struct MethodStats
+{
+      std::string method;
+      size_t sent;
+      size_t answered;
+      size_t cancelled; // Answered with RequestCancelled
+      // Of the requests answered with a result, in nanoseconds
+      uint64_t p50, p99, p999, max;
+};
+
+struct LoadResult
+{
+      size_t keystrokes;
+      double keystrokesPerSecond;
+      double requestsPerSecond;
+      double answeredPerSecond;
+      std::vector<MethodStats> methods;
+
+      const MethodStats *method(const std::string &name) const
+      {
+            auto it = std::find_if(methods.begin(), methods.end(), [&](const MethodStats &m)
+                                   { return m.method == name; });
+            return it == methods.end() ? nullptr : &*it;
+      }
+};
+
+// Latencies of every connection, by method
+class Recorder
+{
+      struct Samples
+      {
+            size_t sent = 0;
+            size_t cancelled = 0;
+            std::vector<uint64_t> latencies;
+      };
+      std::mutex m_mutex;
+      std::map<std::string, Samples> m_methods;
+
+public:
+      void sent(const std::string &method)
+      {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_methods[method].sent++;
+      }
+
+      void answered(const std::string &method, Clock::duration latency, bool cancelled)
+      {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            Samples &samples = m_methods[method];
+            if (cancelled)
+                  samples.cancelled++;
+            else
+                  samples.latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count());
+      }
+
+      std::vector<MethodStats> stats()
+      {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            std::vector<MethodStats> out;
+            for (auto &[method, samples] : m_methods)
+            {
+                  auto &l = samples.latencies;
+                  std::sort(l.begin(), l.end());
+                  out.push_back({method, samples.sent, l.size() + samples.cancelled, samples.cancelled,
+                                 percentile(l, 0.5), percentile(l, 0.99), percentile(l, 0.999), l.empty() ? 0 : l.back()});
+            }
+            return out;
+      }
+};
+
+// One server process and the requests waiting for its answers
+class Connection
+{
+      struct Pending
+      {
+            std::string method;
+            Clock::time_point sent;
+      };
+
+      testutil::ServerProcess m_process;
+      Recorder *m_recorder;
+      std::atomic<int64_t> m_nextId{1};
+      std::mutex m_mutex;
+      std::condition_variable m_answered;
+      std::unordered_map<int64_t, Pending> m_pending;
+      std::thread m_reader;
+
+      void read()
+      {
+            while (auto payload = m_process.receive())
+            {
+                  int64_t id = 0, code = 0;
+                  bool hasId = false;
+                  std::string_view key;
+                  JsonReader reader(*payload);
+                  if (!reader.beginObject())
+                        continue;
+                  while (reader.nextMember(key))
+                  {
+                        if (key == "id")
+                              hasId = reader.readInt(id);
+                        else if (key == "error" && reader.beginObject())
+                        {
+                              std::string_view member;
+                              while (reader.nextMember(member))
+                              {
+                                    if (member == "code")
+                                          reader.readInt(code);
+                                    else
+                                          reader.skipValue();
+                              }
+                        }
+                        else
+                              reader.skipValue();
+                  }
+
+                  const auto now = Clock::now();
+                  std::lock_guard<std::mutex> lock(m_mutex);
+                  auto it = hasId ? m_pending.find(id) : m_pending.end();
+                  if (it == m_pending.end())
+                        continue;
+                  if (m_recorder)
+                        m_recorder->answered(it->second.method, now - it->second.sent, code == -32800);
+                  m_pending.erase(it);
+                  m_answered.notify_all();
+            }
+            // The server is gone, nothing else will be answered
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_pending.clear();
+            m_answered.notify_all();
+      }
+
+public:
+      explicit Connection(const std::vector<std::string> &command) : m_process(command), m_recorder(nullptr)
+      {
+            m_reader = std::thread(&Connection::read, this);
+      }
+
+      ~Connection()
+      {
+            m_process.closeInput();
+            m_reader.join();
+            m_process.wait();
+      }
+
+      bool running() const
+      {
+            return m_process.running();
+      }
+
+      // Latencies are only recorded once set, leaving out the handshake
+      void record(Recorder *recorder)
+      {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_recorder = recorder;
+      }
+
+      int64_t request(const std::string &method, const nlohmann::json &params)
+      {
+            const int64_t id = m_nextId++;
+            {
+                  std::lock_guard<std::mutex> lock(m_mutex);
+                  m_pending[id] = {method, Clock::now()};
+                  if (m_recorder)
+                        m_recorder->sent(method);
+            }
+            m_process.send(nlohmann::json{{"jsonrpc", "2.0"}, {"id", id}, {"method", method}, {"params", params}}.dump());
+            return id;
+      }
+
+      void notify(const std::string &method, const nlohmann::json &params)
+      {
+            m_process.send(nlohmann::json{{"jsonrpc", "2.0"}, {"method", method}, {"params", params}}.dump());
+      }
+
+      bool isPending(int64_t id)
+      {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_pending.count(id) > 0;
+      }
+
+      // Waits until every request was answered, returns false on timeout
+      bool drain(std::chrono::milliseconds timeout)
+      {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            return m_answered.wait_for(lock, timeout, [this]
+                                       { return m_pending.empty(); });
+      }
+
+      void shutdown()
+      {
+            record(nullptr);
+            request("shutdown", nullptr);
+            drain(std::chrono::seconds(5));
+            notify("exit", nullptr);
+      }
+};
+
+static nlohmann::json position(const std::string &uri, uint line, uint character)
+{
+      return {{"textDocument", {{"uri", uri}}}, {"position", {{"line", line}, {"character", character}}}};
+}
+
+// One editor typing into its own document until `end`. Returns the keystrokes sent.
+static size_t runEditor(Connection &connection, size_t index, const LoadConfig &config, Clock::time_point start, Clock::time_point end)
+{
+      static const std::string typed = "total += compute_value(variable_12, offset);\nif (total > limit)\nreport(total);\n";
+      const std::string uri = "file:///load/editor_" + std::to_string(index) + ".cpp";
+      std::mt19937 random(static_cast<unsigned>(index) * 7919 + 1);
+      int version = 1;
+      connection.notify("textDocument/didOpen", {{"textDocument", {{"uri", uri}, {"languageId", "cpp"}, {"version", version}, {"text", sourceText(config.lines)}}}});
+
+      uint line = config.lines / 2, column = 0;
+      auto change = [&](uint startColumn, uint endColumn, const std::string &text)
+      {
+            nlohmann::json range = {{"start", {{"line", line}, {"character", startColumn}}}, {"end", {{"line", line}, {"character", endColumn}}}};
+            connection.notify("textDocument/didChange", {{"textDocument", {{"uri", uri}, {"version", ++version}}}, {"contentChanges", {{{"range", range}, {"text", text}}}}});
+      };
+      // Typing starts on a new line in the middle of the document
+      change(0, 0, "\n");
+
+      const auto period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / config.rate));
+      // Editors do not type in lockstep
+      auto next = start + std::chrono::duration_cast<Clock::duration>(period * std::uniform_real_distribution<double>(0, 1)(random));
+      std::optional<int64_t> completion;
+      size_t keystrokes = 0;
+      for (; next < end; next += period, keystrokes++)
+      {
+            std::this_thread::sleep_until(next);
+            const char c = typed[keystrokes % typed.size()];
+            if (column > 0 && random() % 20 == 0)
+            {
+                  change(column - 1, column, "");
+                  column--;
+                  continue;
+            }
+            change(column, column, std::string(1, c));
+            if (c == '\n')
+            {
+                  line++;
+                  column = 0;
+                  continue;
+            }
+            column++;
+
+            if (std::isalnum(static_cast<unsigned char>(c)) || c == '_')
+            {
+                  // The previous list is of no use any more
+                  if (completion && connection.isPending(*completion))
+                        connection.notify("$/cancelRequest", {{"id", *completion}});
+                  completion = connection.request("textDocument/completion", position(uri, line, column));
+            }
+            if (config.hoverEvery > 0 && keystrokes % config.hoverEvery == 0)
+                  connection.request("textDocument/hover", position(uri, static_cast<uint>(random() % config.lines), 10));
+      }
+      connection.notify("textDocument/didClose", {{"textDocument", {{"uri", uri}}}});
+      return keystrokes;
+}
+
+static std::optional<LoadResult> runLoad(const LoadConfig &config)
+{
+      std::vector<std::unique_ptr<Connection>> connections;
+      for (size_t i = 0; i < std::max<size_t>(1, config.servers); i++)
+      {
+            auto connection = std::make_unique<Connection>(config.serverCommand);
+            if (!connection->running())
+                  return std::nullopt;
+            connection->request("initialize", {{"capabilities", nlohmann::json::object()}});
+            if (!connection->drain(std::chrono::seconds(5)))
+                  return std::nullopt;
+            connection->notify("initialized", nlohmann::json::object());
+            connections.push_back(std::move(connection));
+      }
+
+      Recorder recorder;
+      for (auto &connection : connections)
+            connection->record(&recorder);
+
+      const auto start = Clock::now() + std::chrono::milliseconds(50);
+      const auto end = start + config.duration;
+      std::atomic<size_t> keystrokes(0);
+      std::vector<std::thread> editors;
+      for (size_t i = 0; i < config.clients; i++)
+            editors.emplace_back([&, i]
+                                 { keystrokes += runEditor(*connections[i % connections.size()], i, config, start, end); });
+      for (auto &editor : editors)
+            editor.join();
+
+      // Late answers still count, lost ones show up as answered < sent
+      for (auto &connection : connections)
+            connection->drain(std::chrono::seconds(5));
+      for (auto &connection : connections)
+            connection->shutdown();
+
+      const double seconds = std::chrono::duration<double>(config.duration).count();
+      LoadResult result{keystrokes, keystrokes / seconds, 0, 0, recorder.stats()};
+      for (const auto &m : result.methods)
+      {
+            result.requestsPerSecond += m.sent / seconds;
+            result.answeredPerSecond += m.answered / seconds;
+      }
+      return result;
+}
+
+// Target server for the default command, answering completion and hover from the open document
+class LoadTargetServer : public LSPServer
+{
+public:
+      LoadTargetServer()
+      {
+            registerCallback<textDocumentPositionParams, nlohmann::json>(
+                Message::Method::TEXT_DOCUMENT_COMPLETION,
+                [this](const textDocumentPositionParams &params, const RequestContext &context)
+                {
+                      nlohmann::json items = nlohmann::json::array();
+                      auto snapshot = m_documentHandler.getOpenDocument(params.textDocument.uri);
+                      if (!snapshot)
+                            return items;
+                      const textDocument &document = snapshot->get();
+
+                      // The word typed so far, up to the cursor
+                      std::string_view text = document.lineView(params.position.line);
+                      size_t end = std::min(byteOffsetFromUnits(text, params.position.character, positionEncoding()), text.size()), begin = end;
+                      while (begin > 0 && defaultWordRules.isWordChar(text[begin - 1]))
+                            begin--;
+                      const std::string_view prefix = text.substr(begin, end - begin);
+
+                      // Every identifier of the document starting with it, as a simple engine would
+                      std::unordered_set<std::string_view> seen;
+                      for (size_t line = 0; line < document.lineCount() && items.size() < 100; line++)
+                      {
+                            if (line % 1024 == 0 && context.cancellation.isCancelled())
+                                  break;
+                            std::string_view words = document.lineView(line);
+                            defaultWordRules.forEachIdentifier(words, [&](size_t from, size_t to)
+                                                               {
+                                                                     std::string_view word = words.substr(from, to - from);
+                                                                     if (word.size() > prefix.size() && word.starts_with(prefix) && seen.insert(word).second)
+                                                                           items.push_back({{"label", std::string(word)}}); });
+                      }
+                      return items;
+                });
+            registerCallback<hoverParams, std::optional<hoverResult>>(
+                Message::Method::HOVER,
+                [this](const hoverParams &params) -> std::optional<hoverResult>
+                {
+                      auto snapshot = m_documentHandler.getOpenDocument(params.textDocument.uri);
+                      if (!snapshot)
+                            return std::nullopt;
+                      std::string_view word = snapshot->get().wordUnderCursor(params.position.line, params.position.character, positionEncoding());
+                      return hoverResult{{MarkupKind::PlainText, std::string(word)}, std::nullopt};
+                });
+      }
+};
+
+static std::vector<std::string> split(const std::string &text, char separator)
+{
+      std::vector<std::string> out;
+      std::istringstream stream(text);
+      for (std::string part; std::getline(stream, part, separator);)
+            if (!part.empty())
+                  out.push_back(part);
+      return out;
+}
+
+static void printResult(const LoadConfig &config, const LoadResult &result)
+{
+      std::cout << std::fixed << std::setprecision(1)
+                << config.clients << " editors, " << config.servers << " servers, " << config.workers << " workers, " << config.lines << " lines: "
+                << result.keystrokesPerSecond << " keystrokes/s, " << result.requestsPerSecond << " requests/s sent, "
+                << result.answeredPerSecond << " answered/s\n"
+                << std::left << std::setw(28) << "method" << std::right << std::setw(9) << "sent" << std::setw(10) << "answered"
+                << std::setw(11) << "cancelled" << std::setw(11) << "p50 ms" << std::setw(11) << "p99 ms" << std::setw(11) << "p999 ms" << std::setw(11) << "max ms" << '\n';
+      for (const MethodStats &m : result.methods)
+            std::cout << std::left << std::setw(28) << m.method << std::right << std::setw(9) << m.sent << std::setw(10) << m.answered << std::setw(11) << m.cancelled
+                      << std::setprecision(2) << std::setw(11) << m.p50 / 1e6 << std::setw(11) << m.p99 / 1e6 << std::setw(11) << m.p999 / 1e6 << std::setw(11) << m.max / 1e6 << '\n';
+}
+
+static nlohmann::json toJson(const LoadConfig &config, const LoadResult &result)
+{
+      nlohmann::json methods = nlohmann::json::array();
+      for (const MethodStats &m : result.methods)
+            methods.push_back({{"method", m.method}, {"sent", m.sent}, {"answered", m.answered}, {"cancelled", m.cancelled}, {"p50_ns", m.p50}, {"p99_ns", m.p99}, {"p999_ns", m.p999}, {"max_ns", m.max}});
+      return {{"clients", config.clients}, {"servers", config.servers}, {"workers", config.workers}, {"lines", config.lines}, {"rate", config.rate},
+              {"keystrokes_per_second", result.keystrokesPerSecond}, {"requests_per_second", result.requestsPerSecond}, {"answered_per_second", result.answeredPerSecond}, {"methods", methods}};
+}
+
+static void usage(const char *name)
+{
+      std::cerr << "usage: " << name << " [--clients n] [--servers n] [--workers n] [--lines n] [--rate keystrokes/s] [--duration ms]\n"
+                << "       [--hover-every keystrokes] [--server \"command args\"] [--json]\n"
+                << "       [--sweep [--workers-list 1,2,4] [--lines-list 1000,10000] [--slo ms] [--max-rate keystrokes/s]]\n"
+                << "   or: " << name << " --serve [--workers n]\n";
+}
+
+int main(int argc, char **argv)
+{
+      LoadConfig config;
+      bool serve = false, sweep = false, json = false;
+      std::string serverCommand, workersList = "1,2,4,8", linesList = "1000,10000,100000";
+      double slo = 50, maxRate = 1000;
+      for (int i = 1; i < argc; i++)
+      {
+            std::string arg = argv[i];
+            const bool hasValue = i + 1 < argc;
+            if (arg == "--serve")
+                  serve = true;
+            else if (arg == "--sweep")
+                  sweep = true;
+            else if (arg == "--json")
+                  json = true;
+            else if (arg == "--clients" && hasValue)
+                  config.clients = std::atoi(argv[++i]);
+            else if (arg == "--servers" && hasValue)
+                  config.servers = std::atoi(argv[++i]);
+            else if (arg == "--workers" && hasValue)
+                  config.workers = std::atoi(argv[++i]);
+            else if (arg == "--lines" && hasValue)
+                  config.lines = std::max(1, std::atoi(argv[++i]));
+            else if (arg == "--rate" && hasValue)
+                  config.rate = std::atof(argv[++i]);
+            else if (arg == "--duration" && hasValue)
+                  config.duration = std::chrono::milliseconds(std::atoi(argv[++i]));
+            else if (arg == "--hover-every" && hasValue)
+                  config.hoverEvery = std::atoi(argv[++i]);
+            else if (arg == "--server" && hasValue)
+                  serverCommand = argv[++i];
+            else if (arg == "--workers-list" && hasValue)
+                  workersList = argv[++i];
+            else if (arg == "--lines-list" && hasValue)
+                  linesList = argv[++i];
+            else if (arg == "--slo" && hasValue)
+                  slo = std::atof(argv[++i]);
+            else if (arg == "--max-rate" && hasValue)
+                  maxRate = std::atof(argv[++i]);
+            else
+            {
+                  usage(argv[0]);
+                  return 2;
+            }
+      }
+
+      if (serve)
+      {
+            LoadTargetServer server;
+            server.init(ServerCapabilities::completionProvider | ServerCapabilities::hoverProvider, std::cin, std::cout, config.workers);
+            return server.exit();
+      }
+      if (config.rate <= 0)
+      {
+            usage(argv[0]);
+            return 2;
+      }
+
+      auto commandFor = [&](size_t workers)
+      {
+            if (!serverCommand.empty())
+                  return split(serverCommand, ' ');
+            return std::vector<std::string>{argv[0], "--serve", "--workers", std::to_string(workers)};
+      };
+
+      if (!sweep)
+      {
+            config.serverCommand = commandFor(config.workers);
+            auto result = runLoad(config);
+            if (!result)
+            {
+                  std::cerr << "server did not start\n";
+                  return 1;
+            }
+            if (json)
+                  std::cout << toJson(config, *result).dump(2) << '\n';
+            else
+                  printResult(config, *result);
+            return 0;
+      }
+
+      nlohmann::json points = nlohmann::json::array();
+      if (!json)
+            std::cout << std::left << std::setw(10) << "workers" << std::setw(10) << "lines" << std::right << std::setw(22) << "saturation keys/s" << std::setw(18) << "completion p99 ms" << '\n';
+      for (const std::string &workers : split(workersList, ','))
+      {
+            for (const std::string &lines : split(linesList, ','))
+            {
+                  LoadConfig step = config;
+                  step.workers = std::atoi(workers.c_str());
+                  step.lines = std::max(1, std::atoi(lines.c_str()));
+                  step.serverCommand = commandFor(step.workers);
+
+                  // Doubles the rate until latency or lost answers show the server cannot keep up
+                  std::optional<LoadResult> sustained;
+                  for (double rate = config.rate; rate <= maxRate; rate *= 2)
+                  {
+                        step.rate = rate;
+                        auto result = runLoad(step);
+                        if (!result)
+                              break;
+                        const MethodStats *completion = result->method("textDocument/completion");
+                        const bool saturated = (completion && completion->p99 / 1e6 > slo) || result->answeredPerSecond < 0.9 * result->requestsPerSecond;
+                        if (saturated)
+                              break;
+                        sustained = result;
+                  }
+
+                  const MethodStats *completion = sustained ? sustained->method("textDocument/completion") : nullptr;
+                  const double keys = sustained ? sustained->keystrokesPerSecond : 0;
+                  const double p99 = completion ? completion->p99 / 1e6 : 0;
+                  if (json)
+                        points.push_back({{"workers", step.workers}, {"lines", step.lines}, {"saturation_keystrokes_per_second", keys}, {"completion_p99_ms", p99}});
+                  else
+                        std::cout << std::left << std::setw(10) << step.workers << std::setw(10) << step.lines << std::right << std::fixed << std::setprecision(1)
+                                  << std::setw(22) << keys << std::setw(18) << std::setprecision(2) << p99 << std::endl;
+            }
+      }
+      if (json)
+            std::cout << nlohmann::json{{"clients", config.clients}, {"slo_ms", slo}, {"points", points}}.dump(2) << '\n';
+      return 0;
+}
@@ -0,0 +1,80 @@
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include "Server.hpp"
+#include "SessionReplay.hpp"
+
+// Replays a session recorded with LSPP_RECORD_FILE (or LSPServer::recordSession) into a
+// bare LSPServer and prints the latency of every method and the overall message rate.
+// Only the library's own work is measured: framing, document sync and dispatch. To
+// include a server's callbacks, call replaySession() on that server instead.
+//
+//     LSPP_RECORD_FILE=session.lspprec my_server
+//     lspp_replay session.lspprec --paced
+
+static void usage(const char *name)
+{
+      std::cerr << "usage: " << name << " recording [--paced] [--speed factor] [--workers count] [--json]\n";
+}
+
+int main(int argc, char **argv)
+{
+      if (argc < 2)
+      {
+            usage(argv[0]);
+            return 2;
+      }
+
+      ReplayOptions options;
+      bool json = false;
+      for (int i = 2; i < argc; i++)
+      {
+            std::string arg = argv[i];
+            if (arg == "--paced")
+                  options.paced = true;
+            else if (arg == "--speed" && i + 1 < argc)
+                  options.speed = std::atof(argv[++i]);
+            else if (arg == "--workers" && i + 1 < argc)
+                  options.workerThreads = std::atoi(argv[++i]);
+            else if (arg == "--json")
+                  json = true;
+            else
+            {
+                  usage(argv[0]);
+                  return 2;
+            }
+      }
+
+      auto frames = readSessionRecording(argv[1]);
+      if (!frames)
+      {
+            std::cerr << argv[1] << " is not a session recording\n";
+            return 1;
+      }
+
+      // Every capability, so no request is turned away before dispatch
+      LSPServer server;
+      ReplayReport report = replaySession(server, ~uint64_t(0), *frames, options);
+
+      if (json)
+      {
+            nlohmann::json methods = nlohmann::json::array();
+            for (const MethodLatency &m : report.methods)
+                  methods.push_back({{"method", m.method}, {"requests", m.requests}, {"p50_ns", m.p50}, {"p99_ns", m.p99}, {"p999_ns", m.p999}, {"max_ns", m.max}});
+            std::cout << nlohmann::json{{"messages", report.messages}, {"responses", report.responses}, {"seconds", report.seconds}, {"messages_per_second", report.messagesPerSecond}, {"methods", methods}}.dump(2) << '\n';
+            return 0;
+      }
+
+      auto us = [](uint64_t ns)
+      { return ns / 1000.0; };
+      std::cout << std::fixed << std::setprecision(1)
+                << report.messages << " messages in " << report.seconds << " s, " << report.messagesPerSecond << " messages/s, "
+                << report.responses << " responses\n\n"
+                << std::left << std::setw(40) << "method" << std::right << std::setw(10) << "requests"
+                << std::setw(12) << "p50 us" << std::setw(12) << "p99 us" << std::setw(12) << "p999 us" << std::setw(12) << "max us" << '\n';
+      for (const MethodLatency &m : report.methods)
+            std::cout << std::left << std::setw(40) << m.method << std::right << std::setw(10) << m.requests
+                      << std::setw(12) << us(m.p50) << std::setw(12) << us(m.p99) << std::setw(12) << us(m.p999) << std::setw(12) << us(m.max) << '\n';
+      return 0;
+}
@@ -15,9 +15,10 @@ public:
 			    {
 				    return std::nullopt;
 			    }
-			    std::string word = docOpt->get().wordUnderCursor(params.position.line, params.position.character);
+			    // Views the document text, valid while docOpt holds the snapshot
+			    std::string_view word = docOpt->get().wordUnderCursor(params.position.line, params.position.character, positionEncoding());
 
-			    return hoverResult{{MarkupKind::PlainText, "This is my custom response for: " + word}, std::nullopt};
+			    return hoverResult{{MarkupKind::PlainText, "This is my custom response for: " + std::string(word)}, std::nullopt};
 		    });
 	}
 };
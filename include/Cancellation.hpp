@@ -0,0 +1,53 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include "Message.hpp"
+
+// Read side of a cancellation flag. Long running callbacks should poll
+// isCancelled() and bail out early once the client has given up on them.
+class CancellationToken
+{
+      std::shared_ptr<const std::atomic<bool>> m_flag;
+
+public:
+      // A token that is never cancelled
+      CancellationToken() = default;
+      explicit CancellationToken(std::shared_ptr<const std::atomic<bool>> flag) : m_flag(std::move(flag)) {}
+
+      bool isCancelled() const
+      {
+            return m_flag && m_flag->load(std::memory_order_relaxed);
+      }
+};
+
+// In-flight requests by id, so that $/cancelRequest can reach them
+class CancellationRegistry
+{
+      std::mutex m_mutex;
+      std::unordered_map<RequestId, std::shared_ptr<std::atomic<bool>>> m_pending;
+
+public:
+      CancellationToken add(RequestId id);
+      // Returns false if no request with that id is in flight
+      bool cancel(RequestId id);
+      void remove(RequestId id);
+
+      // Removes the request once destroyed, whether its handler returned or threw
+      class Registration
+      {
+            CancellationRegistry &m_registry;
+            RequestId m_id;
+
+      public:
+            Registration(CancellationRegistry &registry, RequestId id) : m_registry(registry), m_id(id) {}
+            ~Registration()
+            {
+                  m_registry.remove(m_id);
+            }
+
+            Registration(const Registration &) = delete;
+            Registration &operator=(const Registration &) = delete;
+      };
+};
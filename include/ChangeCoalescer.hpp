@@ -0,0 +1,70 @@
+#pragma once
+#include "ProtocolStructures.hpp"
+#include "PositionEncoding.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Collects didChange edits per document and reports them once typing pauses.
+// A document settles when no edit arrived for the quiet period, or when the
+// maximum delay since its first unreported edit has passed.
+class ChangeCoalescer
+{
+public:
+      using Clock = std::chrono::steady_clock;
+      // Dirty ranges are in the coordinates of the current document text, sorted and non-overlapping
+      using SettledCallback = std::function<void(const std::string &uri, const std::vector<Range> &dirty)>;
+
+      ChangeCoalescer();
+      ~ChangeCoalescer();
+
+      void setCallback(SettledCallback callback, std::chrono::milliseconds quietPeriod, std::chrono::milliseconds maxDelay);
+      bool enabled() const;
+      // Unit of the characters in edit ranges and dirty ranges, UTF-16 unless negotiated otherwise
+      void setPositionEncoding(PositionEncoding encoding);
+
+      // Record an edit that replaced `range` with `text`
+      void documentChanged(const std::string &uri, const Range &range, const std::string &text);
+      // Record a full replacement of the document text
+      void documentReplaced(const std::string &uri, const std::string &text);
+      // Forget pending edits of a closed document
+      void documentClosed(const std::string &uri);
+
+      // Report every pending document now
+      void flush();
+      // Drop pending edits and stop the timer thread
+      void stop();
+
+      // Moves the accumulated ranges through an edit and adds the edited region.
+      // Characters count code units of `encoding`.
+      static void applyEdit(std::vector<Range> &dirty, const Range &range, const std::string &text, PositionEncoding encoding);
+
+private:
+      struct Pending
+      {
+            std::vector<Range> dirty;
+            Clock::time_point firstChange;
+            Clock::time_point lastChange;
+      };
+
+      SettledCallback m_callback;
+      std::chrono::milliseconds m_quietPeriod;
+      std::chrono::milliseconds m_maxDelay;
+      std::atomic<PositionEncoding> m_positionEncoding{PositionEncoding::UTF16};
+
+      std::unordered_map<std::string, Pending> m_pending;
+      std::mutex m_mutex;
+      std::condition_variable m_cv;
+      std::thread m_timer;
+      bool m_stopping;
+
+      void record(const std::string &uri, const Range &range, const std::string &text, bool replaceAll);
+      Clock::time_point deadline(const Pending &pending) const;
+      void run();
+};
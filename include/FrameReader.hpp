@@ -0,0 +1,60 @@
+#pragma once
+#include <cstddef>
+#include <istream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Splits an LSP byte stream into "Content-Length" framed payloads.
+//
+// Input is read in large chunks into a buffer that is reused for the lifetime
+// of the reader, and payloads are handed out as views into that buffer, so
+// once the buffer has grown to fit the largest message no further allocation
+// happens. When reading from std::cin the file descriptor is read directly.
+class FrameReader
+{
+public:
+      // Use reasonable upper limit (10MB) to prevent bad_alloc from malformed/malicious data
+      static constexpr size_t MAX_MESSAGE_SIZE = 10 * 1024 * 1024;
+      static constexpr size_t MAX_HEADER_SIZE = 8 * 1024;
+
+      explicit FrameReader(std::istream &in, size_t initialCapacity = 64 * 1024);
+
+      // Reads the next frame into `payload`, which stays valid until the next call.
+      // Returns the payload size, 0 if a malformed frame was skipped, or -1 on
+      // EOF, read errors and oversized frames.
+      int next(std::string_view &payload);
+      // Headers and payload of the frame last returned by next(), exactly as read
+      std::string_view frame() const;
+
+      // Parses a header block (without the terminating blank line) and extracts
+      // the Content-Length value. Header names are matched case-insensitively.
+      static bool parseContentLength(std::string_view headers, size_t &contentLength);
+
+private:
+      std::istream &m_in;
+      int m_fd;
+      std::vector<char> m_buffer;
+      size_t m_begin; // Start of unconsumed data
+      size_t m_end;   // End of valid data
+      size_t m_next;  // Start of the frame following the one last returned
+
+      bool fill(size_t required);
+      static size_t findHeaderEnd(const char *data, size_t from, size_t size);
+};
+
+// Splits bytes handed over as they arrive into payloads, for output that is written
+// rather than read, such as a server's captured stdout. Malformed headers are skipped
+// like FrameReader::next() skips them.
+class FrameSplitter
+{
+public:
+      void append(const char *data, size_t size);
+      // Next complete payload, valid until the next append(). std::nullopt until one has fully arrived.
+      std::optional<std::string_view> next();
+
+private:
+      std::string m_data;
+      size_t m_begin = 0; // Start of the first frame not handed out yet
+};
@@ -0,0 +1,74 @@
+#pragma once
+#include <functional>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "ProtocolStructures.hpp"
+#include "PositionEncoding.hpp"
+#include "WordRules.hpp"
+#include "textDocument.hpp"
+
+// Where every identifier of one document occurs, for documentHighlight and
+// references. An identifier is a run of word characters not starting with a
+// digit. Occurrences are kept in immutable blocks of consecutive lines, numbered
+// from the start of their block: an edit re-reads only the blocks it touched, and
+// later lines move with their block without being rewritten. Copies share the
+// blocks, so indexing a new version costs the same whatever the document size.
+//
+// Ranges use the position encoding given at construction. Safe to query from
+// several threads while another one updates it.
+class IdentifierIndex
+{
+public:
+      explicit IdentifierIndex(const WordRules &rules = defaultWordRules, PositionEncoding encoding = PositionEncoding::UTF16);
+      // Shares the blocks, so a new version can be indexed while readers keep this one
+      IdentifierIndex(const IdentifierIndex &other);
+      IdentifierIndex &operator=(const IdentifierIndex &) = delete;
+
+      void rebuild(const textDocument &document);
+      // `range` is the edited range in the coordinates before the edit, `document` the text after it
+      void update(const textDocument &document, const Range &range, std::string_view text);
+
+      // Sorted by position
+      std::vector<Range> occurrences(std::string_view identifier) const;
+      std::vector<Location> locations(std::string_view identifier, const DocumentUri &uri) const;
+      size_t identifierCount() const;
+
+private:
+      struct ViewHash
+      {
+            using is_transparent = void;
+            size_t operator()(std::string_view s) const { return std::hash<std::string_view>{}(s); }
+      };
+
+      using Occurrences = std::unordered_map<std::string, std::vector<Range>, ViewHash, std::equal_to<>>;
+      struct Block
+      {
+            size_t lines = 0;
+            // Sorted by position, lines counted from the first line of the block
+            Occurrences occurrences;
+      };
+      // Consecutive blocks, shared between copies the same way, so a copy or an edit does not
+      // have to go through every block of a long document
+      struct Segment
+      {
+            size_t lines = 0;
+            std::vector<std::shared_ptr<const Block>> blocks;
+      };
+      // Lines per block when indexing; smaller blocks mean less to re-read per edit but more to query
+      static constexpr size_t blockLines = 64;
+      static constexpr size_t segmentBlocks = 64;
+
+      WordRules m_rules;
+      PositionEncoding m_encoding;
+      std::vector<std::shared_ptr<const Segment>> m_segments;
+      size_t m_lineCount = 0;
+      mutable std::shared_mutex m_mutex;
+
+      std::vector<std::shared_ptr<const Block>> indexLines(const textDocument &document, size_t first, size_t last) const;
+      std::shared_ptr<const Block> indexBlock(const textDocument &document, size_t first, size_t last) const;
+      static std::vector<std::shared_ptr<const Segment>> segmentsOf(const std::vector<std::shared_ptr<const Block>> &blocks);
+};
@@ -0,0 +1,69 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Forward-only pull scanner over a JSON text. It never builds a tree: values
+// are either read into the caller's variables or skipped, so a consumer can
+// extract a few fields of a large document without touching the rest.
+//
+// Any syntax error puts the reader in a failed state where every further call
+// returns false.
+class JsonReader
+{
+public:
+      explicit JsonReader(std::string_view json);
+
+      bool ok() const;
+      size_t position() const;
+
+      enum class Type
+      {
+            Object,
+            Array,
+            String,
+            Number,
+            Boolean,
+            Null,
+            End,
+            Invalid
+      };
+      // Type of the next value, without consuming it
+      Type peek();
+
+      // Objects: call beginObject() then nextMember() until it returns false.
+      // nextMember() consumes the key and the ':' so the member value is next.
+      bool beginObject();
+      bool nextMember(std::string_view &key);
+      // Advances through the members of the current object until `key`, leaving
+      // its value next. Returns false (with the object consumed) if it is absent.
+      bool findMember(std::string_view key);
+
+      // Arrays: call beginArray() then nextElement() until it returns false.
+      bool beginArray();
+      bool nextElement();
+
+      bool readString(std::string &out);
+      // Raw contents between the quotes, escape sequences are left untouched
+      bool readStringView(std::string_view &out);
+      bool readInt(int64_t &out);
+      bool readUInt(uint64_t &out);
+      bool readBool(bool &out);
+      bool readNull();
+
+      bool skipValue();
+      // Skips the next value and returns the exact text it spans
+      bool captureValue(std::string_view &out);
+
+private:
+      std::string_view m_json;
+      size_t m_pos;
+      bool m_failed;
+
+      void skipWhitespace();
+      bool consume(char c);
+      bool fail();
+      bool skipString();
+      bool skipScalar();
+};
@@ -0,0 +1,102 @@
+#pragma once
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Appends JSON text to a string without building a tree. Commas between
+// members and elements are inserted automatically; the caller is responsible
+// for balancing begin/end calls.
+//
+// Protocol types are written through free `writeJson(JsonWriter &, const T &)`
+// overloads found by argument dependent lookup, so `value()` accepts any type
+// that has one, and vectors and optionals of such types.
+class JsonWriter
+{
+public:
+      explicit JsonWriter(std::string &out);
+
+      void beginObject();
+      void endObject();
+      void beginArray();
+      void endArray();
+      void key(std::string_view name);
+
+      void value(std::string_view s);
+      void value(const char *s);
+      void value(const std::string &s);
+      void value(bool b);
+      void value(std::nullptr_t);
+      // Already serialized JSON, copied verbatim
+      void raw(std::string_view json);
+
+      template <std::integral T>
+      void value(T n)
+      {
+            if constexpr (std::is_signed_v<T>)
+                  writeInt(static_cast<int64_t>(n));
+            else
+                  writeUInt(static_cast<uint64_t>(n));
+      }
+
+      // Overloads below only see the ones declared before them in their constraints
+      template <typename T>
+            requires requires(JsonWriter &w, const T &v) { writeJson(w, v); }
+      void value(const T &v)
+      {
+            writeJson(*this, v);
+      }
+
+      template <typename T>
+            requires requires(JsonWriter &w, const T &v) { w.value(v); }
+      void value(const std::optional<T> &v)
+      {
+            if (v.has_value())
+                  value(*v);
+            else
+                  value(nullptr);
+      }
+
+      template <typename T>
+            requires requires(JsonWriter &w, const T &v) { w.value(v); }
+      void value(const std::vector<T> &values)
+      {
+            m_out.reserve(m_out.size() + values.size() * 16);
+            beginArray();
+            for (const T &v : values)
+                  value(v);
+            endArray();
+      }
+
+      template <typename T>
+      void member(std::string_view name, const T &v)
+      {
+            key(name);
+            value(v);
+      }
+
+      // Skips absent optionals instead of writing null
+      template <typename T>
+      void optionalMember(std::string_view name, const std::optional<T> &v)
+      {
+            if (v.has_value())
+                  member(name, *v);
+      }
+
+private:
+      std::string &m_out;
+      // Whether the innermost open container already has an entry
+      std::vector<bool> m_hasEntry;
+      bool m_afterKey;
+
+      void separate();
+      void writeInt(int64_t n);
+      void writeUInt(uint64_t n);
+};
+
+// Types the writer can serialize without going through nlohmann::json
+template <typename T>
+concept JsonWritable = requires(JsonWriter &w, const T &v) { w.value(v); };
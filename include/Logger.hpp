@@ -0,0 +1,94 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+enum class LogLevel
+{
+      Debug,
+      Info,
+      Warning,
+      Error,
+      Off
+};
+
+// Writes log lines from a background thread. Producers push onto a bounded
+// lock-free queue and never touch the file; the writer thread drains it in
+// batches through one persistent handle. Lines are dropped when the queue is full.
+class Logger
+{
+public:
+      static constexpr size_t QUEUE_CAPACITY = 4096; // Power of two
+
+      // Logs nothing
+      Logger();
+      // Appends to `path`, messages below `level` are discarded
+      Logger(const std::string &path, LogLevel level);
+      ~Logger();
+
+      Logger(const Logger &) = delete;
+      Logger &operator=(const Logger &) = delete;
+
+      // Process wide logger, configured from LSPP_LOG_FILE and LSPP_LOG_LEVEL
+      static Logger &instance();
+
+      bool enabled(LogLevel level) const
+      {
+            return level >= m_level;
+      }
+
+      void write(LogLevel level, std::string text);
+      // Blocks until every line written so far is in the file
+      void flush();
+      // Lines lost to a full queue
+      size_t dropped() const;
+
+      static LogLevel parseLevel(const char *name, LogLevel fallback);
+
+private:
+      struct Entry
+      {
+            LogLevel level;
+            std::chrono::system_clock::time_point time;
+            std::string text;
+      };
+
+      // Bounded MPSC ring, each cell's sequence number tells whose turn it is
+      struct Cell
+      {
+            std::atomic<size_t> sequence;
+            Entry entry;
+      };
+
+      LogLevel m_level;
+      std::FILE *m_file;
+      std::unique_ptr<std::array<Cell, QUEUE_CAPACITY>> m_cells;
+      alignas(64) std::atomic<size_t> m_enqueuePos;
+      alignas(64) size_t m_dequeuePos;
+      std::atomic<size_t> m_dropped;
+      std::atomic<size_t> m_written;
+      std::atomic<size_t> m_accepted;
+
+      std::mutex m_wakeMutex;
+      std::condition_variable m_wake;
+      std::atomic<bool> m_sleeping;
+      std::atomic<bool> m_stopping;
+      std::thread m_writer;
+
+      bool tryPop(Entry &entry);
+      void run();
+};
+
+// Only evaluates `text` when `level` is enabled, so disabled logging costs one comparison
+#define LSPP_LOG(level, text)                                 \
+      do                                                      \
+      {                                                       \
+            if (Logger::instance().enabled(level))            \
+                  Logger::instance().write((level), (text));  \
+      } while (0)
@@ -1,32 +1,71 @@
 #pragma once
+#include <chrono>
 #include <cstddef>
 #include <memory>
 #include <string>
 #include <nlohmann/json.hpp>
 #include <optional>
+#include <string_view>
+#include "FrameReader.hpp"
+
+class JsonReader;
+
+// Request ids as Message reads them: LSP integers, which are 32 bit. String ids are not supported.
+using RequestId = int;
 
 class Message
 {
-	char *m_buffer;
-	size_t m_payloadSize;
-	/*std::unique_ptr<char> m_buffer;*/
-	nlohmann::json m_jsonData;
+	std::string m_storage;	  // Owned payload bytes, reused between reads
+	std::string_view m_payload; // Either m_storage or a view into a FrameReader buffer
+
+	// Routing fields, extracted by scanning the payload without building a JSON tree
+	bool m_valid;
+	std::string m_method;
+	std::optional<RequestId> m_id;
+	std::string m_uri;
+	size_t m_jsonrpcOffset, m_jsonrpcLength;
+	size_t m_paramsOffset, m_paramsLength;
+
+	// Full params tree, only parsed when a handler asks for it
+	mutable std::optional<nlohmann::json> m_params;
+	std::chrono::nanoseconds m_scanTime;
+
+	int scanPayload();
+	int timedScanPayload();
+	void reset();
 
 public:
 	// Message(const char* buffer, const size_t& bufsize);
 	Message(std::istream &buffer);
 	Message();
-	~Message();
+	Message(const Message &other);
+	Message &operator=(const Message &other);
 	std::string get() const;
+	// Raw payload, valid until the next read (or until the FrameReader it came from reads again)
+	std::string_view payload() const;
+	// Parses the whole payload, prefer the field accessors below
 	nlohmann::json jsonData() const;
 	int readMessage(std::istream &stream);
+	// Reads the next frame from `reader` without copying the payload
+	int readMessage(FrameReader &reader);
+	// Copies a payload borrowed from a FrameReader into the message's own storage
+	void detach();
 
-	std::string method_description() const;
-	nlohmann::json params() const;
-	std::optional<int> id() const;
-	std::string documentURI() const;
+	bool isValid() const;
+	std::string_view jsonrpc() const;
+	const std::string &method_description() const;
+	const nlohmann::json &params() const;
+	// Unparsed text of the "params" member, empty if there is none
+	std::string_view paramsSpan() const;
+	std::optional<RequestId> id() const;
+	// Reads an id value, std::nullopt (with the value skipped) for strings and numbers outside RequestId
+	static std::optional<RequestId> readId(JsonReader &reader);
+	const std::string &documentURI() const;
+	// Time the last read spent extracting the routing fields, excluding the wait for input
+	std::chrono::nanoseconds scanTime() const;
 
 	static void log(const std::string_view &s);
+	static bool logEnabled();
 
 	enum Method
 	{
@@ -77,6 +116,7 @@ public:
 		TEXT_DOCUMENT_RENAME,
 		TEXT_DOCUMENT_PREPARE_RENAME,
 		TEXT_DOCUMENT_LINKED_EDITING_RANGE,
+		WORKSPACE_SYMBOL,
 		WORKSPACE_CODE_LENS_REFRESH,
 		WORKSPACE_INLAY_HINT_REFRESH,
 		WORKSPACE_INLINE_VALUE_REFRESH,
@@ -84,49 +124,111 @@ public:
 		WORKSPACE_DIAGNOSTIC_REFRESH,
 		TEXT_DOCUMENT_DID_OPEN,
 		TEXT_DOCUMENT_DID_CHANGE,
-		TEXT_DOCUMENT_DID_CLOSE
+		TEXT_DOCUMENT_DID_CLOSE,
+		CANCEL_REQUEST,
+		METHOD_COUNT // Not a method, sizes tables indexed by Method
 	};
 
+	// Resolved once when the message is read
 	Method method() const;
 
 	// Get the string name for a Method enum
 	static std::string methodToString(Method method);
-	static Method stringToMethod(const std::string &methodStr);
+	static std::string_view methodName(Method method);
+	static Method stringToMethod(std::string_view methodStr);
+
+private:
+	Method m_methodId;
 };
 
 class Response
 {
+	// Result serialized by JsonWriter, written into the envelope verbatim
+	std::optional<std::string> m_rawResult;
+
 public:
 	nlohmann::json data;
 
-	explicit Response(const Message &message) : data({{"id", message.id()}}) {}
+	explicit Response(const Message &message) : Response(message.id()) {}
+	explicit Response(std::optional<RequestId> id) : data({{"id", id}}) {}
 
 	void setResult(const nlohmann::json &result)
 	{
+		m_rawResult.reset();
 		data["result"] = result;
 	}
 
+	// `json` must be a complete JSON value
+	void setRawResult(std::string json)
+	{
+		data.erase("result");
+		m_rawResult = std::move(json);
+	}
+
 	void setError(const nlohmann::json &error)
 	{
+		m_rawResult.reset();
+		data.erase("result");
 		data["error"] = error;
 	}
 
-	std::string toString() const
+	// The result as a tree, parsing a raw result if needed
+	nlohmann::json result() const
+	{
+		if (m_rawResult)
+			return nlohmann::json::parse(*m_rawResult);
+		return data.value("result", nlohmann::json());
+	}
+
+	// Serialized JSON body, without the Content-Length header
+	std::string body() const
 	{
 		try
 		{
-			// Dump JSON once and reuse
-			std::string json_str = data.dump();
+			// Invalid UTF-8 becomes U+FFFD, as JsonWriter writes it
+			constexpr auto replace = nlohmann::json::error_handler_t::replace;
+			if (!m_rawResult)
+				return data.dump(-1, ' ', false, replace);
+			if (data.size() != 1)
+			{
+				// Members other than the id were added by hand, merge the slow way
+				nlohmann::json merged = data;
+				merged["result"] = result();
+				return merged.dump(-1, ' ', false, replace);
+			}
 
-			// Pre-allocate to avoid multiple reallocations during concatenation
-			std::string result;
-			result.reserve(json_str.length() + 50); // Header + CRLF + safety margin
+			// Same layout as data.dump() would produce with the result in place
+			std::string out;
+			out.reserve(m_rawResult->size() + 32);
+			out += "{\"id\":";
+			out += data.at("id").dump();
+			out += ",\"result\":";
+			out += *m_rawResult;
+			out += '}';
+			return out;
+		}
+		catch (const std::bad_alloc &)
+		{
+			// Return minimal valid response on allocation failure
+			return "{}";
+		}
+	}
 
-			result = "Content-Length: ";
-			result += std::to_string(json_str.length());
-			result += "\r\n\r\n";
-			result += json_str;
+	static std::string header(size_t bodyLength)
+	{
+		std::string result = "Content-Length: ";
+		result += std::to_string(bodyLength);
+		result += "\r\n\r\n";
+		return result;
+	}
 
+	std::string toString() const
+	{
+		std::string json_str = body();
+		try
+		{
+			std::string result = header(json_str.length());
+			result += json_str;
 			return result;
 		}
 		catch (const std::bad_alloc &)
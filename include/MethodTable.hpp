@@ -0,0 +1,49 @@
+#pragma once
+#include <array>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include "Message.hpp"
+
+// Per-method values. Protocol methods sit in a dense array indexed by
+// Message::Method, only custom method names go through a string map.
+template <typename T>
+class MethodTable
+{
+      std::array<std::optional<T>, Message::METHOD_COUNT> m_known;
+      std::unordered_map<std::string, T> m_custom;
+
+public:
+      void set(Message::Method method, T value)
+      {
+            m_known[method] = std::move(value);
+      }
+
+      void set(const std::string &method, T value)
+      {
+            Message::Method known = Message::stringToMethod(method);
+            if (known != Message::Method::NONE)
+                  set(known, std::move(value));
+            else
+                  m_custom[method] = std::move(value);
+      }
+
+      const T *find(Message::Method method) const
+      {
+            return m_known[method] ? &*m_known[method] : nullptr;
+      }
+
+      // `name` is only looked at for custom methods, i.e. when `method` is NONE
+      const T *find(Message::Method method, const std::string &name) const
+      {
+            if (method != Message::Method::NONE)
+                  return find(method);
+            auto it = m_custom.find(name);
+            return it != m_custom.end() ? &it->second : nullptr;
+      }
+
+      const T *find(const std::string &name) const
+      {
+            return find(Message::stringToMethod(name), name);
+      }
+};
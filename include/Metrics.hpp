@@ -0,0 +1,120 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include "Message.hpp"
+
+// Histogram of nanosecond durations in the style of HdrHistogram: each power of two
+// is split into SUB_BUCKETS linear buckets, so a reported value is within 1/SUB_BUCKETS
+// of the recorded one. Recording is a handful of relaxed atomic operations and safe
+// from any thread.
+class LatencyHistogram
+{
+public:
+      static constexpr size_t SUB_BUCKET_BITS = 4;
+      static constexpr size_t SUB_BUCKETS = size_t(1) << SUB_BUCKET_BITS;
+      // Up to 2^42 ns (about 73 minutes), longer durations count as the largest bucket
+      static constexpr size_t MAX_BITS = 42;
+      static constexpr size_t BUCKET_COUNT = (MAX_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+      struct Summary
+      {
+            uint64_t count = 0;
+            uint64_t mean = 0;
+            uint64_t p50 = 0;
+            uint64_t p90 = 0;
+            uint64_t p99 = 0;
+            uint64_t p999 = 0;
+            uint64_t max = 0;
+      };
+
+      LatencyHistogram();
+
+      void record(uint64_t nanoseconds);
+      void record(std::chrono::nanoseconds duration)
+      {
+            record(static_cast<uint64_t>(std::max<int64_t>(0, duration.count())));
+      }
+
+      // Percentiles report the highest value of their bucket
+      Summary summary() const;
+
+      static size_t bucketFor(uint64_t nanoseconds);
+      static uint64_t bucketLimit(size_t bucket);
+
+private:
+      std::array<std::atomic<uint64_t>, BUCKET_COUNT> m_buckets;
+      std::atomic<uint64_t> m_count;
+      std::atomic<uint64_t> m_sum;
+      std::atomic<uint64_t> m_max;
+};
+
+// Everything ServerMetrics counted up to one point, plus the document store's size
+struct MetricsSnapshot
+{
+      struct MethodLatency
+      {
+            std::string method; // "custom" for methods outside Message::Method
+            LatencyHistogram::Summary latency;
+      };
+
+      std::vector<MethodLatency> methods; // Only methods seen so far
+      LatencyHistogram::Summary queueWait;
+      LatencyHistogram::Summary parse;
+      LatencyHistogram::Summary serialize;
+      size_t queueDepth = 0;
+      size_t maxQueueDepth = 0;
+      uint64_t messagesIn = 0;
+      uint64_t messagesOut = 0;
+      uint64_t bytesIn = 0;
+      uint64_t bytesOut = 0;
+      size_t openDocuments = 0;
+      size_t documentBytes = 0;
+};
+
+void to_json(nlohmann::json &j, const LatencyHistogram::Summary &s);
+
+// Nearest-rank percentile of exact samples sorted in ascending order, 0 if there are none
+uint64_t percentile(const std::vector<uint64_t> &sorted, double p);
+void to_json(nlohmann::json &j, const MetricsSnapshot &s);
+
+// Always on counters of an LSPServer. Latency is measured from reading a message to
+// having answered it (or, for notifications, having processed it), so for requests
+// handed to workers it includes the time spent queued. Histograms of methods are
+// allocated the first time the method is seen.
+class ServerMetrics
+{
+public:
+      ServerMetrics();
+      ~ServerMetrics();
+
+      ServerMetrics(const ServerMetrics &) = delete;
+      ServerMetrics &operator=(const ServerMetrics &) = delete;
+
+      void messageReceived(size_t bytes, std::chrono::nanoseconds parse);
+      void messageSent(size_t bytes, std::chrono::nanoseconds serialize);
+      void messageHandled(Message::Method method, std::chrono::nanoseconds latency);
+      void requestQueued();
+      void requestDequeued(std::chrono::nanoseconds wait);
+
+      // Latency histogram of a method, nullptr until it was seen
+      const LatencyHistogram *latency(Message::Method method) const;
+      MetricsSnapshot snapshot() const;
+
+private:
+      std::array<std::atomic<LatencyHistogram *>, Message::METHOD_COUNT> m_methods;
+      LatencyHistogram m_queueWait;
+      LatencyHistogram m_parse;
+      LatencyHistogram m_serialize;
+      std::atomic<size_t> m_queueDepth;
+      std::atomic<size_t> m_maxQueueDepth;
+      std::atomic<uint64_t> m_messagesIn;
+      std::atomic<uint64_t> m_messagesOut;
+      std::atomic<uint64_t> m_bytesIn;
+      std::atomic<uint64_t> m_bytesOut;
+};
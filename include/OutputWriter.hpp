@@ -0,0 +1,69 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// How long an outgoing message may wait to be written together with others
+struct FlushPolicy
+{
+      std::chrono::microseconds maxDelay; // Oldest queued message is written by then
+      size_t maxBytes;                    // Write right away once this much is queued
+
+      // Write every message as soon as it is queued
+      static FlushPolicy immediate()
+      {
+            return {std::chrono::microseconds(0), 0};
+      }
+
+      static FlushPolicy batched(std::chrono::microseconds maxDelay = std::chrono::microseconds(500), size_t maxBytes = 64 * 1024)
+      {
+            return {maxDelay, maxBytes};
+      }
+};
+
+// Queues framed messages as separate header and body buffers and writes
+// whatever is pending in one go: a single writev(2) when the output is
+// std::cout, sequential ostream writes otherwise. Callers serialize before
+// queueing, so the lock only covers moving buffers around.
+class OutputWriter
+{
+public:
+      explicit OutputWriter(std::ostream &out);
+      ~OutputWriter();
+
+      void setStream(std::ostream &out);
+
+      void write(std::string header, std::string body, const FlushPolicy &policy);
+      // Writes everything queued so far
+      void flush();
+
+      // Holds off writes, e.g. while a test reads back an ostringstream
+      std::unique_lock<std::mutex> lockStream() const;
+      const std::ostream *stream() const;
+
+private:
+      std::ostream *m_out;
+      int m_fd; // stdout when m_out is std::cout, -1 otherwise
+
+      // Pending buffers, in write order
+      std::vector<std::string> m_pending;
+      size_t m_pendingBytes;
+      std::chrono::steady_clock::time_point m_deadline;
+      std::mutex m_queueMutex;
+
+      // Serializes the actual writes so that batches keep their order
+      mutable std::mutex m_writeMutex;
+
+      std::condition_variable m_cv;
+      std::thread m_flusher;
+      bool m_stopping;
+
+      void writeBatch(std::vector<std::string> &batch);
+      void writeToFd(const std::vector<std::string> &batch);
+      void run();
+};
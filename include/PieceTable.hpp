@@ -0,0 +1,79 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Text storage made of pieces referencing immutable buffers. Pieces are kept in
+// a treap ordered by document position, where every node caches the byte and
+// newline totals of its subtree, so edits, slices and line lookups are
+// O(log n). Nodes are never modified once built: edits rebuild the path to the
+// root and share everything else, which makes copies cheap.
+class PieceTable
+{
+public:
+      PieceTable();
+      explicit PieceTable(std::string_view content);
+
+      size_t length() const;
+      size_t lineCount() const;
+
+      void insert(size_t offset, std::string_view text);
+      void erase(size_t offset, size_t length);
+      void replace(size_t offset, size_t length, std::string_view text);
+
+      std::string slice(size_t offset, size_t length) const;
+      // View of the range straight into the buffer holding it, if a single piece covers
+      // it. The view stays valid for as long as this table or a copy of it is alive.
+      std::optional<std::string_view> view(size_t offset, size_t length) const;
+      std::string toString() const;
+
+      // Offset of the first character of `line`, or length() if there is no such line
+      size_t lineStart(size_t line) const;
+      // Zero based line containing `offset`
+      size_t lineAt(size_t offset) const;
+      // True if no byte in the range is >= 0x80. Pieces are tagged when created, so
+      // this only looks at the buffers of pieces that do contain non-ASCII text.
+      bool isAscii(size_t offset, size_t length) const;
+      // Bytes held by the tree and the buffers it references, counting buffers shared
+      // with copies of this table too
+      size_t memoryUsage() const;
+
+private:
+      struct Buffer
+      {
+            std::string text;
+            std::vector<size_t> newlines; // Offsets of every '\n' in text
+            std::vector<size_t> nonAscii; // Start and end offsets of each run of non-ASCII bytes in text
+      };
+
+      struct Piece
+      {
+            std::shared_ptr<const Buffer> buffer;
+            size_t start;
+            size_t length;
+            size_t newlines;
+            bool ascii;
+      };
+
+      struct Node;
+      using NodePtr = std::shared_ptr<const Node>;
+
+      NodePtr m_root;
+      uint32_t m_seed;
+
+      uint32_t nextPriority();
+      void compactIfFragmented();
+
+      static std::shared_ptr<const Buffer> makeBuffer(std::string_view text);
+      static Piece makePiece(const std::shared_ptr<const Buffer> &buffer, size_t start, size_t length);
+      static NodePtr makeNode(const Piece &piece, uint32_t priority, NodePtr left, NodePtr right);
+      static std::pair<NodePtr, NodePtr> split(const NodePtr &node, size_t offset);
+      static NodePtr merge(const NodePtr &left, const NodePtr &right);
+      static void appendRange(const NodePtr &node, size_t from, size_t to, std::string &out);
+      static bool rangeIsAscii(const Buffer &buffer, size_t from, size_t to);
+      static bool isAscii(const NodePtr &node, size_t from, size_t to);
+};
@@ -0,0 +1,27 @@
+#pragma once
+#include <cstddef>
+#include <optional>
+#include <string_view>
+
+// Unit in which Position::character counts, as negotiated with the client.
+// Document text is stored as UTF-8, so UTF8 needs no conversion at all.
+enum class PositionEncoding
+{
+      UTF8,
+      UTF16,
+      UTF32
+};
+
+// Wire name, e.g. "utf-16"
+std::string_view positionEncodingName(PositionEncoding encoding);
+std::optional<PositionEncoding> parsePositionEncoding(std::string_view name);
+
+// Index of the first byte >= 0x80 at or after `from`, or text.size() if there is none.
+// Checks eight bytes per step.
+size_t findNonAscii(std::string_view text, size_t from = 0);
+
+// Byte offset in `line` of the position `units` code units into it. Positions past the
+// end resolve to line.size(); a position inside a character resolves to its start.
+size_t byteOffsetFromUnits(std::string_view line, size_t units, PositionEncoding encoding);
+// Number of code units in the first `bytes` bytes of `line`
+size_t unitsFromByteOffset(std::string_view line, size_t bytes, PositionEncoding encoding);
@@ -2,6 +2,8 @@
 #include <string>
 #include "nlohmann/json.hpp"
 #include <optional>
+#include "JsonWriter.hpp"
+#include "JsonReader.hpp"
 
 
 /**
@@ -40,11 +42,12 @@ struct ServerCapabilities
        */
       struct PositionEncodingKind
       {
-            static constexpr const char *encodings[] = {"utf-8", "utf-16"};
+            static constexpr const char *encodings[] = {"utf-8", "utf-16", "utf-32"};
             enum encoding_index
             {
                   UTF8 = 0,
-                  UTF16 = 1
+                  UTF16 = 1,
+                  UTF32 = 2
             };
       };
       std::string positionEncoding;
@@ -434,7 +437,7 @@ struct TextDocumentContentChangeEvent {
 };
 
 struct DidChangeTextDocumentParams {
-      textDocumentIdentifier textDocument;
+      versionedTextDocumentIdentifier textDocument;
       std::vector<TextDocumentContentChangeEvent> contentChanges;
 };
 
@@ -447,10 +450,52 @@ struct hoverResult
 struct declarationResult: public Location {};
 struct definitionResult: public Location {};
 
+enum class SymbolKind
+{
+      File = 1,
+      Module,
+      Namespace,
+      Package,
+      Class,
+      Method,
+      Property,
+      Field,
+      Constructor,
+      Enum,
+      Interface,
+      Function,
+      Variable,
+      Constant,
+      String,
+      Number,
+      Boolean,
+      Array,
+      Object,
+      Key,
+      Null,
+      EnumMember,
+      Struct,
+      Event,
+      Operator,
+      TypeParameter
+};
+
+struct SymbolInformation
+{
+      std::string name;
+      SymbolKind kind;
+      Location location;
+      std::optional<std::string> containerName;
+};
+
 // Params
 struct hoverParams: public textDocumentPositionParams, workDoneProgressParams, PartialResultParams {};
 struct declarationParams: public textDocumentPositionParams, workDoneProgressParams, PartialResultParams {};
 struct definitionParams: public textDocumentPositionParams, workDoneProgressParams, PartialResultParams {};
+struct WorkspaceSymbolParams: public workDoneProgressParams, PartialResultParams
+{
+      std::string query;
+};
 
 
 // Serialization
@@ -465,6 +510,38 @@ void to_json(nlohmann::json &j, const hoverResult &h);
 void to_json(nlohmann::json &j, const Range &r);
 void to_json(nlohmann::json &j, const Location &l);
 void to_json(nlohmann::json &j, const textDocumentPositionParams &td);
+void to_json(nlohmann::json &j, const SymbolInformation &s);
+
+// Direct serialization, keys in the same (sorted) order nlohmann::json uses
+void writeJson(JsonWriter &w, const ServerInfo &serverInfo);
+void writeJson(JsonWriter &w, const Position &p);
+void writeJson(JsonWriter &w, const Range &r);
+void writeJson(JsonWriter &w, const Location &l);
+void writeJson(JsonWriter &w, const textDocumentIdentifier &p);
+void writeJson(JsonWriter &w, const textDocumentPositionParams &td);
+void writeJson(JsonWriter &w, const MarkupContent &p);
+void writeJson(JsonWriter &w, const hoverResult &h);
+void writeJson(JsonWriter &w, const SymbolInformation &s);
+
+// Direct deserialization from the payload text. Strings are read straight into
+// their fields; unknown members are skipped. Return false on malformed input or
+// when a required member is missing.
+bool readJson(JsonReader &r, Position &p);
+bool readJson(JsonReader &r, Range &range);
+bool readJson(JsonReader &r, Location &l);
+bool readJson(JsonReader &r, textDocumentIdentifier &p);
+bool readJson(JsonReader &r, versionedTextDocumentIdentifier &p);
+bool readJson(JsonReader &r, textDocumentPositionParams &td);
+bool readJson(JsonReader &r, hoverParams &p);
+bool readJson(JsonReader &r, declarationParams &p);
+bool readJson(JsonReader &r, definitionParams &p);
+bool readJson(JsonReader &r, TextDocumentContentChangeEvent &e);
+bool readJson(JsonReader &r, DidChangeTextDocumentParams &p);
+bool readJson(JsonReader &r, WorkspaceSymbolParams &p);
+
+// Types that can be decoded without building a nlohmann::json tree
+template <typename T>
+concept JsonReadable = requires(JsonReader &r, T &v) { { readJson(r, v) } -> std::same_as<bool>; };
 
 // Deserialization
 void from_json(const nlohmann::json &j, Position &p);
@@ -475,3 +552,4 @@ void from_json(const nlohmann::json &j, textDocumentPositionParams &td);
 void from_json(const nlohmann::json &j, TextDocumentContentChangeEvent &td);
 void from_json(const nlohmann::json &j, DidChangeTextDocumentParams &p);
 void from_json(const nlohmann::json &j, versionedTextDocumentIdentifier &td);
+void from_json(const nlohmann::json &j, WorkspaceSymbolParams &p);
@@ -1,26 +1,117 @@
 #pragma once
 #include <thread>
+#include <array>
 #include <atomic>
 #include <functional>
 #include <unordered_map>
 #include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
 #include "ProtocolStructures.hpp"
 #include "textDocument.hpp"
+#include "UriTable.hpp"
+#include "IdentifierIndex.hpp"
+#include "SymbolIndex.hpp"
 #include "Message.hpp"
+#include "WorkerPool.hpp"
+#include "Cancellation.hpp"
+#include "ChangeCoalescer.hpp"
+#include "MethodTable.hpp"
+#include "OutputWriter.hpp"
+#include "SessionRecording.hpp"
+#include "Metrics.hpp"
+#include "Tracer.hpp"
+#include "JsonWriter.hpp"
 #include "iostream"
 
 class DocumentHandler
 {
-      std::map<std::string, textDocument> m_openDocuments;
+      struct OpenDocument
+      {
+            std::shared_ptr<const textDocument> document;
+            int version;
+            // Null unless identifier indexing is enabled. Describes `document` and is
+            // replaced along with it, never updated in place.
+            std::shared_ptr<const IdentifierIndex> identifiers;
+      };
+      // Documents are spread over independently locked shards by handle, so lookups
+      // only contend with writers to documents in the same shard. The locks guard the
+      // maps only; the documents themselves are immutable once published.
+      struct alignas(64) Shard
+      {
+            mutable std::shared_mutex mutex;
+            std::unordered_map<DocumentHandle, OpenDocument> documents;
+      };
+      static constexpr size_t SHARD_COUNT = 32;
+      std::array<Shard, SHARD_COUNT> m_shards;
+      UriTable m_uris;
+      std::atomic<PositionEncoding> m_positionEncoding{PositionEncoding::UTF16};
+      bool m_indexIdentifiers = false;
+      WordRules m_identifierRules = defaultWordRules;
+
+      Shard &shardFor(DocumentHandle handle);
+      const Shard &shardFor(DocumentHandle handle) const;
+      std::shared_ptr<const IdentifierIndex> identifiersOf(DocumentHandle handle) const;
 
 public:
-      bool openDocument(const std::string &uri, const std::string &document);
+      // Handle of a URI, assigned on first use. Resolve once, then use the handle overloads.
+      // Closing the document releases its handle; the URI gets a new one when reopened.
+      DocumentHandle handleFor(const std::string &uri);
+      // Handle of a URI that was seen before, without assigning one
+      std::optional<DocumentHandle> findHandle(const std::string &uri) const;
+      // std::nullopt for a released handle
+      std::optional<std::string> uriFor(DocumentHandle handle) const;
+
+      // Encoding of the positions in didChange ranges, UTF-16 unless negotiated otherwise
+      void setPositionEncoding(PositionEncoding encoding);
+      PositionEncoding positionEncoding() const;
+
+      bool openDocument(DocumentHandle handle, const std::string &document, int version = 0);
+      bool closeDocument(DocumentHandle handle);
+      // Applies the changes to a copy of the current version and publishes it as params.textDocument.version.
+      // Edits to one document are expected to come from a single thread, as document-sync notifications do.
+      bool updateDocument(DocumentHandle handle, const DidChangeTextDocumentParams &params);
+      bool documentIsOpen(DocumentHandle handle) const;
+      // Returns the latest version of the open document if it exists. The snapshot is
+      // unaffected by later edits, so it may be kept for as long as needed.
+      std::optional<DocumentSnapshot> getOpenDocument(DocumentHandle handle) const;
+      size_t documentCount() const;
+      // Bytes held by the latest version of every open document
+      size_t memoryUsage() const;
+
+      // Keep an IdentifierIndex for every document opened from now on. Call before init().
+      void enableIdentifierIndex(const WordRules &rules = defaultWordRules);
+      // Occurrences of `identifier` in the latest version of the document, empty if the
+      // document is not open or indexing is disabled
+      std::vector<Location> findIdentifier(DocumentHandle handle, std::string_view identifier) const;
+      // Index of the latest version, null if the document is not open or indexing is disabled.
+      // Like a snapshot, it is unaffected by later edits.
+      std::shared_ptr<const IdentifierIndex> getIdentifierIndex(DocumentHandle handle) const;
+
+      // Same as above, resolving the URI first
+      bool openDocument(const std::string &uri, const std::string &document, int version = 0);
       bool closeDocument(const std::string &uri);
       bool updateDocument(const std::string &uri, const DidChangeTextDocumentParams &params);
       bool documentIsOpen(const std::string &uri) const;
+      std::optional<DocumentSnapshot> getOpenDocument(const std::string &uri) const;
+};
+
+// Thrown when a request's params do not decode into the type its callback takes,
+// answered with InvalidParams (-32602)
+class InvalidParamsError : public std::runtime_error
+{
+public:
+      using std::runtime_error::runtime_error;
+};
 
-      // Returns a reference to the open document if it exists
-      std::optional<std::reference_wrapper<textDocument>> getOpenDocument(const std::string &uri);
+// Per-request information available to callbacks
+struct RequestContext
+{
+      std::optional<RequestId> id;
+      Message::Method method;
+      CancellationToken cancellation;
+      // The document named by params.textDocument.uri, if that URI was ever opened
+      std::optional<DocumentHandle> document;
 };
 
 class LSPServer
@@ -29,16 +120,56 @@ class LSPServer
       std::atomic<bool> force_shutdown;
       std::atomic<bool> thread_exiting;  // Signals when thread is about to exit
       bool isOKtoExit;
-      bool m_shutdownRequested;
-      bool m_initialized;
+      std::atomic<bool> m_shutdownRequested;
+      std::atomic<bool> m_initialized;
       ServerCapabilities m_capabilities;
 
+      // Requests run here when init() is given worker threads, otherwise on the listener thread
+      WorkerPool m_workers;
+
       std::istream *m_input_stream;
-      std::ostream *m_output_stream;
-      mutable std::mutex m_output_mutex; // Protects m_output_stream (mutable for const methods)
+      OutputWriter m_output;
+      FlushPolicy m_flushPolicy;
+
+      // Every frame in and out, when recording
+      SessionRecorder m_recorder;
+
+      // Latency, queue and traffic counters, answered to $/lspp/metrics
+      ServerMetrics m_metrics;
+
+      // Stage timeline of every message, when tracing
+      Tracer m_tracer;
 
       // Generic callback storage
-      std::unordered_map<std::string, std::function<nlohmann::json(const nlohmann::json &)>> m_callbacks;
+      // Params handed to a stored callback: those of a message, decoded from its payload
+      // text when the params type allows it, or an already built tree
+      struct CallbackParams
+      {
+            const Message *message;
+            const nlohmann::json *tree;
+
+            const nlohmann::json &json() const
+            {
+                  return tree ? *tree : message->params();
+            }
+      };
+
+      // Stores its result (or error) in the response
+      using Callback = std::function<void(const CallbackParams &, const RequestContext &, Response &)>;
+      MethodTable<Callback> m_callbacks;
+
+      CancellationRegistry m_cancellations;
+
+      // Scheduling overrides set by registrants, keyed like m_callbacks
+      MethodTable<WorkerPool::Priority> m_methodPriorities;
+
+      // Batches didChange edits for the document settled callback
+      ChangeCoalescer m_changeCoalescer;
+
+      // Fed by didOpen/didChange/didClose once enableWorkspaceSymbols() was called
+      SymbolIndex m_symbolIndex;
+      std::atomic<bool> m_indexSymbols{false};
+      void indexOpenDocument(const std::string &uri);
 
 protected:
       DocumentHandler m_documentHandler;
@@ -46,124 +177,298 @@ protected:
 public:
       LSPServer();
       ~LSPServer();
-      int init(const uint64_t &capabilities, std::istream &in = std::cin, std::ostream &out = std::cout);
+      int init(const uint64_t &capabilities, std::istream &in = std::cin, std::ostream &out = std::cout, size_t workerThreads = 0);
       void stop();
       int exit();
       static void server_main(LSPServer *server);
       bool hasCapability(uint64_t capability) const;
-      Response processRequest(const Message &message);
+      // Encoding of every Position exchanged with the client, fixed once initialize is answered
+      PositionEncoding positionEncoding() const;
+      // Picks from the client's general.positionEncodings: UTF-8 first since it needs no
+      // conversion, then UTF-32, then the protocol default UTF-16
+      static PositionEncoding negotiatePositionEncoding(const Message &initialize);
+      Response processRequest(const Message &message, const CancellationToken &cancellation = CancellationToken());
+      // processRequest, answering with InvalidParams or InternalError when a callback throws
+      Response answerRequest(const Message &message, const CancellationToken &cancellation = CancellationToken());
       void processNotification(const Message &message);
-      void send(const Response &response, bool flush = false);
+      // Serializes on the calling thread, then queues the frame on the output writer
+      void send(const Response &response);
+      void send(const Response &response, const FlushPolicy &policy);
+      // Default policy for send(), FlushPolicy::immediate() unless changed
+      void setFlushPolicy(const FlushPolicy &policy);
+      // Records every frame read and written to `path` for lspp_replay. init() starts a
+      // recording on its own when LSPP_RECORD_FILE is set.
+      bool recordSession(const std::string &path);
+      const ServerMetrics &metrics() const;
+      // Writes a Chrome trace-event timeline of every message to `path` once the server
+      // stops. init() starts tracing on its own when LSPP_TRACE_FILE is set.
+      bool traceTo(const std::string &path);
+      // Counters so far plus the current size of the document store. Clients get the
+      // same as JSON from the $/lspp/metrics request.
+      MetricsSnapshot metricsSnapshot() const;
       
+      // Called once a document stopped changing for quietPeriod, or at the latest maxDelay after
+      // its first unreported edit, with the ranges edited since the last call. Runs on a timer
+      // thread. Set before init().
+      void onDocumentSettled(ChangeCoalescer::SettledCallback callback,
+                             std::chrono::milliseconds quietPeriod = std::chrono::milliseconds(300),
+                             std::chrono::milliseconds maxDelay = std::chrono::milliseconds(2000));
+
+      // Answers workspace/symbol from an index of the open documents, plus whatever is added
+      // through the returned index (e.g. indexDirectory on the workspace root). The
+      // workspaceSymbolProvider capability still has to be advertised.
+      SymbolIndex &enableWorkspaceSymbols();
+
       // Thread-safe method to get output (for testing)
       std::string getOutputSafe(std::ostringstream *out_stream) const;
 
 
-      // Generic callback registration (by string)
+      // Results with writeJson overloads are serialized straight to text, others go through nlohmann::json
+      template <typename ResultT>
+      static void setCallbackResult(Response &response, const ResultT &result)
+      {
+            if constexpr (JsonWritable<ResultT>)
+            {
+                  std::string json;
+                  JsonWriter writer(json);
+                  writer.value(result);
+                  response.setRawResult(std::move(json));
+            }
+            else
+                  response.setResult(nlohmann::json(result));
+      }
+
+      // Params types with readJson overloads are decoded straight from the payload. Anything
+      // else, or a payload the fast path rejects, goes through nlohmann::json.
+      template <typename ParamsT>
+      static ParamsT decodeParams(const CallbackParams &params)
+      {
+            if constexpr (JsonReadable<ParamsT>)
+            {
+                  if (!params.tree)
+                  {
+                        ParamsT typedParams{};
+                        JsonReader reader(params.message->paramsSpan());
+                        if (readJson(reader, typedParams))
+                              return typedParams;
+                  }
+            }
+            try
+            {
+                  return params.json().template get<ParamsT>();
+            }
+            catch (const nlohmann::json::exception &e)
+            {
+                  throw InvalidParamsError(e.what());
+            }
+      }
+
+      // Wraps a typed callback into the stored form
       template <typename ParamsT, typename ResultT>
-      void registerCallback(const std::string &method, std::function<ResultT(const ParamsT &)> callback)
+      static Callback makeCallback(std::function<ResultT(const ParamsT &)> callback)
+      {
+            return [callback](const CallbackParams &params, const RequestContext &, Response &response)
+            {
+                  setCallbackResult(response, callback(decodeParams<ParamsT>(params)));
+            };
+      }
+
+      template <typename ParamsT, typename ResultT>
+      static Callback makeCallback(std::function<ResultT(const ParamsT &, const RequestContext &)> callback)
       {
-            m_callbacks[method] = [callback](const nlohmann::json &params) -> nlohmann::json
+            return [callback](const CallbackParams &params, const RequestContext &context, Response &response)
             {
-                  ParamsT typedParams = params.get<ParamsT>();
-                  ResultT result = callback(typedParams);
-                  return nlohmann::json(result);
+                  setCallbackResult(response, callback(decodeParams<ParamsT>(params), context));
             };
       }
 
+      // Generic callback registration (by string). Protocol method names end up in the same
+      // slot as their Message::Method, anything else is kept as a custom method.
+      template <typename ParamsT, typename ResultT>
+      void registerCallback(const std::string &method, std::function<ResultT(const ParamsT &)> callback)
+      {
+            m_callbacks.set(method, makeCallback<ParamsT, ResultT>(callback));
+      }
+
+      // Callbacks that also receive the request context, e.g. to poll for cancellation
+      template <typename ParamsT, typename ResultT>
+      void registerCallback(const std::string &method, std::function<ResultT(const ParamsT &, const RequestContext &)> callback)
+      {
+            m_callbacks.set(method, makeCallback<ParamsT, ResultT>(callback));
+      }
+
       // Generic callback registration (by Method enum)
       template <typename ParamsT, typename ResultT>
       void registerCallback(Message::Method method, std::function<ResultT(const ParamsT &)> callback)
       {
-            registerCallback<ParamsT, ResultT>(Message::methodToString(method), callback);
+            m_callbacks.set(method, makeCallback<ParamsT, ResultT>(callback));
+      }
+
+      template <typename ParamsT, typename ResultT>
+      void registerCallback(Message::Method method, std::function<ResultT(const ParamsT &, const RequestContext &)> callback)
+      {
+            m_callbacks.set(method, makeCallback<ParamsT, ResultT>(callback));
+      }
+
+      // Returns false if no callback is registered for the message's method
+      bool invokeCallback(const Message &message, const RequestContext &context, Response &response)
+      {
+            const Callback *callback = m_callbacks.find(message.method(), message.method_description());
+            if (!callback)
+                  return false;
+            (*callback)(CallbackParams{&message, nullptr}, context, response);
+            return true;
+      }
+
+      std::optional<nlohmann::json> invokeCallback(const Message &message, const RequestContext &context)
+      {
+            Response response(message);
+            if (!invokeCallback(message, context, response))
+                  return std::nullopt;
+            return response.result();
       }
 
       std::optional<nlohmann::json> invokeCallback(const Message &message)
       {
-            return invokeCallback(message.method_description(), message.params());
+            return invokeCallback(message, RequestContext{message.id(), message.method(), CancellationToken(), std::nullopt});
       }
 
       std::optional<nlohmann::json> invokeCallback(const Message::Method &method, const nlohmann::json &params)
       {
-            return invokeCallback(Message::methodToString(method), params);
+            return invokeCallback(m_callbacks.find(method), params, RequestContext{std::nullopt, method, CancellationToken(), std::nullopt});
       }
 
       // Helper to invoke callbacks
-      std::optional<nlohmann::json> invokeCallback(const std::string &method, const nlohmann::json &params)
+      std::optional<nlohmann::json> invokeCallback(const std::string &method, const nlohmann::json &params, const RequestContext &context = RequestContext{})
+      {
+            return invokeCallback(m_callbacks.find(method), params, context);
+      }
+
+      static std::optional<nlohmann::json> invokeCallback(const Callback *callback, const nlohmann::json &params, const RequestContext &context)
+      {
+            if (!callback)
+                  return std::nullopt;
+            Response response(context.id);
+            (*callback)(CallbackParams{nullptr, &params}, context, response);
+            return response.result();
+      }
+
+      // Override the scheduling class of a method. Only affects servers running with worker threads.
+      void setMethodPriority(const std::string &method, WorkerPool::Priority priority)
+      {
+            m_methodPriorities.set(method, priority);
+      }
+
+      void setMethodPriority(Message::Method method, WorkerPool::Priority priority)
       {
-            auto it = m_callbacks.find(method);
-            if (it != m_callbacks.end())
+            m_methodPriorities.set(method, priority);
+      }
+
+      WorkerPool::Priority priorityForMethod(const Message &message) const
+      {
+            const WorkerPool::Priority *priority = m_methodPriorities.find(message.method(), message.method_description());
+            return priority ? *priority : defaultPriorityForMethod(message.method());
+      }
+
+      // Requests whose results the user is waiting on are interactive, the rest is background work
+      static WorkerPool::Priority defaultPriorityForMethod(Message::Method method)
+      {
+            switch (method)
             {
-                  return it->second(params);
+            case Message::Method::TEXT_DOCUMENT_CODE_LENS:
+            case Message::Method::CODE_LENS_RESOLVE:
+            case Message::Method::TEXT_DOCUMENT_DOCUMENT_LINK:
+            case Message::Method::DOCUMENT_LINK_RESOLVE:
+            case Message::Method::TEXT_DOCUMENT_FOLDING_RANGE:
+            case Message::Method::TEXT_DOCUMENT_DOCUMENT_SYMBOL:
+            case Message::Method::TEXT_DOCUMENT_SEMANTIC_TOKENS_FULL:
+            case Message::Method::TEXT_DOCUMENT_SEMANTIC_TOKENS_FULL_DELTA:
+            case Message::Method::TEXT_DOCUMENT_SEMANTIC_TOKENS_RANGE:
+            case Message::Method::TEXT_DOCUMENT_INLAY_HINT:
+            case Message::Method::INLAY_HINT_RESOLVE:
+            case Message::Method::TEXT_DOCUMENT_INLINE_VALUE:
+            case Message::Method::TEXT_DOCUMENT_MONIKER:
+            case Message::Method::TEXT_DOCUMENT_DIAGNOSTIC:
+            case Message::Method::WORKSPACE_DIAGNOSTIC:
+            case Message::Method::TEXT_DOCUMENT_DOCUMENT_COLOR:
+            case Message::Method::TEXT_DOCUMENT_COLOR_PRESENTATION:
+                  return WorkerPool::Priority::Background;
+            default:
+                  return WorkerPool::Priority::Interactive;
             }
-            return std::nullopt;
       }
 
+      // Context of the request being processed on the calling thread, nullptr outside of callbacks
+      static const RequestContext *currentRequest();
+
       static uint64_t capabilityFlagForMethod(Message::Method method)
       {
-            static const std::unordered_map<Message::Method, uint64_t> capabilityMap = {
-                {Message::Method::HOVER, ServerCapabilities::hoverProvider},
-                {Message::Method::DEFINITION, ServerCapabilities::definitionProvider},
-                {Message::Method::DECLARATION, ServerCapabilities::declarationProvider},
-                {Message::Method::TYPE_DEFINITION, ServerCapabilities::typeDefinitionProvider},
-                {Message::Method::IMPLEMENTATION, ServerCapabilities::implementationProvider},
-                {Message::Method::REFERENCES, ServerCapabilities::referencesProvider},
-                {Message::Method::TEXT_DOCUMENT_HIGHLIGHT, ServerCapabilities::documentHighlightProvider},
-                {Message::Method::TEXT_DOCUMENT_DOCUMENT_SYMBOL, ServerCapabilities::documentSymbolProvider},
-                {Message::Method::TEXT_DOCUMENT_CODE_ACTION, ServerCapabilities::codeActionProvider},
-                {Message::Method::TEXT_DOCUMENT_CODE_LENS, ServerCapabilities::codeLensProvider},
-                {Message::Method::TEXT_DOCUMENT_DOCUMENT_LINK, ServerCapabilities::documentLinkProvider},
-                {Message::Method::DOCUMENT_LINK_RESOLVE, ServerCapabilities::documentLinkProvider},
-                {Message::Method::TEXT_DOCUMENT_DOCUMENT_COLOR, ServerCapabilities::colorProvider},
-                {Message::Method::TEXT_DOCUMENT_COLOR_PRESENTATION, ServerCapabilities::colorProvider},
-                {Message::Method::TEXT_DOCUMENT_FORMATTING, ServerCapabilities::documentFormattingProvider},
-                {Message::Method::TEXT_DOCUMENT_RANGE_FORMATTING, ServerCapabilities::documentRangeFormattingProvider},
-                {Message::Method::TEXT_DOCUMENT_ON_TYPE_FORMATTING, ServerCapabilities::documentOnTypeFormattingProvider},
-                {Message::Method::TEXT_DOCUMENT_RENAME, ServerCapabilities::renameProvider},
-                {Message::Method::TEXT_DOCUMENT_PREPARE_RENAME, ServerCapabilities::renameProvider},
-                {Message::Method::TEXT_DOCUMENT_FOLDING_RANGE, ServerCapabilities::foldingRangeProvider},
-                {Message::Method::TEXT_DOCUMENT_SELECTION_RANGE, ServerCapabilities::selectionRangeProvider},
-                {Message::Method::TEXT_DOCUMENT_LINKED_EDITING_RANGE, ServerCapabilities::linkedEditingRangeProvider},
-                {Message::Method::TEXT_DOCUMENT_SIGNATURE_HELP, ServerCapabilities::signatureHelpProvider},
-                {Message::Method::TEXT_DOCUMENT_COMPLETION, ServerCapabilities::completionProvider},
-                {Message::Method::COMPLETION_ITEM_RESOLVE, ServerCapabilities::completionProvider},
-                {Message::Method::TEXT_DOCUMENT_DIAGNOSTIC, ServerCapabilities::diagnosticProvider},
-                {Message::Method::WORKSPACE_DIAGNOSTIC, ServerCapabilities::diagnosticProvider},
-                {Message::Method::PREPARE_CALL_HIERARCHY, ServerCapabilities::callHierarchyProvider},
-                {Message::Method::INCOMING_CALLS, ServerCapabilities::callHierarchyProvider},
-                {Message::Method::OUTGOING_CALLS, ServerCapabilities::callHierarchyProvider},
-                {Message::Method::PREPARE_TYPE_HIERARCHY, ServerCapabilities::typeHierarchyProvider},
-                {Message::Method::TYPE_HIERARCHY_SUPERTYPES, ServerCapabilities::typeHierarchyProvider},
-                {Message::Method::TYPE_HIERARCHY_SUBTYPES, ServerCapabilities::typeHierarchyProvider},
-                {Message::Method::TEXT_DOCUMENT_SEMANTIC_TOKENS_FULL, ServerCapabilities::semanticTokensProvider},
-                {Message::Method::TEXT_DOCUMENT_SEMANTIC_TOKENS_FULL_DELTA, ServerCapabilities::semanticTokensProvider},
-                {Message::Method::TEXT_DOCUMENT_SEMANTIC_TOKENS_RANGE, ServerCapabilities::semanticTokensProvider},
-                {Message::Method::TEXT_DOCUMENT_SEMANTIC_TOKENS_REFRESH, ServerCapabilities::semanticTokensProvider},
-                {Message::Method::TEXT_DOCUMENT_INLAY_HINT, ServerCapabilities::inlayHintProvider},
-                {Message::Method::INLAY_HINT_RESOLVE, ServerCapabilities::inlayHintProvider},
-                {Message::Method::TEXT_DOCUMENT_INLINE_VALUE, ServerCapabilities::inlineValueProvider},
-                {Message::Method::TEXT_DOCUMENT_MONIKER, ServerCapabilities::monikerProvider},
-                {Message::Method::WORKSPACE_CODE_LENS_REFRESH, ServerCapabilities::codeLensProvider},
-                {Message::Method::WORKSPACE_INLAY_HINT_REFRESH, ServerCapabilities::inlayHintProvider},
-                {Message::Method::WORKSPACE_INLINE_VALUE_REFRESH, ServerCapabilities::inlineValueProvider},
-                // Note: The following don't have direct capability flags or are special cases
-                // Message::Method::INITIALIZE - special lifecycle method
-                // Message::Method::SHUTDOWN - special lifecycle method
-                // Message::Method::EXIT - special lifecycle method
-                // Message::Method::TEXT_DOCUMENT_DID_OPEN - notification
-                // Message::Method::TEXT_DOCUMENT_DID_CHANGE - notification
-                // Message::Method::TEXT_DOCUMENT_DID_CLOSE - notification
-                // Message::Method::TEXT_DOCUMENT_PUBLISH_DIAGNOSTICS - server notification
-                // Message::Method::WORKSPACE_DIAGNOSTIC_REFRESH - server notification
-                // Message::Method::CODE_LENS_RESOLVE - uses codeLensProvider
-                // Message::Method::CODE_ACTION_RESOLVE - uses codeActionProvider
-            };
-
-            auto it = capabilityMap.find(method);
-            if (it != capabilityMap.end())
+            static constexpr auto capabilityFlags = []
             {
-                  return it->second;
-            }
-            return 0;
+                  std::array<uint64_t, Message::METHOD_COUNT> flags{};
+                  const std::pair<Message::Method, uint64_t> entries[] = {
+                      {Message::Method::HOVER, ServerCapabilities::hoverProvider},
+                      {Message::Method::DEFINITION, ServerCapabilities::definitionProvider},
+                      {Message::Method::DECLARATION, ServerCapabilities::declarationProvider},
+                      {Message::Method::TYPE_DEFINITION, ServerCapabilities::typeDefinitionProvider},
+                      {Message::Method::IMPLEMENTATION, ServerCapabilities::implementationProvider},
+                      {Message::Method::REFERENCES, ServerCapabilities::referencesProvider},
+                      {Message::Method::TEXT_DOCUMENT_HIGHLIGHT, ServerCapabilities::documentHighlightProvider},
+                      {Message::Method::TEXT_DOCUMENT_DOCUMENT_SYMBOL, ServerCapabilities::documentSymbolProvider},
+                      {Message::Method::TEXT_DOCUMENT_CODE_ACTION, ServerCapabilities::codeActionProvider},
+                      {Message::Method::TEXT_DOCUMENT_CODE_LENS, ServerCapabilities::codeLensProvider},
+                      {Message::Method::TEXT_DOCUMENT_DOCUMENT_LINK, ServerCapabilities::documentLinkProvider},
+                      {Message::Method::DOCUMENT_LINK_RESOLVE, ServerCapabilities::documentLinkProvider},
+                      {Message::Method::TEXT_DOCUMENT_DOCUMENT_COLOR, ServerCapabilities::colorProvider},
+                      {Message::Method::TEXT_DOCUMENT_COLOR_PRESENTATION, ServerCapabilities::colorProvider},
+                      {Message::Method::TEXT_DOCUMENT_FORMATTING, ServerCapabilities::documentFormattingProvider},
+                      {Message::Method::TEXT_DOCUMENT_RANGE_FORMATTING, ServerCapabilities::documentRangeFormattingProvider},
+                      {Message::Method::TEXT_DOCUMENT_ON_TYPE_FORMATTING, ServerCapabilities::documentOnTypeFormattingProvider},
+                      {Message::Method::TEXT_DOCUMENT_RENAME, ServerCapabilities::renameProvider},
+                      {Message::Method::TEXT_DOCUMENT_PREPARE_RENAME, ServerCapabilities::renameProvider},
+                      {Message::Method::TEXT_DOCUMENT_FOLDING_RANGE, ServerCapabilities::foldingRangeProvider},
+                      {Message::Method::TEXT_DOCUMENT_SELECTION_RANGE, ServerCapabilities::selectionRangeProvider},
+                      {Message::Method::TEXT_DOCUMENT_LINKED_EDITING_RANGE, ServerCapabilities::linkedEditingRangeProvider},
+                      {Message::Method::TEXT_DOCUMENT_SIGNATURE_HELP, ServerCapabilities::signatureHelpProvider},
+                      {Message::Method::TEXT_DOCUMENT_COMPLETION, ServerCapabilities::completionProvider},
+                      {Message::Method::COMPLETION_ITEM_RESOLVE, ServerCapabilities::completionProvider},
+                      {Message::Method::TEXT_DOCUMENT_DIAGNOSTIC, ServerCapabilities::diagnosticProvider},
+                      {Message::Method::WORKSPACE_DIAGNOSTIC, ServerCapabilities::diagnosticProvider},
+                      {Message::Method::PREPARE_CALL_HIERARCHY, ServerCapabilities::callHierarchyProvider},
+                      {Message::Method::INCOMING_CALLS, ServerCapabilities::callHierarchyProvider},
+                      {Message::Method::OUTGOING_CALLS, ServerCapabilities::callHierarchyProvider},
+                      {Message::Method::PREPARE_TYPE_HIERARCHY, ServerCapabilities::typeHierarchyProvider},
+                      {Message::Method::TYPE_HIERARCHY_SUPERTYPES, ServerCapabilities::typeHierarchyProvider},
+                      {Message::Method::TYPE_HIERARCHY_SUBTYPES, ServerCapabilities::typeHierarchyProvider},
+                      {Message::Method::TEXT_DOCUMENT_SEMANTIC_TOKENS_FULL, ServerCapabilities::semanticTokensProvider},
+                      {Message::Method::TEXT_DOCUMENT_SEMANTIC_TOKENS_FULL_DELTA, ServerCapabilities::semanticTokensProvider},
+                      {Message::Method::TEXT_DOCUMENT_SEMANTIC_TOKENS_RANGE, ServerCapabilities::semanticTokensProvider},
+                      {Message::Method::TEXT_DOCUMENT_SEMANTIC_TOKENS_REFRESH, ServerCapabilities::semanticTokensProvider},
+                      {Message::Method::TEXT_DOCUMENT_INLAY_HINT, ServerCapabilities::inlayHintProvider},
+                      {Message::Method::INLAY_HINT_RESOLVE, ServerCapabilities::inlayHintProvider},
+                      {Message::Method::TEXT_DOCUMENT_INLINE_VALUE, ServerCapabilities::inlineValueProvider},
+                      {Message::Method::TEXT_DOCUMENT_MONIKER, ServerCapabilities::monikerProvider},
+                      {Message::Method::WORKSPACE_SYMBOL, ServerCapabilities::workspaceSymbolProvider},
+                      {Message::Method::WORKSPACE_CODE_LENS_REFRESH, ServerCapabilities::codeLensProvider},
+                      {Message::Method::WORKSPACE_INLAY_HINT_REFRESH, ServerCapabilities::inlayHintProvider},
+                      {Message::Method::WORKSPACE_INLINE_VALUE_REFRESH, ServerCapabilities::inlineValueProvider},
+                      // Note: The following don't have direct capability flags or are special cases
+                      // Message::Method::INITIALIZE - special lifecycle method
+                      // Message::Method::SHUTDOWN - special lifecycle method
+                      // Message::Method::EXIT - special lifecycle method
+                      // Message::Method::TEXT_DOCUMENT_DID_OPEN - notification
+                      // Message::Method::TEXT_DOCUMENT_DID_CHANGE - notification
+                      // Message::Method::TEXT_DOCUMENT_DID_CLOSE - notification
+                      // Message::Method::TEXT_DOCUMENT_PUBLISH_DIAGNOSTICS - server notification
+                      // Message::Method::WORKSPACE_DIAGNOSTIC_REFRESH - server notification
+                      // Message::Method::CODE_LENS_RESOLVE - uses codeLensProvider
+                      // Message::Method::CODE_ACTION_RESOLVE - uses codeActionProvider
+                  };
+                  for (const auto &entry : entries)
+                        flags[entry.first] = entry.second;
+                  return flags;
+            }();
+
+            return method < Message::METHOD_COUNT ? capabilityFlags[method] : 0;
       }
 };
\ No newline at end of file
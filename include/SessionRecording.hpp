@@ -0,0 +1,67 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Binary recording of a session: every frame the server read or wrote, headers
+// included and byte for byte, stamped with steady_clock nanoseconds since the
+// recording started. All integers are little endian:
+//
+//     "LSPPREC" 0x01                               magic, last byte is the format version
+//     u8 direction, u64 nanoseconds, u32 size      per frame, followed by `size` bytes
+//
+// Frames are buffered and only guaranteed to be in the file once the recorder is closed.
+enum class FrameDirection : uint8_t
+{
+      Inbound = 0,
+      Outbound = 1
+};
+
+struct RecordedFrame
+{
+      FrameDirection direction;
+      uint64_t nanoseconds;
+      std::string frame;
+
+      // The frame without its headers
+      std::string_view payload() const;
+};
+
+class SessionRecorder
+{
+public:
+      static constexpr std::string_view MAGIC{"LSPPREC\x01", 8};
+
+      SessionRecorder();
+      ~SessionRecorder();
+
+      SessionRecorder(const SessionRecorder &) = delete;
+      SessionRecorder &operator=(const SessionRecorder &) = delete;
+
+      // Truncates `path`. Returns false if it cannot be written.
+      bool open(const std::string &path);
+      void close();
+      bool isOpen() const
+      {
+            return m_open.load(std::memory_order_relaxed);
+      }
+
+      // `header` and `body` are written as one frame
+      void record(FrameDirection direction, std::string_view header, std::string_view body = {});
+
+private:
+      mutable std::mutex m_mutex;
+      std::FILE *m_file;
+      std::chrono::steady_clock::time_point m_start;
+      std::atomic<bool> m_open;
+};
+
+// Every frame of a recording, std::nullopt if `path` is not one. A frame cut short
+// by a crash while recording ends the list.
+std::optional<std::vector<RecordedFrame>> readSessionRecording(const std::string &path);
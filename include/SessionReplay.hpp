@@ -0,0 +1,41 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "SessionRecording.hpp"
+
+class LSPServer;
+
+struct ReplayOptions
+{
+      // Keep the recorded gaps between inbound frames instead of sending them back to back
+      bool paced = false;
+      // Divides the recorded gaps when paced, 2 replays twice as fast
+      double speed = 1.0;
+      size_t workerThreads = 0;
+};
+
+struct MethodLatency
+{
+      std::string method;
+      size_t requests;
+      // From handing the request to the server until its response was written, in nanoseconds
+      uint64_t p50;
+      uint64_t p99;
+      uint64_t p999;
+      uint64_t max;
+};
+
+struct ReplayReport
+{
+      size_t messages;  // Inbound frames sent
+      size_t responses; // Responses matched to a request
+      double seconds;   // From the first frame until the server stopped
+      double messagesPerSecond;
+      std::vector<MethodLatency> methods; // Sorted by method name
+};
+
+// Runs the inbound frames of a recording through `server`, which must not be running
+// yet and is stopped again on return. The server's callbacks answer as they would in
+// production; the recorded responses are not compared against.
+ReplayReport replaySession(LSPServer &server, uint64_t capabilities, const std::vector<RecordedFrame> &frames, const ReplayOptions &options = {});
@@ -0,0 +1,136 @@
+#pragma once
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "ProtocolStructures.hpp"
+#include "PositionEncoding.hpp"
+#include "WordRules.hpp"
+#include "WorkerPool.hpp"
+#include "textDocument.hpp"
+
+// Workspace-wide symbol search behind workspace/symbol. Documents are spread over
+// shards, and every shard indexes the trigrams and characters of its lowercased
+// symbol names: a query only looks at the symbols holding all of its trigrams, or
+// all of its characters for fuzzy matches, and the shards are searched in parallel
+// once the index is large.
+//
+// Changes to open documents are extracted on a background thread. A search waits
+// for the changes made before it started, so it never sees an older version.
+class SymbolIndex
+{
+public:
+      using Extractor = std::function<std::vector<SymbolInformation>(const std::string &uri, const textDocument &document)>;
+
+      static constexpr size_t SHARD_COUNT = 8;
+      // Below this many symbols a search runs on the calling thread only
+      static constexpr size_t PARALLEL_SEARCH_THRESHOLD = 50000;
+
+      // Replaces the default extractor, which reports every distinct identifier once
+      void setExtractor(Extractor extractor);
+      void setPositionEncoding(PositionEncoding encoding);
+
+      // Replace every symbol of a document
+      void setDocument(const std::string &uri, const textDocument &document);
+      void setSymbols(const std::string &uri, std::vector<SymbolInformation> symbols);
+      void removeDocument(const std::string &uri);
+      // Queue a new version of an open document for indexing
+      void documentChanged(const std::string &uri, const DocumentSnapshot &snapshot);
+      // Falls back to the file on disk when it lies in an indexed directory, read in the background
+      void documentClosed(const std::string &uri);
+
+      // Indexes every regular file below `root` whose extension is listed (".cpp", ...),
+      // or every file if none are. Returns the number of files indexed.
+      size_t indexDirectory(const std::filesystem::path &root, const std::vector<std::string> &extensions = {});
+
+      // Case-insensitive. Exact matches come first, then prefixes, then substrings, then, if
+      // `fuzzy`, names holding the query's characters in order. An empty query matches everything.
+      std::vector<SymbolInformation> search(std::string_view query, size_t limit = 256, bool fuzzy = true);
+      size_t size() const;
+
+      static std::vector<SymbolInformation> identifierSymbols(const std::string &uri, const textDocument &document,
+                                                              const WordRules &rules = defaultWordRules,
+                                                              PositionEncoding encoding = PositionEncoding::UTF16);
+      static std::string pathToUri(const std::filesystem::path &path);
+      static std::optional<std::filesystem::path> uriToPath(std::string_view uri);
+
+private:
+      struct Entry
+      {
+            SymbolInformation symbol;
+            std::string lowered;
+            bool live = false;
+      };
+
+      struct alignas(64) Shard
+      {
+            mutable std::shared_mutex mutex;
+            std::vector<Entry> entries;
+            std::vector<uint32_t> freeSlots;
+            // Trigram or character of a lowercased name -> sorted ids of the entries containing it
+            std::unordered_map<uint32_t, std::vector<uint32_t>> postings;
+            std::unordered_map<std::string, std::vector<uint32_t>> documents;
+            size_t liveEntries = 0;
+      };
+
+      struct Match
+      {
+            int rank;
+            size_t detail;
+            SymbolInformation symbol;
+      };
+
+      struct Pending
+      {
+            // The buffer to index, none once the document was closed
+            std::optional<DocumentSnapshot> snapshot;
+            uint64_t sequence = 0;
+      };
+
+      std::array<Shard, SHARD_COUNT> m_shards;
+
+      mutable std::mutex m_mutex;
+      Extractor m_extractor;
+      PositionEncoding m_encoding = PositionEncoding::UTF16;
+      std::vector<std::filesystem::path> m_roots;
+      std::unordered_map<std::string, Pending> m_pending;
+      // Sequence of the newest change of each document until it is indexed. A change
+      // extracted after a newer one was made is dropped instead of replacing it.
+      std::unordered_map<std::string, uint64_t> m_latest;
+      // Sequences of the changes being extracted, searches wait for the older ones
+      std::set<uint64_t> m_extracting;
+      std::condition_variable m_indexed;
+      uint64_t m_nextSequence = 1;
+      // Documents the editor has open, their buffer wins over the file on disk
+      std::unordered_set<std::string> m_open;
+
+      // Extracts pending changes and searches shards, started on first use. Declared
+      // last so its tasks finish before the rest of the index goes away.
+      std::once_flag m_poolStarted;
+      WorkerPool m_pool;
+
+      Shard &shardFor(const std::string &uri);
+      void queue(const std::string &uri, std::optional<DocumentSnapshot> snapshot);
+      void startPool();
+      // Indexes every change made so far, waiting for those other threads are extracting
+      void indexPending();
+      // Indexes the pending change of one document, if no other thread took it already
+      void indexPending(const std::string &uri);
+      std::vector<SymbolInformation> extract(const std::string &uri, const textDocument &document);
+      static void eraseDocument(Shard &shard, const std::string &uri);
+      static void insertSymbols(Shard &shard, const std::string &uri, std::vector<SymbolInformation> symbols);
+      // Sorted ids of the entries holding every key, all of them if there are none
+      static std::vector<uint32_t> holdingAll(const Shard &shard, const std::vector<uint32_t> &keys);
+      // Best `limit` matches of the lowercased query in one shard
+      static std::vector<Match> searchShard(const Shard &shard, std::string_view query, size_t limit, bool fuzzy);
+};
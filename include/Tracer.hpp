@@ -0,0 +1,133 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "Message.hpp"
+
+// Opt-in timeline of where the server spends its time, written as Chrome trace-event
+// JSON that chrome://tracing and ui.perfetto.dev open. Every thread appends to a buffer
+// of its own, so recording a span never contends with other threads; the file is only
+// written when the tracer is closed.
+//
+// Spans recorded on a thread take the request id and method from the innermost
+// TraceContext alive on that thread.
+class Tracer
+{
+public:
+      using Clock = std::chrono::steady_clock;
+
+      static constexpr int64_t NO_ID = INT64_MIN;
+      // Later spans of a thread are dropped, and counted in the trace's otherData
+      static constexpr size_t MAX_EVENTS_PER_THREAD = size_t(1) << 20;
+
+      struct Event
+      {
+            const char *name; // Must outlive the tracer, string literals in practice
+            uint64_t start;   // Nanoseconds since open()
+            uint64_t duration;
+            uint64_t asyncId; // 0 for spans on the thread's own track
+            int64_t id;       // NO_ID outside of requests
+            Message::Method method;
+            std::string uri; // Only set where asked for, copying it into every span would cost an allocation
+      };
+
+      Tracer();
+      ~Tracer();
+
+      Tracer(const Tracer &) = delete;
+      Tracer &operator=(const Tracer &) = delete;
+
+      // Starts tracing into `path`, dropping anything recorded before. Returns false if
+      // the file cannot be written. Like close(), not meant to race with recording threads.
+      bool open(const std::string &path);
+      // Writes the trace and stops tracing. Call once the threads recording spans are done.
+      bool close();
+      bool isEnabled() const
+      {
+            return m_enabled.load(std::memory_order_acquire);
+      }
+
+      // A span on the calling thread's track
+      void record(const char *name, Clock::time_point start, Clock::time_point end, std::string uri = {});
+      // A span on its own track, for stages that start on one thread and end on another.
+      // Spans sharing an id are drawn together.
+      void recordAsync(const char *name, uint64_t asyncId, Clock::time_point start, Clock::time_point end, std::string uri = {});
+      uint64_t nextAsyncId();
+      // Shown instead of the thread's number
+      void setThreadName(std::string name);
+
+private:
+      struct ThreadBuffer
+      {
+            std::mutex mutex;
+            std::vector<Event> events;
+            uint64_t dropped = 0;
+            uint32_t tid;
+            std::string name;
+      };
+
+      // Buffers live as long as the tracer, threads keep a pointer to theirs
+      std::mutex m_mutex;
+      std::vector<std::unique_ptr<ThreadBuffer>> m_buffers;
+      std::unordered_map<std::thread::id, ThreadBuffer *> m_byThread;
+      const uint64_t m_serial;
+      std::atomic<uint64_t> m_nextAsyncId;
+      std::atomic<bool> m_enabled;
+      std::string m_path;
+      Clock::time_point m_origin;
+
+      ThreadBuffer &threadBuffer();
+      void append(Event event);
+      uint64_t since(Clock::time_point t) const;
+};
+
+// Request the calling thread works on until destroyed, restoring the previous one after
+class TraceContext
+{
+public:
+      TraceContext(std::optional<RequestId> id, Message::Method method);
+      explicit TraceContext(const Message &message) : TraceContext(message.id(), message.method()) {}
+      ~TraceContext();
+
+      TraceContext(const TraceContext &) = delete;
+      TraceContext &operator=(const TraceContext &) = delete;
+
+      static int64_t currentId();
+      static Message::Method currentMethod();
+
+private:
+      int64_t m_previousId;
+      Message::Method m_previousMethod;
+};
+
+// Records the enclosing scope as a span. Reads the clock twice when tracing, does nothing else otherwise.
+class TraceSpan
+{
+public:
+      TraceSpan(Tracer &tracer, const char *name) : m_tracer(tracer.isEnabled() ? &tracer : nullptr), m_name(name)
+      {
+            if (m_tracer)
+                  m_start = Tracer::Clock::now();
+      }
+      ~TraceSpan()
+      {
+            if (m_tracer)
+                  m_tracer->record(m_name, m_start, Tracer::Clock::now());
+      }
+
+      TraceSpan(const TraceSpan &) = delete;
+      TraceSpan &operator=(const TraceSpan &) = delete;
+
+private:
+      Tracer *m_tracer;
+      const char *m_name;
+      Tracer::Clock::time_point m_start;
+};
@@ -0,0 +1,40 @@
+#pragma once
+#include <cstdint>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// Small integer standing for a document URI. Handles are never reused, so a stale
+// handle names no URI rather than some other document's.
+using DocumentHandle = uint32_t;
+
+// Interns document URIs. Every distinct URI is stored once and given the next handle,
+// until its entry is released.
+class UriTable
+{
+      struct ViewHash
+      {
+            using is_transparent = void;
+            size_t operator()(std::string_view s) const { return std::hash<std::string_view>{}(s); }
+      };
+
+      // Elements of an unordered_map never move, so the views keyed in m_handles stay valid
+      std::unordered_map<DocumentHandle, std::string> m_uris;
+      std::unordered_map<std::string_view, DocumentHandle, ViewHash, std::equal_to<>> m_handles;
+      DocumentHandle m_next = 0;
+      mutable std::shared_mutex m_mutex;
+
+public:
+      // Returns the handle of uri, assigning one if it has none
+      DocumentHandle intern(std::string_view uri);
+      // Returns the handle of uri without assigning one
+      std::optional<DocumentHandle> find(std::string_view uri) const;
+      // The URI a handle was assigned to, std::nullopt once released or for a handle
+      // this table never assigned
+      std::optional<std::string> uri(DocumentHandle handle) const;
+      // Forgets a handle. Interning its URI again assigns a new one.
+      void release(DocumentHandle handle);
+      size_t size() const;
+};
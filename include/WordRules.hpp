@@ -0,0 +1,75 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <string_view>
+
+// Which bytes may be part of a word, as one 256-entry lookup table. The defaults
+// treat everything but whitespace and ASCII punctuation as a word character, so
+// identifiers with '_' and non-ASCII letters are kept whole. Languages with other
+// identifier rules derive their own table, e.g. for CSS or shell:
+//
+//     static constexpr WordRules css = WordRules::defaults().withWordChars("-");
+//     static constexpr WordRules shell = WordRules::defaults().withWordChars("$");
+class WordRules
+{
+      std::array<bool, 256> m_wordChar;
+
+public:
+      static constexpr std::string_view DEFAULT_DELIMITERS = " \t\r\n`~!@#$%^&*()-=+[{]}\\|;:'\",.<>/?";
+
+      constexpr WordRules() : m_wordChar{}
+      {
+            m_wordChar.fill(true);
+      }
+
+      static constexpr WordRules defaults()
+      {
+            return WordRules().withDelimiters(DEFAULT_DELIMITERS);
+      }
+
+      constexpr WordRules withWordChars(std::string_view chars) const
+      {
+            WordRules rules = *this;
+            for (char c : chars)
+                  rules.m_wordChar[static_cast<unsigned char>(c)] = true;
+            return rules;
+      }
+
+      constexpr WordRules withDelimiters(std::string_view chars) const
+      {
+            WordRules rules = *this;
+            for (char c : chars)
+                  rules.m_wordChar[static_cast<unsigned char>(c)] = false;
+            return rules;
+      }
+
+      constexpr bool isWordChar(char c) const
+      {
+            return m_wordChar[static_cast<unsigned char>(c)];
+      }
+
+      // Calls `f(begin, end)` with the byte range of every identifier in `text`, in order.
+      // An identifier is a run of word characters not starting with a digit.
+      template <typename F>
+      constexpr void forEachIdentifier(std::string_view text, F &&f) const
+      {
+            size_t i = 0;
+            while (i < text.size())
+            {
+                  if (!isWordChar(text[i]))
+                  {
+                        i++;
+                        continue;
+                  }
+                  size_t end = i + 1;
+                  while (end < text.size() && isWordChar(text[end]))
+                        end++;
+                  if (text[i] < '0' || text[i] > '9')
+                        f(i, end);
+                  i = end;
+            }
+      }
+};
+
+// Built at compile time, used when no rules are given
+inline constexpr WordRules defaultWordRules = WordRules::defaults();
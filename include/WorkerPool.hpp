@@ -0,0 +1,48 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of threads running queued tasks. Interactive tasks run before
+// queued background tasks; each class is FIFO on its own.
+class WorkerPool
+{
+public:
+      enum class Priority
+      {
+            Interactive,
+            Background
+      };
+
+      // Background work waiting behind this many consecutive interactive tasks gets the next turn
+      static constexpr size_t MAX_INTERACTIVE_BURST = 8;
+
+      WorkerPool();
+      ~WorkerPool();
+
+      void start(size_t workers);
+      // Waits for every queued task to finish, then joins the workers
+      void stop();
+
+      void submit(std::function<void()> task, Priority priority = Priority::Interactive);
+      size_t size() const;
+      size_t pending() const;
+      size_t pending(Priority priority) const;
+
+private:
+      std::vector<std::thread> m_workers;
+      std::deque<std::function<void()>> m_interactive;
+      std::deque<std::function<void()>> m_background;
+      // Interactive tasks taken in a row while background work was waiting
+      size_t m_interactiveBurst;
+      mutable std::mutex m_mutex;
+      std::condition_variable m_cv;
+      bool m_stopping;
+
+      void run();
+      std::function<void()> takeNext();
+};
@@ -1,15 +1,75 @@
 #pragma once
 #include <string>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include "ProtocolStructures.hpp"
+#include "PieceTable.hpp"
+#include "PositionEncoding.hpp"
+#include "WordRules.hpp"
 
 struct textDocument {
-      static constexpr const char word_delimiters[] = " `~!@#$%^&*()-=+[{]}\\|;:'\",.<>/?";
+      static constexpr std::string_view word_delimiters = WordRules::DEFAULT_DELIMITERS;
       // std::string m_uri;
-      std::string m_content;
 
       textDocument();
       textDocument(const std::string& content);
-      std::string getLine(int n);
+      // Copies share the text storage, see PieceTable
+      textDocument(const textDocument &other);
+      textDocument &operator=(const textDocument &other);
+
+      // Contiguous copy of the document, built lazily and cached until the next edit.
+      // Safe to call from several threads as long as nobody edits the document.
+      const std::string &getContent() const;
+      void setContent(const std::string &content);
+      void replace(size_t start, size_t length, const std::string &text);
+      std::string slice(size_t start, size_t length) const;
+
+      size_t length() const;
+      size_t lineCount() const;
+      std::string getLine(int n) const;
+      // Same as getLine, but viewing the document storage instead of copying. Valid until the
+      // document is edited or destroyed; snapshot documents are never edited. A line split
+      // over several pieces is copied once and kept until the next edit.
+      std::string_view lineView(int n) const;
       static bool isWordDelimiter(const char c);
-      std::string wordUnderCursor(const int line, const int column);
-      int findPos(const int line, const int column) const;
+      // Word around the character at `column` of `line`, counted in code units of `encoding`
+      // like findPos, empty if it is not a word character. The view has the lifetime of lineView.
+      std::string_view wordUnderCursor(const int line, const int column, PositionEncoding encoding, const WordRules &rules = defaultWordRules) const;
+      // `column` and Position::character count code units of `encoding`; lines made of
+      // ASCII only are resolved without looking at their text. There is no default: positions
+      // from the client are in LSPServer::positionEncoding(), UTF-16 unless negotiated.
+      int findPos(const int line, const int column, PositionEncoding encoding) const;
+      Position positionAt(size_t offset, PositionEncoding encoding) const;
+      bool lineIsAscii(size_t line) const;
+      // Bytes held by the text storage and the cached copies
+      size_t memoryUsage() const;
+
+private:
+      PieceTable m_text;
+      mutable std::string m_flat;
+      mutable bool m_flatValid;
+      // Lines lineView had to copy, by line number. Nodes never move, so views stay valid.
+      mutable std::unordered_map<size_t, std::string> m_lines;
+      mutable std::mutex m_flatMutex;
+
+      size_t lineEnd(size_t line) const;
+};
+
+// Read-only view of an open document at one LSP version. Edits never touch a
+// published snapshot: they build the next version from a copy that shares the
+// unchanged text, so a snapshot stays valid for as long as someone holds it.
+class DocumentSnapshot
+{
+      std::shared_ptr<const textDocument> m_document;
+      int m_version;
+
+public:
+      DocumentSnapshot(std::shared_ptr<const textDocument> document, int version) : m_document(std::move(document)), m_version(version) {}
+
+      const textDocument &get() const { return *m_document; }
+      const textDocument &operator*() const { return *m_document; }
+      const textDocument *operator->() const { return m_document.get(); }
+      int version() const { return m_version; }
 };
@@ -0,0 +1,25 @@
+#include "Cancellation.hpp"
+
+CancellationToken CancellationRegistry::add(RequestId id)
+{
+      auto flag = std::make_shared<std::atomic<bool>>(false);
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_pending[id] = flag;
+      return CancellationToken(flag);
+}
+
+bool CancellationRegistry::cancel(RequestId id)
+{
+      std::lock_guard<std::mutex> lock(m_mutex);
+      auto it = m_pending.find(id);
+      if (it == m_pending.end())
+            return false;
+      it->second->store(true, std::memory_order_relaxed);
+      return true;
+}
+
+void CancellationRegistry::remove(RequestId id)
+{
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_pending.erase(id);
+}
@@ -0,0 +1,214 @@
+#include "ChangeCoalescer.hpp"
+#include <algorithm>
+
+ChangeCoalescer::ChangeCoalescer() : m_quietPeriod(0), m_maxDelay(0), m_stopping(false) {}
+
+ChangeCoalescer::~ChangeCoalescer()
+{
+      stop();
+}
+
+void ChangeCoalescer::setCallback(SettledCallback callback, std::chrono::milliseconds quietPeriod, std::chrono::milliseconds maxDelay)
+{
+      stop();
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_callback = std::move(callback);
+      m_quietPeriod = quietPeriod;
+      m_maxDelay = std::max(maxDelay, quietPeriod);
+}
+
+bool ChangeCoalescer::enabled() const
+{
+      return static_cast<bool>(m_callback);
+}
+
+void ChangeCoalescer::setPositionEncoding(PositionEncoding encoding)
+{
+      m_positionEncoding.store(encoding, std::memory_order_relaxed);
+}
+
+static bool operator<(const Position &a, const Position &b)
+{
+      return a.line < b.line || (a.line == b.line && a.character < b.character);
+}
+
+// Position right after `text` when it is inserted at `start`
+static Position endOfInsertion(const Position &start, const std::string &text, PositionEncoding encoding)
+{
+      size_t lastNewline = text.rfind('\n');
+      std::string_view lastLine = std::string_view(text).substr(lastNewline == std::string::npos ? 0 : lastNewline + 1);
+      const uint units = static_cast<uint>(unitsFromByteOffset(lastLine, lastLine.size(), encoding));
+      if (lastNewline == std::string::npos)
+            return {start.line, start.character + units};
+      uint lines = static_cast<uint>(std::count(text.begin(), text.end(), '\n'));
+      return {start.line + lines, units};
+}
+
+// Where `position` ends up after [start, oldEnd) was replaced by text ending at newEnd
+static Position shiftPosition(const Position &position, const Position &start, const Position &oldEnd, const Position &newEnd)
+{
+      if (position < start)
+            return position;
+      if (position < oldEnd)
+            return newEnd;
+      if (position.line == oldEnd.line)
+            return {newEnd.line, newEnd.character + (position.character - oldEnd.character)};
+      return {position.line - oldEnd.line + newEnd.line, position.character};
+}
+
+void ChangeCoalescer::applyEdit(std::vector<Range> &dirty, const Range &range, const std::string &text, PositionEncoding encoding)
+{
+      const Position newEnd = endOfInsertion(range.start, text, encoding);
+
+      for (Range &r : dirty)
+      {
+            r.start = shiftPosition(r.start, range.start, range.end, newEnd);
+            r.end = shiftPosition(r.end, range.start, range.end, newEnd);
+      }
+      dirty.push_back({range.start, newEnd});
+
+      // Keep the list sorted and merge ranges that touch
+      std::sort(dirty.begin(), dirty.end(), [](const Range &a, const Range &b)
+                { return a.start < b.start; });
+      size_t merged = 0;
+      for (size_t i = 1; i < dirty.size(); i++)
+      {
+            if (dirty[merged].end < dirty[i].start)
+                  dirty[++merged] = dirty[i];
+            else if (dirty[merged].end < dirty[i].end)
+                  dirty[merged].end = dirty[i].end;
+      }
+      dirty.resize(merged + 1);
+}
+
+void ChangeCoalescer::record(const std::string &uri, const Range &range, const std::string &text, bool replaceAll)
+{
+      if (!enabled())
+            return;
+
+      const Clock::time_point now = Clock::now();
+      {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto [it, inserted] = m_pending.try_emplace(uri);
+            Pending &pending = it->second;
+            if (inserted)
+                  pending.firstChange = now;
+            pending.lastChange = now;
+
+            const PositionEncoding encoding = m_positionEncoding.load(std::memory_order_relaxed);
+            if (replaceAll)
+                  pending.dirty.assign(1, {{0, 0}, endOfInsertion({0, 0}, text, encoding)});
+            else
+                  applyEdit(pending.dirty, range, text, encoding);
+
+            if (!m_timer.joinable())
+            {
+                  m_stopping = false;
+                  m_timer = std::thread(&ChangeCoalescer::run, this);
+            }
+      }
+      m_cv.notify_one();
+}
+
+void ChangeCoalescer::documentChanged(const std::string &uri, const Range &range, const std::string &text)
+{
+      record(uri, range, text, false);
+}
+
+void ChangeCoalescer::documentReplaced(const std::string &uri, const std::string &text)
+{
+      record(uri, {}, text, true);
+}
+
+void ChangeCoalescer::documentClosed(const std::string &uri)
+{
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_pending.erase(uri);
+}
+
+void ChangeCoalescer::flush()
+{
+      std::unordered_map<std::string, Pending> due;
+      SettledCallback callback;
+      {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            due.swap(m_pending);
+            callback = m_callback;
+      }
+      // Nothing to report to before a callback is set or after it was cleared
+      if (!callback)
+            return;
+      for (auto &[uri, pending] : due)
+            callback(uri, pending.dirty);
+}
+
+void ChangeCoalescer::stop()
+{
+      {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+            m_pending.clear();
+      }
+      m_cv.notify_all();
+      if (m_timer.joinable())
+            m_timer.join();
+}
+
+ChangeCoalescer::Clock::time_point ChangeCoalescer::deadline(const Pending &pending) const
+{
+      return std::min(pending.lastChange + m_quietPeriod, pending.firstChange + m_maxDelay);
+}
+
+void ChangeCoalescer::run()
+{
+      std::unique_lock<std::mutex> lock(m_mutex);
+      while (!m_stopping)
+      {
+            if (m_pending.empty())
+            {
+                  m_cv.wait(lock);
+                  continue;
+            }
+
+            // Sleep until the earliest document is due, or a new edit moves the deadlines
+            Clock::time_point next = Clock::time_point::max();
+            for (const auto &[uri, pending] : m_pending)
+                  next = std::min(next, deadline(pending));
+            if (Clock::now() < next)
+            {
+                  m_cv.wait_until(lock, next);
+                  continue;
+            }
+
+            std::vector<std::pair<std::string, std::vector<Range>>> due;
+            const Clock::time_point now = Clock::now();
+            for (auto it = m_pending.begin(); it != m_pending.end();)
+            {
+                  if (deadline(it->second) <= now)
+                  {
+                        due.emplace_back(it->first, std::move(it->second.dirty));
+                        it = m_pending.erase(it);
+                  }
+                  else
+                        ++it;
+            }
+
+            // Callbacks may take a while and must not block incoming edits
+            SettledCallback callback = m_callback;
+            lock.unlock();
+            for (const auto &[uri, dirty] : due)
+            {
+                  if (!callback)
+                        break;
+                  try
+                  {
+                        callback(uri, dirty);
+                  }
+                  catch (...)
+                  {
+                        // A failing callback must not stop later documents from settling
+                  }
+            }
+            lock.lock();
+      }
+}
@@ -0,0 +1,186 @@
+#include "FrameReader.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <iostream>
+#include <unistd.h>
+
+static constexpr size_t MIN_READ_SIZE = 4096;
+
+FrameReader::FrameReader(std::istream &in, size_t initialCapacity)
+    : m_in(in), m_fd(&in == &std::cin ? STDIN_FILENO : -1), m_buffer(std::max(initialCapacity, MIN_READ_SIZE)), m_begin(0), m_end(0), m_next(0)
+{
+}
+
+// Returns the offset of the "\r\n\r\n" terminator in data[from, size), or size if there is none.
+// memchr is vectorized by the C library, so the scan only drops to scalar code on '\r' bytes.
+size_t FrameReader::findHeaderEnd(const char *data, size_t from, size_t size)
+{
+      while (from + 4 <= size)
+      {
+            const void *cr = std::memchr(data + from, '\r', size - from - 3);
+            if (!cr)
+                  return size;
+            size_t pos = static_cast<const char *>(cr) - data;
+            if (std::memcmp(data + pos, "\r\n\r\n", 4) == 0)
+                  return pos;
+            from = pos + 1;
+      }
+      return size;
+}
+
+bool FrameReader::parseContentLength(std::string_view headers, size_t &contentLength)
+{
+      static constexpr std::string_view name = "content-length:";
+
+      while (!headers.empty())
+      {
+            size_t eol = headers.find('\n');
+            std::string_view line = headers.substr(0, eol);
+            headers = eol == std::string_view::npos ? std::string_view() : headers.substr(eol + 1);
+
+            if (line.size() < name.size())
+                  continue;
+
+            bool matches = true;
+            for (size_t i = 0; i < name.size() && matches; i++)
+                  matches = (line[i] | 0x20) == name[i];
+            if (!matches)
+                  continue;
+
+            std::string_view value = line.substr(name.size());
+            while (!value.empty() && value.front() == ' ')
+                  value.remove_prefix(1);
+            while (!value.empty() && (value.back() == '\r' || value.back() == ' '))
+                  value.remove_suffix(1);
+
+            auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), contentLength);
+            return ec == std::errc() && end == value.data() + value.size();
+      }
+      return false;
+}
+
+// Reads at least one more byte into the buffer, making room for `required` bytes of unconsumed data
+bool FrameReader::fill(size_t required)
+{
+      if (m_begin > 0)
+      {
+            std::memmove(m_buffer.data(), m_buffer.data() + m_begin, m_end - m_begin);
+            m_end -= m_begin;
+            m_begin = 0;
+      }
+      if (required > m_buffer.size() || m_buffer.size() - m_end < MIN_READ_SIZE)
+            m_buffer.resize(std::max(required, m_buffer.size() * 2));
+
+      char *dst = m_buffer.data() + m_end;
+      const size_t space = m_buffer.size() - m_end;
+      std::streamsize got;
+
+      if (m_fd >= 0)
+      {
+            ssize_t n;
+            do
+            {
+                  n = ::read(m_fd, dst, space);
+            } while (n < 0 && errno == EINTR);
+            got = n;
+      }
+      else
+      {
+            // Only take what the stream has already buffered so reads never block for a full chunk
+            std::streambuf *sb = m_in.rdbuf();
+            if (!sb || sb->sgetc() == std::char_traits<char>::eof())
+                  return false;
+            std::streamsize available = sb->in_avail();
+            got = sb->sgetn(dst, std::min<std::streamsize>(available > 0 ? available : 1, space));
+      }
+
+      if (got <= 0)
+            return false;
+      m_end += got;
+      return true;
+}
+
+int FrameReader::next(std::string_view &payload)
+{
+      payload = {};
+      m_begin = m_next;
+
+      size_t searched = 0;
+      size_t headerEnd;
+      while ((headerEnd = findHeaderEnd(m_buffer.data() + m_begin, searched, m_end - m_begin)) == m_end - m_begin)
+      {
+            if (m_end - m_begin > MAX_HEADER_SIZE)
+                  return -1;
+            // The terminator may straddle the chunk boundary
+            searched = m_end - m_begin >= 3 ? m_end - m_begin - 3 : 0;
+            if (!fill(0))
+                  return -1;
+      }
+
+      size_t contentLength = 0;
+      const size_t bodyStart = headerEnd + 4;
+      if (!parseContentLength(std::string_view(m_buffer.data() + m_begin, headerEnd), contentLength))
+      {
+            m_next = m_begin + bodyStart;
+            return 0;
+      }
+      if (contentLength > MAX_MESSAGE_SIZE)
+            return -1;
+      if (contentLength == 0)
+      {
+            m_next = m_begin + bodyStart;
+            return 0;
+      }
+
+      while (m_end - m_begin < bodyStart + contentLength)
+      {
+            if (!fill(bodyStart + contentLength))
+                  return -1;
+      }
+
+      payload = std::string_view(m_buffer.data() + m_begin + bodyStart, contentLength);
+      m_next = m_begin + bodyStart + contentLength;
+      return static_cast<int>(contentLength);
+}
+
+std::string_view FrameReader::frame() const
+{
+      return std::string_view(m_buffer.data() + m_begin, m_next - m_begin);
+}
+
+void FrameSplitter::append(const char *data, size_t size)
+{
+      // Payloads handed out before are no longer needed
+      if (m_begin == m_data.size() || m_begin > (1 << 16))
+      {
+            m_data.erase(0, m_begin);
+            m_begin = 0;
+      }
+      m_data.append(data, size);
+}
+
+std::optional<std::string_view> FrameSplitter::next()
+{
+      while (true)
+      {
+            const size_t headerEnd = m_data.find("\r\n\r\n", m_begin);
+            if (headerEnd == std::string::npos)
+                  return std::nullopt;
+
+            size_t length = 0;
+            const size_t bodyStart = headerEnd + 4;
+            if (!FrameReader::parseContentLength(std::string_view(m_data).substr(m_begin, headerEnd - m_begin), length) ||
+                length > FrameReader::MAX_MESSAGE_SIZE)
+            {
+                  m_begin = bodyStart;
+                  continue;
+            }
+            if (m_data.size() - bodyStart < length)
+                  return std::nullopt;
+
+            m_begin = bodyStart + length;
+            return std::string_view(m_data).substr(bodyStart, length);
+      }
+}
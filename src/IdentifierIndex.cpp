@@ -0,0 +1,195 @@
+#include "IdentifierIndex.hpp"
+#include <algorithm>
+#include <mutex>
+#include <unordered_set>
+
+IdentifierIndex::IdentifierIndex(const WordRules &rules, PositionEncoding encoding) : m_rules(rules), m_encoding(encoding) {}
+
+IdentifierIndex::IdentifierIndex(const IdentifierIndex &other) : m_rules(other.m_rules), m_encoding(other.m_encoding)
+{
+      std::shared_lock<std::shared_mutex> lock(other.m_mutex);
+      m_segments = other.m_segments;
+      m_lineCount = other.m_lineCount;
+}
+
+void IdentifierIndex::rebuild(const textDocument &document)
+{
+      auto segments = segmentsOf(indexLines(document, 0, document.lineCount()));
+      std::unique_lock<std::shared_mutex> lock(m_mutex);
+      m_segments = std::move(segments);
+      m_lineCount = document.lineCount();
+}
+
+void IdentifierIndex::update(const textDocument &document, const Range &range, std::string_view text)
+{
+      const size_t first = range.start.line;
+      const size_t added = std::count(text.begin(), text.end(), '\n');
+
+      {
+            std::unique_lock<std::shared_mutex> lock(m_mutex);
+            if (first < m_lineCount)
+            {
+                  const size_t last = std::min<size_t>(std::max(range.end.line, range.start.line), m_lineCount - 1);
+                  const size_t lineCount = m_lineCount + added - (last - first);
+                  if (lineCount == document.lineCount())
+                  {
+                        // Segments [segmentFrom, segmentTo) hold lines first to last before the edit
+                        size_t segmentFrom = 0, segmentStart = 0;
+                        while (segmentStart + m_segments[segmentFrom]->lines <= first)
+                              segmentStart += m_segments[segmentFrom++]->lines;
+                        size_t segmentTo = segmentFrom + 1, segmentEnd = segmentStart + m_segments[segmentFrom]->lines;
+                        while (segmentEnd <= last)
+                              segmentEnd += m_segments[segmentTo++]->lines;
+
+                        std::vector<std::shared_ptr<const Block>> blocks;
+                        auto takeSegment = [&](size_t segment)
+                        { blocks.insert(blocks.end(), m_segments[segment]->blocks.begin(), m_segments[segment]->blocks.end()); };
+                        for (size_t segment = segmentFrom; segment < segmentTo; segment++)
+                              takeSegment(segment);
+
+                        // Of those, blocks [from, to) hold lines [start, end)
+                        size_t from = 0, start = segmentStart;
+                        while (start + blocks[from]->lines <= first)
+                              start += blocks[from++]->lines;
+                        size_t to = from + 1, end = start + blocks[from]->lines;
+                        while (end <= last)
+                              end += blocks[to++]->lines;
+
+                        // The same lines after the edit, taking in the next block rather than leaving a small one behind
+                        size_t newEnd = end + added - (last - first);
+                        if (newEnd - start < blockLines / 2)
+                        {
+                              if (to == blocks.size() && segmentTo < m_segments.size())
+                                    takeSegment(segmentTo++);
+                              if (to < blocks.size())
+                                    newEnd += blocks[to++]->lines;
+                        }
+
+                        auto indexed = indexLines(document, start, newEnd);
+                        blocks.erase(blocks.begin() + from, blocks.begin() + to);
+                        blocks.insert(blocks.begin() + from, indexed.begin(), indexed.end());
+                        // Likewise for segments
+                        if (blocks.size() < segmentBlocks / 2 && segmentTo < m_segments.size())
+                              takeSegment(segmentTo++);
+
+                        auto segments = segmentsOf(blocks);
+                        m_segments.erase(m_segments.begin() + segmentFrom, m_segments.begin() + segmentTo);
+                        m_segments.insert(m_segments.begin() + segmentFrom, segments.begin(), segments.end());
+                        m_lineCount = lineCount;
+                        return;
+                  }
+            }
+      }
+      // Edits outside the indexed text mean the index is out of step, start over
+      rebuild(document);
+}
+
+std::vector<Range> IdentifierIndex::occurrences(std::string_view identifier) const
+{
+      std::vector<Range> out;
+      std::shared_lock<std::shared_mutex> lock(m_mutex);
+      uint start = 0;
+      for (const auto &segment : m_segments)
+      {
+            for (const auto &block : segment->blocks)
+            {
+                  auto it = block->occurrences.find(identifier);
+                  if (it != block->occurrences.end())
+                  {
+                        for (Range range : it->second)
+                        {
+                              range.start.line += start;
+                              range.end.line += start;
+                              out.push_back(range);
+                        }
+                  }
+                  start += block->lines;
+            }
+      }
+      return out;
+}
+
+std::vector<Location> IdentifierIndex::locations(std::string_view identifier, const DocumentUri &uri) const
+{
+      std::vector<Location> out;
+      for (const Range &range : occurrences(identifier))
+            out.push_back({uri, range});
+      return out;
+}
+
+size_t IdentifierIndex::identifierCount() const
+{
+      std::unordered_set<std::string_view> identifiers;
+      std::shared_lock<std::shared_mutex> lock(m_mutex);
+      for (const auto &segment : m_segments)
+            for (const auto &block : segment->blocks)
+                  for (const auto &[identifier, ranges] : block->occurrences)
+                        identifiers.insert(identifier);
+      return identifiers.size();
+}
+
+// Indexes lines [first, last) of the document into blocks of about blockLines lines
+std::vector<std::shared_ptr<const IdentifierIndex::Block>> IdentifierIndex::indexLines(const textDocument &document, size_t first, size_t last) const
+{
+      const size_t lines = last - first;
+      const size_t count = std::max<size_t>(1, (lines + blockLines - 1) / blockLines);
+      std::vector<std::shared_ptr<const Block>> blocks;
+      blocks.reserve(count);
+      for (size_t i = 0; i < count; i++)
+            blocks.push_back(indexBlock(document, first + lines * i / count, first + lines * (i + 1) / count));
+      return blocks;
+}
+
+// Adds the identifiers on lines [first, last) of the document to a new block
+std::shared_ptr<const IdentifierIndex::Block> IdentifierIndex::indexBlock(const textDocument &document, size_t first, size_t last) const
+{
+      auto block = std::make_shared<Block>();
+      block->lines = last - first;
+      for (size_t line = first; line < last; line++)
+      {
+            std::string_view text = document.lineView(line);
+            const bool ascii = m_encoding == PositionEncoding::UTF8 || findNonAscii(text) == text.size();
+            const uint relative = static_cast<uint>(line - first);
+
+            // Code units up to byte `unitsAt`, carried along so long lines are converted once
+            size_t unitsAt = 0, units = 0;
+            auto column = [&](size_t byte)
+            {
+                  if (ascii)
+                        return byte;
+                  units += unitsFromByteOffset(text.substr(unitsAt), byte - unitsAt, m_encoding);
+                  unitsAt = byte;
+                  return units;
+            };
+
+            // Identifiers come left to right, so appending keeps every list sorted
+            m_rules.forEachIdentifier(text, [&](size_t begin, size_t end)
+                                      {
+                                            std::string_view identifier = text.substr(begin, end - begin);
+                                            const uint startColumn = column(begin);
+                                            Range range{{relative, startColumn}, {relative, static_cast<uint>(column(end))}};
+
+                                            auto it = block->occurrences.find(identifier);
+                                            if (it == block->occurrences.end())
+                                                  it = block->occurrences.emplace(std::string(identifier), std::vector<Range>()).first;
+                                            it->second.push_back(range); });
+      }
+      return block;
+}
+
+// Groups the blocks into segments of about segmentBlocks blocks
+std::vector<std::shared_ptr<const IdentifierIndex::Segment>> IdentifierIndex::segmentsOf(const std::vector<std::shared_ptr<const Block>> &blocks)
+{
+      const size_t count = std::max<size_t>(1, (blocks.size() + segmentBlocks - 1) / segmentBlocks);
+      std::vector<std::shared_ptr<const Segment>> segments;
+      segments.reserve(count);
+      for (size_t i = 0; i < count; i++)
+      {
+            auto segment = std::make_shared<Segment>();
+            segment->blocks.assign(blocks.begin() + blocks.size() * i / count, blocks.begin() + blocks.size() * (i + 1) / count);
+            for (const auto &block : segment->blocks)
+                  segment->lines += block->lines;
+            segments.push_back(std::move(segment));
+      }
+      return segments;
+}
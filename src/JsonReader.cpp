@@ -0,0 +1,372 @@
+#include "JsonReader.hpp"
+#include <charconv>
+#include <cstring>
+
+JsonReader::JsonReader(std::string_view json) : m_json(json), m_pos(0), m_failed(false) {}
+
+bool JsonReader::ok() const
+{
+      return !m_failed;
+}
+
+size_t JsonReader::position() const
+{
+      return m_pos;
+}
+
+bool JsonReader::fail()
+{
+      m_failed = true;
+      return false;
+}
+
+void JsonReader::skipWhitespace()
+{
+      while (m_pos < m_json.size())
+      {
+            char c = m_json[m_pos];
+            if (c != ' ' && c != '\n' && c != '\r' && c != '\t')
+                  return;
+            m_pos++;
+      }
+}
+
+bool JsonReader::consume(char c)
+{
+      if (m_failed)
+            return false;
+      skipWhitespace();
+      if (m_pos < m_json.size() && m_json[m_pos] == c)
+      {
+            m_pos++;
+            return true;
+      }
+      return false;
+}
+
+JsonReader::Type JsonReader::peek()
+{
+      if (m_failed)
+            return Type::Invalid;
+      skipWhitespace();
+      if (m_pos >= m_json.size())
+            return Type::End;
+
+      switch (m_json[m_pos])
+      {
+      case '{':
+            return Type::Object;
+      case '[':
+            return Type::Array;
+      case '"':
+            return Type::String;
+      case 't':
+      case 'f':
+            return Type::Boolean;
+      case 'n':
+            return Type::Null;
+      default:
+      {
+            char c = m_json[m_pos];
+            return (c == '-' || (c >= '0' && c <= '9')) ? Type::Number : Type::Invalid;
+      }
+      }
+}
+
+bool JsonReader::beginObject()
+{
+      return consume('{') || fail();
+}
+
+bool JsonReader::nextMember(std::string_view &key)
+{
+      if (m_failed)
+            return false;
+      consume(',');
+      if (consume('}'))
+            return false;
+      if (!readStringView(key) || !consume(':'))
+            return fail();
+      return true;
+}
+
+bool JsonReader::findMember(std::string_view key)
+{
+      std::string_view name;
+      while (nextMember(name))
+      {
+            if (name == key)
+                  return true;
+            if (!skipValue())
+                  return false;
+      }
+      return false;
+}
+
+bool JsonReader::beginArray()
+{
+      return consume('[') || fail();
+}
+
+bool JsonReader::nextElement()
+{
+      if (m_failed)
+            return false;
+      consume(',');
+      if (consume(']'))
+            return false;
+      return true;
+}
+
+// Moves past a string starting at m_pos, returns false if it is unterminated
+bool JsonReader::skipString()
+{
+      size_t i = m_pos + 1;
+      while (i < m_json.size())
+      {
+            const char *p = static_cast<const char *>(std::memchr(m_json.data() + i, '"', m_json.size() - i));
+            if (!p)
+                  break;
+            size_t quote = p - m_json.data();
+
+            // The quote is escaped if it is preceded by an odd number of backslashes
+            size_t slashes = 0;
+            while (quote - slashes > m_pos && m_json[quote - slashes - 1] == '\\')
+                  slashes++;
+            if (slashes % 2 == 0)
+            {
+                  m_pos = quote + 1;
+                  return true;
+            }
+            i = quote + 1;
+      }
+      return fail();
+}
+
+bool JsonReader::skipScalar()
+{
+      const size_t start = m_pos;
+      while (m_pos < m_json.size())
+      {
+            char c = m_json[m_pos];
+            if (c == ',' || c == '}' || c == ']' || c == ' ' || c == '\n' || c == '\r' || c == '\t')
+                  break;
+            m_pos++;
+      }
+      return m_pos > start || fail();
+}
+
+bool JsonReader::readStringView(std::string_view &out)
+{
+      if (peek() != Type::String)
+            return fail();
+
+      const size_t start = m_pos + 1;
+      if (!skipString())
+            return false;
+      out = m_json.substr(start, m_pos - 1 - start);
+      return true;
+}
+
+static void appendUtf8(std::string &out, uint32_t cp)
+{
+      if (cp < 0x80)
+            out += static_cast<char>(cp);
+      else if (cp < 0x800)
+      {
+            out += static_cast<char>(0xC0 | (cp >> 6));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+      }
+      else if (cp < 0x10000)
+      {
+            out += static_cast<char>(0xE0 | (cp >> 12));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+      }
+      else
+      {
+            out += static_cast<char>(0xF0 | (cp >> 18));
+            out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+      }
+}
+
+static bool parseHex4(std::string_view s, size_t pos, uint32_t &out)
+{
+      if (pos + 4 > s.size())
+            return false;
+      auto [end, ec] = std::from_chars(s.data() + pos, s.data() + pos + 4, out, 16);
+      return ec == std::errc() && end == s.data() + pos + 4;
+}
+
+bool JsonReader::readString(std::string &out)
+{
+      if (peek() != Type::String)
+            return fail();
+
+      const size_t start = m_pos + 1;
+      if (!skipString())
+            return false;
+      std::string_view raw = m_json.substr(start, m_pos - 1 - start);
+
+      // Fast path: nothing to unescape
+      size_t escape = raw.find('\\');
+      if (escape == std::string_view::npos)
+      {
+            out.assign(raw);
+            return true;
+      }
+
+      out.assign(raw.substr(0, escape));
+      for (size_t i = escape; i < raw.size(); i++)
+      {
+            if (raw[i] != '\\')
+            {
+                  out += raw[i];
+                  continue;
+            }
+            if (++i >= raw.size())
+                  return fail();
+
+            switch (raw[i])
+            {
+            case '"':
+            case '\\':
+            case '/':
+                  out += raw[i];
+                  break;
+            case 'b':
+                  out += '\b';
+                  break;
+            case 'f':
+                  out += '\f';
+                  break;
+            case 'n':
+                  out += '\n';
+                  break;
+            case 'r':
+                  out += '\r';
+                  break;
+            case 't':
+                  out += '\t';
+                  break;
+            case 'u':
+            {
+                  uint32_t cp;
+                  if (!parseHex4(raw, i + 1, cp))
+                        return fail();
+                  i += 4;
+                  // Surrogate pair
+                  if (cp >= 0xD800 && cp < 0xDC00 && i + 2 < raw.size() && raw[i + 1] == '\\' && raw[i + 2] == 'u')
+                  {
+                        uint32_t low;
+                        if (parseHex4(raw, i + 3, low) && low >= 0xDC00 && low < 0xE000)
+                        {
+                              cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                              i += 6;
+                        }
+                  }
+                  appendUtf8(out, cp);
+                  break;
+            }
+            default:
+                  return fail();
+            }
+      }
+      return true;
+}
+
+template <typename T>
+static bool readNumber(std::string_view json, size_t &pos, T &out)
+{
+      auto [end, ec] = std::from_chars(json.data() + pos, json.data() + json.size(), out);
+      if (ec != std::errc())
+            return false;
+      pos = end - json.data();
+      return true;
+}
+
+bool JsonReader::readInt(int64_t &out)
+{
+      return (peek() == Type::Number && readNumber(m_json, m_pos, out)) || fail();
+}
+
+bool JsonReader::readUInt(uint64_t &out)
+{
+      return (peek() == Type::Number && readNumber(m_json, m_pos, out)) || fail();
+}
+
+bool JsonReader::readBool(bool &out)
+{
+      if (peek() != Type::Boolean)
+            return fail();
+      if (m_json.substr(m_pos, 4) == "true")
+      {
+            out = true;
+            m_pos += 4;
+            return true;
+      }
+      if (m_json.substr(m_pos, 5) == "false")
+      {
+            out = false;
+            m_pos += 5;
+            return true;
+      }
+      return fail();
+}
+
+bool JsonReader::readNull()
+{
+      if (peek() != Type::Null || m_json.substr(m_pos, 4) != "null")
+            return fail();
+      m_pos += 4;
+      return true;
+}
+
+bool JsonReader::skipValue()
+{
+      switch (peek())
+      {
+      case Type::String:
+            return skipString();
+      case Type::Number:
+      case Type::Boolean:
+      case Type::Null:
+            return skipScalar();
+      case Type::Object:
+      case Type::Array:
+            break;
+      default:
+            return fail();
+      }
+
+      // Containers: track nesting depth, skipping over strings so brackets inside them are ignored
+      size_t depth = 0;
+      while (m_pos < m_json.size())
+      {
+            char c = m_json[m_pos];
+            if (c == '"')
+            {
+                  if (!skipString())
+                        return false;
+                  continue;
+            }
+            m_pos++;
+            if (c == '{' || c == '[')
+                  depth++;
+            else if ((c == '}' || c == ']') && --depth == 0)
+                  return true;
+      }
+      return fail();
+}
+
+bool JsonReader::captureValue(std::string_view &out)
+{
+      skipWhitespace();
+      const size_t start = m_pos;
+      if (!skipValue())
+            return false;
+      out = m_json.substr(start, m_pos - start);
+      return true;
+}
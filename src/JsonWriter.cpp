@@ -0,0 +1,209 @@
+#include "JsonWriter.hpp"
+#include <charconv>
+
+JsonWriter::JsonWriter(std::string &out) : m_out(out), m_afterKey(false) {}
+
+// Writes the comma that goes before a new member or element, if one is needed
+void JsonWriter::separate()
+{
+      if (m_afterKey)
+      {
+            m_afterKey = false;
+            return;
+      }
+      if (m_hasEntry.empty())
+            return;
+      if (m_hasEntry.back())
+            m_out += ',';
+      m_hasEntry.back() = true;
+}
+
+void JsonWriter::beginObject()
+{
+      separate();
+      m_out += '{';
+      m_hasEntry.push_back(false);
+}
+
+void JsonWriter::endObject()
+{
+      m_out += '}';
+      m_hasEntry.pop_back();
+}
+
+void JsonWriter::beginArray()
+{
+      separate();
+      m_out += '[';
+      m_hasEntry.push_back(false);
+}
+
+void JsonWriter::endArray()
+{
+      m_out += ']';
+      m_hasEntry.pop_back();
+}
+
+void JsonWriter::key(std::string_view name)
+{
+      value(name);
+      m_out += ':';
+      m_afterKey = true;
+}
+
+// Length of the UTF-8 sequence starting at s[i] if it is well formed. Otherwise sets
+// `valid` to false and returns the length of its longest well formed prefix, at least
+// one byte, which is replaced as a whole like nlohmann's error_handler_t::replace does.
+static size_t utf8Sequence(std::string_view s, size_t i, bool &valid)
+{
+      const unsigned char lead = static_cast<unsigned char>(s[i]);
+      size_t length;
+      unsigned char low = 0x80, high = 0xBF; // Allowed range of the second byte
+      if (lead >= 0xC2 && lead <= 0xDF)
+            length = 2;
+      else if (lead >= 0xE0 && lead <= 0xEF)
+      {
+            length = 3;
+            if (lead == 0xE0)
+                  low = 0xA0; // Overlong
+            else if (lead == 0xED)
+                  high = 0x9F; // Surrogates
+      }
+      else if (lead >= 0xF0 && lead <= 0xF4)
+      {
+            length = 4;
+            if (lead == 0xF0)
+                  low = 0x90; // Overlong
+            else if (lead == 0xF4)
+                  high = 0x8F; // Above U+10FFFF
+      }
+      else
+      {
+            valid = false;
+            return 1;
+      }
+
+      for (size_t n = 1; n < length; n++)
+      {
+            const unsigned char c = i + n < s.size() ? static_cast<unsigned char>(s[i + n]) : 0;
+            if (c < low || c > high)
+            {
+                  valid = false;
+                  return n;
+            }
+            low = 0x80;
+            high = 0xBF;
+      }
+      valid = true;
+      return length;
+}
+
+void JsonWriter::value(std::string_view s)
+{
+      static constexpr char hex[] = "0123456789abcdef";
+
+      separate();
+      m_out.reserve(m_out.size() + s.size() + 2);
+      m_out += '"';
+
+      // Copy runs of characters that need no escaping in one go
+      size_t run = 0;
+      for (size_t i = 0; i < s.size(); i++)
+      {
+            unsigned char c = static_cast<unsigned char>(s[i]);
+            if (c >= 0x20 && c != '"' && c != '\\' && c < 0x80)
+                  continue;
+            if (c >= 0x80)
+            {
+                  // Valid UTF-8 is copied as is, anything else becomes U+FFFD
+                  bool valid;
+                  const size_t length = utf8Sequence(s, i, valid);
+                  if (!valid)
+                  {
+                        m_out.append(s.data() + run, i - run);
+                        m_out += "\xEF\xBF\xBD";
+                        run = i + length;
+                  }
+                  i += length - 1;
+                  continue;
+            }
+
+            m_out.append(s.data() + run, i - run);
+            run = i + 1;
+            switch (c)
+            {
+            case '"':
+                  m_out += "\\\"";
+                  break;
+            case '\\':
+                  m_out += "\\\\";
+                  break;
+            case '\b':
+                  m_out += "\\b";
+                  break;
+            case '\f':
+                  m_out += "\\f";
+                  break;
+            case '\n':
+                  m_out += "\\n";
+                  break;
+            case '\r':
+                  m_out += "\\r";
+                  break;
+            case '\t':
+                  m_out += "\\t";
+                  break;
+            default:
+                  m_out += "\\u00";
+                  m_out += hex[c >> 4];
+                  m_out += hex[c & 0xF];
+                  break;
+            }
+      }
+      m_out.append(s.data() + run, s.size() - run);
+      m_out += '"';
+}
+
+void JsonWriter::value(const char *s)
+{
+      value(std::string_view(s));
+}
+
+void JsonWriter::value(const std::string &s)
+{
+      value(std::string_view(s));
+}
+
+void JsonWriter::value(bool b)
+{
+      separate();
+      m_out += b ? "true" : "false";
+}
+
+void JsonWriter::value(std::nullptr_t)
+{
+      separate();
+      m_out += "null";
+}
+
+void JsonWriter::raw(std::string_view json)
+{
+      separate();
+      m_out += json;
+}
+
+void JsonWriter::writeInt(int64_t n)
+{
+      separate();
+      char buffer[24];
+      auto [end, ec] = std::to_chars(buffer, buffer + sizeof(buffer), n);
+      m_out.append(buffer, end);
+}
+
+void JsonWriter::writeUInt(uint64_t n)
+{
+      separate();
+      char buffer[24];
+      auto [end, ec] = std::to_chars(buffer, buffer + sizeof(buffer), n);
+      m_out.append(buffer, end);
+}
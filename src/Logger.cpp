@@ -0,0 +1,177 @@
+#include "Logger.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+static constexpr const char *levelNames[] = {"debug", "info", "warning", "error", "off"};
+
+Logger::Logger() : m_level(LogLevel::Off), m_file(nullptr), m_enqueuePos(0), m_dequeuePos(0), m_dropped(0), m_written(0), m_accepted(0), m_sleeping(false), m_stopping(false) {}
+
+Logger::Logger(const std::string &path, LogLevel level) : Logger()
+{
+      if (level == LogLevel::Off)
+            return;
+      m_file = std::fopen(path.c_str(), "a");
+      if (!m_file)
+            return;
+
+      m_cells = std::make_unique<std::array<Cell, QUEUE_CAPACITY>>();
+      for (size_t i = 0; i < QUEUE_CAPACITY; i++)
+            (*m_cells)[i].sequence.store(i, std::memory_order_relaxed);
+
+      m_level = level;
+      m_writer = std::thread(&Logger::run, this);
+}
+
+Logger::~Logger()
+{
+      if (m_writer.joinable())
+      {
+            m_stopping.store(true);
+            {
+                  std::lock_guard<std::mutex> lock(m_wakeMutex);
+                  m_wake.notify_one();
+            }
+            m_writer.join();
+      }
+      if (m_file)
+            std::fclose(m_file);
+}
+
+Logger &Logger::instance()
+{
+      static Logger logger = []
+      {
+            const char *path = std::getenv("LSPP_LOG_FILE");
+            if (!path)
+                  return Logger();
+            return Logger(path, parseLevel(std::getenv("LSPP_LOG_LEVEL"), LogLevel::Debug));
+      }();
+      return logger;
+}
+
+LogLevel Logger::parseLevel(const char *name, LogLevel fallback)
+{
+      if (!name)
+            return fallback;
+      for (size_t i = 0; i < std::size(levelNames); i++)
+      {
+            if (std::strcmp(name, levelNames[i]) == 0)
+                  return static_cast<LogLevel>(i);
+      }
+      return fallback;
+}
+
+void Logger::write(LogLevel level, std::string text)
+{
+      if (!enabled(level))
+            return;
+
+      size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+      Cell *cell;
+      while (true)
+      {
+            cell = &(*m_cells)[pos & (QUEUE_CAPACITY - 1)];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            if (sequence == pos)
+            {
+                  if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                        break;
+            }
+            else if (sequence < pos)
+            {
+                  // The writer has not caught up, losing a line beats blocking the caller
+                  m_dropped.fetch_add(1, std::memory_order_relaxed);
+                  return;
+            }
+            else
+                  pos = m_enqueuePos.load(std::memory_order_relaxed);
+      }
+
+      cell->entry.level = level;
+      cell->entry.time = std::chrono::system_clock::now();
+      cell->entry.text = std::move(text);
+      cell->sequence.store(pos + 1, std::memory_order_release);
+      m_accepted.fetch_add(1, std::memory_order_relaxed);
+
+      // Pairs with the fence in run(): either the writer sees this line or we see it asleep
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (m_sleeping.load(std::memory_order_relaxed))
+      {
+            std::lock_guard<std::mutex> lock(m_wakeMutex);
+            m_wake.notify_one();
+      }
+}
+
+bool Logger::tryPop(Entry &entry)
+{
+      Cell &cell = (*m_cells)[m_dequeuePos & (QUEUE_CAPACITY - 1)];
+      if (cell.sequence.load(std::memory_order_acquire) != m_dequeuePos + 1)
+            return false;
+
+      entry = std::move(cell.entry);
+      cell.sequence.store(m_dequeuePos + QUEUE_CAPACITY, std::memory_order_release);
+      m_dequeuePos++;
+      return true;
+}
+
+void Logger::flush()
+{
+      if (!m_writer.joinable())
+            return;
+      const size_t target = m_accepted.load();
+      while (m_written.load() < target)
+      {
+            {
+                  std::lock_guard<std::mutex> lock(m_wakeMutex);
+                  m_wake.notify_one();
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+}
+
+size_t Logger::dropped() const
+{
+      return m_dropped.load(std::memory_order_relaxed);
+}
+
+void Logger::run()
+{
+      std::string batch;
+      Entry entry;
+      while (true)
+      {
+            size_t count = 0;
+            while (count < QUEUE_CAPACITY && tryPop(entry))
+            {
+                  batch += std::to_string(std::chrono::system_clock::to_time_t(entry.time));
+                  batch += ' ';
+                  batch += levelNames[static_cast<size_t>(entry.level)];
+                  batch += ">>";
+                  batch += entry.text;
+                  batch += '\n';
+                  count++;
+            }
+
+            if (count > 0)
+            {
+                  std::fwrite(batch.data(), 1, batch.size(), m_file);
+                  std::fflush(m_file);
+                  batch.clear();
+                  m_written.fetch_add(count, std::memory_order_release);
+                  continue;
+            }
+
+            if (m_stopping.load())
+                  return;
+
+            // Nothing queued: sleep until a producer sees m_sleeping and wakes us
+            std::unique_lock<std::mutex> lock(m_wakeMutex);
+            m_sleeping.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            const Cell &next = (*m_cells)[m_dequeuePos & (QUEUE_CAPACITY - 1)];
+            if (next.sequence.load(std::memory_order_relaxed) != m_dequeuePos + 1 && !m_stopping.load())
+                  m_wake.wait_for(lock, std::chrono::milliseconds(100));
+            m_sleeping.store(false, std::memory_order_relaxed);
+      }
+}
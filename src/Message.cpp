@@ -1,26 +1,52 @@
 #include "Message.hpp"
+#include "JsonReader.hpp"
+#include "Logger.hpp"
 #include <cstring>
 #include <iostream>
 #include <string>
 #include <climits>
+#include <limits>
 #include <cstddef>
 #include <cassert>
-#include <fstream>
 #include <optional>
 #include <algorithm>
+#include <array>
+#include <utility>
 
-Message::Message() : m_buffer(nullptr), m_payloadSize(0), m_jsonData(nlohmann::json::value_t::null) {}
+Message::Message() : m_storage(), m_payload()
+{
+	reset();
+}
+
+Message::Message(const Message &other) : m_storage(), m_payload()
+{
+	*this = other;
+}
 
-Message::~Message()
+Message &Message::operator=(const Message &other)
 {
-	if (m_buffer)
+	if (this != &other)
 	{
-		free(m_buffer);
+		m_storage.assign(other.m_payload);
+		m_payload = m_storage;
+		m_valid = other.m_valid;
+		m_method = other.m_method;
+		m_methodId = other.m_methodId;
+		m_id = other.m_id;
+		m_uri = other.m_uri;
+		m_jsonrpcOffset = other.m_jsonrpcOffset;
+		m_jsonrpcLength = other.m_jsonrpcLength;
+		m_paramsOffset = other.m_paramsOffset;
+		m_paramsLength = other.m_paramsLength;
+		m_params = other.m_params;
+		m_scanTime = other.m_scanTime;
 	}
+	return *this;
 }
 
-Message::Message(std::istream &buffer) : m_buffer(nullptr), m_payloadSize(0), m_jsonData(nlohmann::json::value_t::null)
+Message::Message(std::istream &buffer) : m_storage(), m_payload()
 {
+	reset();
 	if (buffer.peek() == EOF)
 	{
 		return;
@@ -28,13 +54,24 @@ Message::Message(std::istream &buffer) : m_buffer(nullptr), m_payloadSize(0), m_
 	readMessage(buffer);
 }
 
+void Message::reset()
+{
+	m_valid = false;
+	m_method.clear();
+	m_methodId = Method::NONE;
+	m_id.reset();
+	m_uri.clear();
+	m_jsonrpcOffset = m_jsonrpcLength = 0;
+	m_paramsOffset = m_paramsLength = 0;
+	m_params.reset();
+	m_scanTime = std::chrono::nanoseconds::zero();
+}
+
 std::string Message::get() const
 {
-	if (!m_buffer)
-		return "";
 	try
 	{
-		return std::string(m_buffer);
+		return std::string(m_payload);
 	}
 	catch (const std::bad_alloc &)
 	{
@@ -43,310 +80,399 @@ std::string Message::get() const
 	}
 }
 
+std::string_view Message::payload() const
+{
+	return m_payload;
+}
+
 nlohmann::json Message::jsonData() const
 {
-	return m_jsonData;
+	if (!m_valid)
+		return nlohmann::json(nlohmann::json::value_t::discarded);
+	return nlohmann::json::parse(m_payload, nullptr, false);
 }
 
-int Message::readMessage(std::istream &stream)
+void Message::detach()
 {
-	// Free old buffer if exists (for message reuse)
-	if (m_buffer)
+	if (m_payload.data() != m_storage.data())
 	{
-		free(m_buffer);
-		m_buffer = nullptr;
+		m_storage.assign(m_payload);
+		m_payload = m_storage;
 	}
-	m_payloadSize = 0;
+}
 
-	// Check if stream is in good state before reading
-	if (!stream.good() && !stream.eof())
-	{
-		return -1; // Signal error (but allow eof)
-	}
+int Message::readMessage(FrameReader &reader)
+{
+	reset();
 
-	// Read header line: "Content-Length: <size>" (case-insensitive)
-	std::string headerLine;
-	if (!std::getline(stream, headerLine))
+	int size = reader.next(m_payload);
+	if (size <= 0)
 	{
-		return -1; // Failed to read header
+		return size;
 	}
+	return timedScanPayload();
+}
 
-	// Remove trailing whitespace/carriage return
-	while (!headerLine.empty() && (headerLine.back() == '\r' || headerLine.back() == '\n' || headerLine.back() == ' '))
-	{
-		headerLine.pop_back();
-	}
+int Message::readMessage(std::istream &stream)
+{
+	m_payload = {};
+	reset();
 
-	// Parse "Content-Length: <size>" (case-insensitive)
-	const std::string headerPrefixLower = "content-length: ";
-	std::string headerLower = headerLine;
-	std::transform(headerLower.begin(), headerLower.end(), headerLower.begin(), ::tolower);
-	if (headerLower.size() < headerPrefixLower.size() || headerLower.substr(0, headerPrefixLower.size()) != headerPrefixLower)
+	// Check if stream is in good state before reading
+	if (!stream.good() && !stream.eof())
 	{
-		return -1; // Invalid header format
+		return -1; // Signal error (but allow eof)
 	}
 
-	size_t temp_size = 0;
-	try
+	// Read the header block up to the blank line, without consuming anything past it
+	std::streambuf *sb = stream.rdbuf();
+	char headers[FrameReader::MAX_HEADER_SIZE];
+	size_t headerSize = 0;
+	size_t lineStart = 0;
+	while (true)
 	{
-		std::string sizeStr = headerLine.substr(headerPrefixLower.size());
-		temp_size = std::stoul(sizeStr);
+		int c = sb->sbumpc();
+		if (c == EOF)
+		{
+			stream.setstate(std::ios::eofbit);
+			return -1; // Failed to read header
+		}
+		if (headerSize == sizeof(headers))
+		{
+			return -1; // Header too long
+		}
+		headers[headerSize++] = static_cast<char>(c);
 
-		// Use reasonable upper limit (10MB) to prevent bad_alloc from malformed/malicious data
-		constexpr size_t MAX_MESSAGE_SIZE = 10 * 1024 * 1024; // 10 MB
-		if (temp_size == 0 || temp_size > MAX_MESSAGE_SIZE)
+		if (c == '\n')
 		{
-			return -1; // Invalid size
+			// A line holding nothing but an optional '\r' ends the header block
+			if (headerSize - lineStart <= 2 && lineStart > 0)
+				break;
+			lineStart = headerSize;
 		}
 	}
-	catch (const std::exception &)
-	{
-		return -1; // Parsing failed
-	}
 
-	// Skip the blank line (\r\n)
-	std::string blankLine;
-	if (!std::getline(stream, blankLine))
+	size_t temp_size = 0;
+	if (!FrameReader::parseContentLength(std::string_view(headers, lineStart), temp_size) ||
+	    temp_size == 0 || temp_size > FrameReader::MAX_MESSAGE_SIZE)
 	{
-		return -1; // Failed to skip blank line
+		return -1; // Invalid header or size
 	}
 
-	// Allocate buffer for payload
-	m_buffer = static_cast<char *>(malloc(temp_size + 1));
-	if (!m_buffer)
+	// Payload storage is reused between messages
+	m_storage.resize(temp_size);
+	std::streamsize bytesRead = sb->sgetn(m_storage.data(), temp_size);
+	if (bytesRead != static_cast<std::streamsize>(temp_size))
 	{
+		stream.setstate(std::ios::eofbit);
 		return -1;
 	}
+	m_payload = m_storage;
 
-	// Read JSON payload - use a new scope to ensure stream ref goes out of scope quickly
+	return timedScanPayload();
+}
+
+// Only the members needed to route the message are extracted here, "params" is
+// just delimited so that it can be parsed later if a handler needs it.
+int Message::timedScanPayload()
+{
+	const auto start = std::chrono::steady_clock::now();
+	int result = scanPayload();
+	m_scanTime = std::chrono::steady_clock::now() - start;
+	return result;
+}
+
+int Message::scanPayload()
+{
+	try
 	{
-		stream.read(m_buffer, temp_size);
-		std::streamsize bytesRead = stream.gcount();
-		if (bytesRead != static_cast<std::streamsize>(temp_size))
+		JsonReader reader(m_payload);
+		std::string_view key;
+
+		if (reader.peek() == JsonReader::Type::Object && reader.beginObject())
 		{
-			free(m_buffer);
-			m_buffer = nullptr;
-			return -1;
+			while (reader.nextMember(key))
+			{
+				std::string_view value;
+				if (key == "method" && reader.peek() == JsonReader::Type::String)
+				{
+					if (reader.readString(m_method))
+						m_methodId = stringToMethod(m_method);
+				}
+				else if (key == "id")
+				{
+					m_id = readId(reader);
+				}
+				else if (key == "jsonrpc" && reader.peek() == JsonReader::Type::String && reader.readStringView(value))
+				{
+					m_jsonrpcOffset = value.data() - m_payload.data();
+					m_jsonrpcLength = value.size();
+				}
+				else if (key == "params" && reader.captureValue(value))
+				{
+					m_paramsOffset = value.data() - m_payload.data();
+					m_paramsLength = value.size();
+				}
+				else
+					reader.skipValue();
+			}
+			m_valid = reader.ok();
 		}
-	}
 
-	// Null-terminate the buffer
-	m_buffer[temp_size] = '\0';
-	m_payloadSize = temp_size;
+		if (!m_valid)
+		{
+			// Not a JSON object - still keep the payload
+			reset();
+			return m_payload.size();
+		}
 
-	// Parse JSON with exception handling
-	try
-	{
-		m_jsonData = nlohmann::json::parse(m_buffer, nullptr, false);
+		// params.textDocument.uri
+		JsonReader params(paramsSpan());
+		if (params.peek() == JsonReader::Type::Object && params.beginObject() && params.findMember("textDocument") &&
+		    params.peek() == JsonReader::Type::Object && params.beginObject() && params.findMember("uri") &&
+		    params.peek() == JsonReader::Type::String)
+		{
+			params.readString(m_uri);
+		}
 	}
 	catch (const std::bad_alloc &)
 	{
-		// Memory allocation failed during parsing - free resources
-		free(m_buffer);
-		m_buffer = nullptr;
-		m_payloadSize = 0;
+		// Memory allocation failed while copying out fields
+		m_payload = {};
+		reset();
 		return -1;
 	}
-	catch (const std::exception &)
-	{
-		// JSON parsing failed - still keep the buffer
-	}
 
-	return m_payloadSize;
+	return m_payload.size();
 }
 
-std::string Message::method_description() const
+bool Message::isValid() const
 {
-	if (m_jsonData.is_discarded() || m_jsonData.is_null() || !m_jsonData.contains("method"))
-		return "";
-	return m_jsonData["method"];
+	return m_valid;
 }
 
-Message::Method Message::method() const
+std::string_view Message::jsonrpc() const
 {
-	return stringToMethod(method_description());
+	return m_payload.substr(m_jsonrpcOffset, m_jsonrpcLength);
 }
 
-std::string Message::methodToString(Message::Method method)
+const std::string &Message::method_description() const
 {
-	static const std::unordered_map<Method, std::string> reverseMap = {
-	    {Method::INITIALIZE, "initialize"},
-	    {Method::SHUTDOWN, "shutdown"},
-	    {Method::EXIT, "exit"},
-	    {Method::TEXT_DOCUMENT_DID_OPEN, "textDocument/didOpen"},
-	    {Method::TEXT_DOCUMENT_DID_CHANGE, "textDocument/didChange"},
-	    {Method::TEXT_DOCUMENT_DID_CLOSE, "textDocument/didClose"},
-	    {Method::DECLARATION, "textDocument/declaration"},
-	    {Method::DEFINITION, "textDocument/definition"},
-	    {Method::TYPE_DEFINITION, "textDocument/typeDefinition"},
-	    {Method::IMPLEMENTATION, "textDocument/implementation"},
-	    {Method::REFERENCES, "textDocument/references"},
-	    {Method::PREPARE_CALL_HIERARCHY, "textDocument/prepareCallHierarchy"},
-	    {Method::INCOMING_CALLS, "callHierarchy/incomingCalls"},
-	    {Method::OUTGOING_CALLS, "callHierarchy/outgoingCalls"},
-	    {Method::PREPARE_TYPE_HIERARCHY, "textDocument/prepareTypeHierarchy"},
-	    {Method::TYPE_HIERARCHY_SUPERTYPES, "typeHierarchy/supertypes"},
-	    {Method::TYPE_HIERARCHY_SUBTYPES, "typeHierarchy/subtypes"},
-	    {Method::TEXT_DOCUMENT_HIGHLIGHT, "textDocument/documentHighlight"},
-	    {Method::TEXT_DOCUMENT_DOCUMENT_LINK, "textDocument/documentLink"},
-	    {Method::DOCUMENT_LINK_RESOLVE, "documentLink/resolve"},
-	    {Method::HOVER, "textDocument/hover"},
-	    {Method::TEXT_DOCUMENT_CODE_LENS, "textDocument/codeLens"},
-	    {Method::CODE_LENS_RESOLVE, "codeLens/resolve"},
-	    {Method::TEXT_DOCUMENT_FOLDING_RANGE, "textDocument/FoldingRange"},
-	    {Method::TEXT_DOCUMENT_SELECTION_RANGE, "textDocument/selectionRange"},
-	    {Method::TEXT_DOCUMENT_DOCUMENT_SYMBOL, "textDocument/documentSymbol"},
-	    {Method::TEXT_DOCUMENT_SEMANTIC_TOKENS_FULL, "textDocument/semanticTokens/full"},
-	    {Method::TEXT_DOCUMENT_SEMANTIC_TOKENS_FULL_DELTA, "textDocument/semanticTokens/full/delta"},
-	    {Method::TEXT_DOCUMENT_SEMANTIC_TOKENS_RANGE, "textDocument/semanticTokens/range"},
-	    {Method::TEXT_DOCUMENT_SEMANTIC_TOKENS_REFRESH, "textDocument/semanticTokens/refresh"},
-	    {Method::TEXT_DOCUMENT_INLAY_HINT, "textDocument/inlayHint"},
-	    {Method::INLAY_HINT_RESOLVE, "inlayHint/resolve"},
-	    {Method::TEXT_DOCUMENT_INLINE_VALUE, "textDocument/inlineValue"},
-	    {Method::TEXT_DOCUMENT_MONIKER, "textDocument/moniker"},
-	    {Method::TEXT_DOCUMENT_COMPLETION, "textDocument/completion"},
-	    {Method::COMPLETION_ITEM_RESOLVE, "completionItem/resolve"},
-	    {Method::TEXT_DOCUMENT_DIAGNOSTIC, "textDocument/diagnostic"},
-	    {Method::WORKSPACE_DIAGNOSTIC, "workspace/diagnostic"},
-	    {Method::TEXT_DOCUMENT_SIGNATURE_HELP, "textDocument/signatureHelp"},
-	    {Method::TEXT_DOCUMENT_CODE_ACTION, "textDocument/codeAction"},
-	    {Method::CODE_ACTION_RESOLVE, "codeAction/resolve"},
-	    {Method::TEXT_DOCUMENT_DOCUMENT_COLOR, "textDocument/documentColor"},
-	    {Method::TEXT_DOCUMENT_COLOR_PRESENTATION, "textDocument/colorPresentation"},
-	    {Method::TEXT_DOCUMENT_FORMATTING, "textDocument/formatting"},
-	    {Method::TEXT_DOCUMENT_RANGE_FORMATTING, "textDocument/rangeFormatting"},
-	    {Method::TEXT_DOCUMENT_ON_TYPE_FORMATTING, "textDocument/onTypeFormatting"},
-	    {Method::TEXT_DOCUMENT_RENAME, "textDocument/rename"},
-	    {Method::TEXT_DOCUMENT_PREPARE_RENAME, "textDocument/prepareRename"},
-	    {Method::TEXT_DOCUMENT_LINKED_EDITING_RANGE, "textDocument/linkedEditingRange"},
-	    {Method::WORKSPACE_CODE_LENS_REFRESH, "workspace/codeLens/refresh"},
-	    {Method::WORKSPACE_INLAY_HINT_REFRESH, "workspace/inlayHint/refresh"},
-	    {Method::WORKSPACE_INLINE_VALUE_REFRESH, "workspace/inlineValue/refresh"},
-	    {Method::TEXT_DOCUMENT_PUBLISH_DIAGNOSTICS, "textDocument/publishDiagnostics"},
-	    {Method::WORKSPACE_DIAGNOSTIC_REFRESH, "workspace/diagnostic/refresh"},
-	};
+	return m_method;
+}
+
+Message::Method Message::method() const
+{
+	return m_methodId;
+}
 
-	auto it = reverseMap.find(method);
-	if (it != reverseMap.end())
+const nlohmann::json &Message::params() const
+{
+	if (!m_params)
 	{
-		return it->second;
+		if (m_paramsLength == 0)
+			m_params = nlohmann::json::object();
+		else
+		{
+			m_params = nlohmann::json::parse(paramsSpan(), nullptr, false);
+			if (m_params->is_discarded())
+				m_params = nlohmann::json::object();
+		}
 	}
-	return ""; // Unknown method
+	return *m_params;
 }
 
-nlohmann::json Message::params() const
+std::string_view Message::paramsSpan() const
 {
-	if (m_jsonData.is_discarded() || m_jsonData.is_null() || !m_jsonData.contains("params"))
-		return nlohmann::json::object();
-	return m_jsonData["params"];
+	return m_payload.substr(m_paramsOffset, m_paramsLength);
 }
 
-std::optional<int> Message::id() const
+std::optional<RequestId> Message::id() const
 {
-	if (m_jsonData.is_discarded() || m_jsonData.is_null() || !m_jsonData.contains("id"))
+	return m_id;
+}
+
+std::optional<RequestId> Message::readId(JsonReader &reader)
+{
+	int64_t id;
+	if (reader.peek() != JsonReader::Type::Number)
+	{
+		reader.skipValue();
 		return std::nullopt;
-	return m_jsonData["id"].get<int>();
+	}
+	if (!reader.readInt(id) || id < std::numeric_limits<RequestId>::min() || id > std::numeric_limits<RequestId>::max())
+		return std::nullopt;
+	return static_cast<RequestId>(id);
 }
 
-std::string Message::documentURI() const
+const std::string &Message::documentURI() const
 {
-	if (m_jsonData.is_discarded() || m_jsonData.is_null())
-		return "";
-	auto p = params();
-	if (!p.contains("textDocument") || !p["textDocument"].contains("uri"))
-		return "";
-	return p["textDocument"]["uri"];
+	return m_uri;
 }
 
-void Message::log(const std::string_view &s)
+std::chrono::nanoseconds Message::scanTime() const
 {
-	static char *logfile = std::getenv("LSPP_LOG_FILE");
+	return m_scanTime;
+}
 
-	if (!(logfile))
-	{
-		return;
-	}
-	try
-	{
-		std::ofstream file(logfile, std::ios::app);
-		file << std::chrono::system_clock::to_time_t(std::chrono::system_clock::now()) << ">>" << s << '\n';
-		file.close();
-	}
-	catch (...)
-	{
-		// Silently fail - logging is non-critical
-	}
+bool Message::logEnabled()
+{
+	return Logger::instance().enabled(LogLevel::Info);
 }
 
-Message::Method Message::stringToMethod(const std::string &methodStr)
+void Message::log(const std::string_view &s)
 {
-	static const std::unordered_map<std::string, Method> methodMap = {
-	    // Notifications
-	    {"initialize", Message::Method::INITIALIZE},
-	    {"shutdown", Message::Method::SHUTDOWN},
-	    {"exit", Message::Method::EXIT},
-	    {"textDocument/didOpen", Message::Method::TEXT_DOCUMENT_DID_OPEN},
-	    {"textDocument/didChange", Message::Method::TEXT_DOCUMENT_DID_CHANGE},
-	    {"textDocument/didClose", Message::Method::TEXT_DOCUMENT_DID_CLOSE},
+	Logger &logger = Logger::instance();
+	if (logger.enabled(LogLevel::Info))
+		logger.write(LogLevel::Info, std::string(s));
+}
+
+// Wire names of the protocol methods, in Method order
+static constexpr auto methodNames = []
+{
+	using M = Message::Method;
+	std::array<std::string_view, Message::METHOD_COUNT> names{};
+	const std::pair<M, std::string_view> entries[] = {
+	    // Lifecycle and document sync
+	    {M::INITIALIZE, "initialize"},
+	    {M::SHUTDOWN, "shutdown"},
+	    {M::EXIT, "exit"},
+	    {M::TEXT_DOCUMENT_DID_OPEN, "textDocument/didOpen"},
+	    {M::TEXT_DOCUMENT_DID_CHANGE, "textDocument/didChange"},
+	    {M::TEXT_DOCUMENT_DID_CLOSE, "textDocument/didClose"},
 
 	    // Requests
-	    {"textDocument/declaration", Message::Method::DECLARATION},
-	    {"textDocument/definition", Message::Method::DEFINITION},
-	    {"textDocument/typeDefinition", Message::Method::TYPE_DEFINITION},
-	    {"textDocument/implementation", Message::Method::IMPLEMENTATION},
-	    {"textDocument/references", Message::Method::REFERENCES},
-	    {"textDocument/prepareCallHierarchy", Message::Method::PREPARE_CALL_HIERARCHY},
-	    {"callHierarchy/incomingCalls", Message::Method::INCOMING_CALLS},
-	    {"callHierarchy/outgoingCalls", Message::Method::OUTGOING_CALLS},
-	    {"textDocument/prepareTypeHierarchy", Message::Method::PREPARE_TYPE_HIERARCHY},
-	    {"typeHierarchy/supertypes", Message::Method::TYPE_HIERARCHY_SUPERTYPES},
-	    {"typeHierarchy/subtypes", Message::Method::TYPE_HIERARCHY_SUBTYPES},
-	    {"textDocument/documentHighlight", Message::Method::TEXT_DOCUMENT_HIGHLIGHT},
-	    {"textDocument/documentLink", Message::Method::TEXT_DOCUMENT_DOCUMENT_LINK},
-	    {"documentLink/resolve", Message::Method::DOCUMENT_LINK_RESOLVE},
-	    {"textDocument/hover", Message::Method::HOVER},
-	    {"textDocument/codeLens", Message::Method::TEXT_DOCUMENT_CODE_LENS},
-	    {"codeLens/resolve", Message::Method::CODE_LENS_RESOLVE},
-	    {"textDocument/FoldingRange", Message::Method::TEXT_DOCUMENT_FOLDING_RANGE},
-	    {"textDocument/selectionRange", Message::Method::TEXT_DOCUMENT_SELECTION_RANGE},
-	    {"textDocument/documentSymbol", Message::Method::TEXT_DOCUMENT_DOCUMENT_SYMBOL},
-	    {"textDocument/semanticTokens/full", Message::Method::TEXT_DOCUMENT_SEMANTIC_TOKENS_FULL},
-	    {"textDocument/semanticTokens/full/delta", Message::Method::TEXT_DOCUMENT_SEMANTIC_TOKENS_FULL_DELTA},
-	    {"textDocument/semanticTokens/range", Message::Method::TEXT_DOCUMENT_SEMANTIC_TOKENS_RANGE},
-	    {"textDocument/semanticTokens/refresh", Message::Method::TEXT_DOCUMENT_SEMANTIC_TOKENS_REFRESH},
-	    {"textDocument/inlayHint", Message::Method::TEXT_DOCUMENT_INLAY_HINT},
-	    {"inlayHint/resolve", Message::Method::INLAY_HINT_RESOLVE},
-	    {"textDocument/inlineValue", Message::Method::TEXT_DOCUMENT_INLINE_VALUE},
-	    {"textDocument/moniker", Message::Method::TEXT_DOCUMENT_MONIKER},
-	    {"textDocument/completion", Message::Method::TEXT_DOCUMENT_COMPLETION},
-	    {"completionItem/resolve", Message::Method::COMPLETION_ITEM_RESOLVE},
-	    {"textDocument/diagnostic", Message::Method::TEXT_DOCUMENT_DIAGNOSTIC},
-	    {"workspace/diagnostic", Message::Method::WORKSPACE_DIAGNOSTIC},
-	    {"textDocument/signatureHelp", Message::Method::TEXT_DOCUMENT_SIGNATURE_HELP},
-	    {"textDocument/codeAction", Message::Method::TEXT_DOCUMENT_CODE_ACTION},
-	    {"codeAction/resolve", Message::Method::CODE_ACTION_RESOLVE},
-	    {"textDocument/documentColor", Message::Method::TEXT_DOCUMENT_DOCUMENT_COLOR},
-	    {"textDocument/colorPresentation", Message::Method::TEXT_DOCUMENT_COLOR_PRESENTATION},
-	    {"textDocument/formatting", Message::Method::TEXT_DOCUMENT_FORMATTING},
-	    {"textDocument/rangeFormatting", Message::Method::TEXT_DOCUMENT_RANGE_FORMATTING},
-	    {"textDocument/onTypeFormatting", Message::Method::TEXT_DOCUMENT_ON_TYPE_FORMATTING},
-	    {"textDocument/rename", Message::Method::TEXT_DOCUMENT_RENAME},
-	    {"textDocument/prepareRename", Message::Method::TEXT_DOCUMENT_PREPARE_RENAME},
-	    {"textDocument/linkedEditingRange", Message::Method::TEXT_DOCUMENT_LINKED_EDITING_RANGE},
+	    {M::DECLARATION, "textDocument/declaration"},
+	    {M::DEFINITION, "textDocument/definition"},
+	    {M::TYPE_DEFINITION, "textDocument/typeDefinition"},
+	    {M::IMPLEMENTATION, "textDocument/implementation"},
+	    {M::REFERENCES, "textDocument/references"},
+	    {M::PREPARE_CALL_HIERARCHY, "textDocument/prepareCallHierarchy"},
+	    {M::INCOMING_CALLS, "callHierarchy/incomingCalls"},
+	    {M::OUTGOING_CALLS, "callHierarchy/outgoingCalls"},
+	    {M::PREPARE_TYPE_HIERARCHY, "textDocument/prepareTypeHierarchy"},
+	    {M::TYPE_HIERARCHY_SUPERTYPES, "typeHierarchy/supertypes"},
+	    {M::TYPE_HIERARCHY_SUBTYPES, "typeHierarchy/subtypes"},
+	    {M::TEXT_DOCUMENT_HIGHLIGHT, "textDocument/documentHighlight"},
+	    {M::TEXT_DOCUMENT_DOCUMENT_LINK, "textDocument/documentLink"},
+	    {M::DOCUMENT_LINK_RESOLVE, "documentLink/resolve"},
+	    {M::HOVER, "textDocument/hover"},
+	    {M::TEXT_DOCUMENT_CODE_LENS, "textDocument/codeLens"},
+	    {M::CODE_LENS_RESOLVE, "codeLens/resolve"},
+	    {M::TEXT_DOCUMENT_FOLDING_RANGE, "textDocument/FoldingRange"},
+	    {M::TEXT_DOCUMENT_SELECTION_RANGE, "textDocument/selectionRange"},
+	    {M::TEXT_DOCUMENT_DOCUMENT_SYMBOL, "textDocument/documentSymbol"},
+	    {M::TEXT_DOCUMENT_SEMANTIC_TOKENS_FULL, "textDocument/semanticTokens/full"},
+	    {M::TEXT_DOCUMENT_SEMANTIC_TOKENS_FULL_DELTA, "textDocument/semanticTokens/full/delta"},
+	    {M::TEXT_DOCUMENT_SEMANTIC_TOKENS_RANGE, "textDocument/semanticTokens/range"},
+	    {M::TEXT_DOCUMENT_SEMANTIC_TOKENS_REFRESH, "textDocument/semanticTokens/refresh"},
+	    {M::TEXT_DOCUMENT_INLAY_HINT, "textDocument/inlayHint"},
+	    {M::INLAY_HINT_RESOLVE, "inlayHint/resolve"},
+	    {M::TEXT_DOCUMENT_INLINE_VALUE, "textDocument/inlineValue"},
+	    {M::TEXT_DOCUMENT_MONIKER, "textDocument/moniker"},
+	    {M::TEXT_DOCUMENT_COMPLETION, "textDocument/completion"},
+	    {M::COMPLETION_ITEM_RESOLVE, "completionItem/resolve"},
+	    {M::TEXT_DOCUMENT_DIAGNOSTIC, "textDocument/diagnostic"},
+	    {M::WORKSPACE_DIAGNOSTIC, "workspace/diagnostic"},
+	    {M::TEXT_DOCUMENT_SIGNATURE_HELP, "textDocument/signatureHelp"},
+	    {M::TEXT_DOCUMENT_CODE_ACTION, "textDocument/codeAction"},
+	    {M::CODE_ACTION_RESOLVE, "codeAction/resolve"},
+	    {M::TEXT_DOCUMENT_DOCUMENT_COLOR, "textDocument/documentColor"},
+	    {M::TEXT_DOCUMENT_COLOR_PRESENTATION, "textDocument/colorPresentation"},
+	    {M::TEXT_DOCUMENT_FORMATTING, "textDocument/formatting"},
+	    {M::TEXT_DOCUMENT_RANGE_FORMATTING, "textDocument/rangeFormatting"},
+	    {M::TEXT_DOCUMENT_ON_TYPE_FORMATTING, "textDocument/onTypeFormatting"},
+	    {M::TEXT_DOCUMENT_RENAME, "textDocument/rename"},
+	    {M::TEXT_DOCUMENT_PREPARE_RENAME, "textDocument/prepareRename"},
+	    {M::TEXT_DOCUMENT_LINKED_EDITING_RANGE, "textDocument/linkedEditingRange"},
+	    {M::WORKSPACE_SYMBOL, "workspace/symbol"},
 
 	    // Server-side requests
-	    {"workspace/codeLens/refresh", Message::Method::WORKSPACE_CODE_LENS_REFRESH},
-	    {"workspace/inlayHint/refresh", Message::Method::WORKSPACE_INLAY_HINT_REFRESH},
-	    {"workspace/inlineValue/refresh", Message::Method::WORKSPACE_INLINE_VALUE_REFRESH},
+	    {M::WORKSPACE_CODE_LENS_REFRESH, "workspace/codeLens/refresh"},
+	    {M::WORKSPACE_INLAY_HINT_REFRESH, "workspace/inlayHint/refresh"},
+	    {M::WORKSPACE_INLINE_VALUE_REFRESH, "workspace/inlineValue/refresh"},
 
 	    // Server-side notifications
-	    {"textDocument/publishDiagnostics", Message::Method::TEXT_DOCUMENT_PUBLISH_DIAGNOSTICS},
-	    {"workspace/diagnostic/refresh", Message::Method::WORKSPACE_DIAGNOSTIC_REFRESH},
+	    {M::TEXT_DOCUMENT_PUBLISH_DIAGNOSTICS, "textDocument/publishDiagnostics"},
+	    {M::WORKSPACE_DIAGNOSTIC_REFRESH, "workspace/diagnostic/refresh"},
+
+	    // Protocol notifications
+	    {M::CANCEL_REQUEST, "$/cancelRequest"},
 	};
+	for (const auto &[method, name] : entries)
+		names[method] = name;
+	return names;
+}();
+
+static constexpr bool allMethodsNamed()
+{
+	for (size_t i = Message::Method::NONE + 1; i < Message::METHOD_COUNT; i++)
+	{
+		if (methodNames[i].empty())
+			return false;
+	}
+	return true;
+}
+static_assert(allMethodsNamed(), "every Message::Method needs an entry in methodNames");
+
+// Perfect hash over methodNames: FNV-1a with a seed picked at compile time so
+// that no two names share a slot. A lookup is one hash and one string compare.
+// With ~16 slots per name a collision-free seed turns up within a few tries.
+static constexpr size_t METHOD_HASH_SLOTS = 1024;
+static_assert(METHOD_HASH_SLOTS >= 16 * Message::METHOD_COUNT, "grow METHOD_HASH_SLOTS");
+static_assert(Message::METHOD_COUNT <= 256, "methodSlots stores Method in a byte");
+
+static constexpr uint32_t methodHash(std::string_view name, uint32_t seed)
+{
+	uint32_t hash = 2166136261u ^ seed;
+	for (char c : name)
+	{
+		hash ^= static_cast<unsigned char>(c);
+		hash *= 16777619u;
+	}
+	return hash ^ (hash >> 15);
+}
 
-	if (methodMap.count(methodStr))
+static constexpr uint32_t methodHashSeed = []
+{
+	for (uint32_t seed = 0;; seed++)
 	{
-		return methodMap.at(methodStr);
+		std::array<bool, METHOD_HASH_SLOTS> used{};
+		bool collision = false;
+		for (size_t i = Message::Method::NONE + 1; i < Message::METHOD_COUNT && !collision; i++)
+		{
+			size_t slot = methodHash(methodNames[i], seed) % METHOD_HASH_SLOTS;
+			collision = used[slot];
+			used[slot] = true;
+		}
+		if (!collision)
+			return seed;
 	}
-	return Message::Method::NONE; // Default case
+}();
+
+// Slot -> Method, NONE for empty slots
+static constexpr auto methodSlots = []
+{
+	std::array<uint8_t, METHOD_HASH_SLOTS> slots{};
+	for (size_t i = Message::Method::NONE + 1; i < Message::METHOD_COUNT; i++)
+		slots[methodHash(methodNames[i], methodHashSeed) % METHOD_HASH_SLOTS] = static_cast<uint8_t>(i);
+	return slots;
+}();
+
+std::string_view Message::methodName(Message::Method method)
+{
+	if (method >= METHOD_COUNT)
+		return {};
+	return methodNames[method]; // Empty for NONE
+}
+
+std::string Message::methodToString(Message::Method method)
+{
+	return std::string(methodName(method));
+}
+
+Message::Method Message::stringToMethod(std::string_view methodStr)
+{
+	Method method = static_cast<Method>(methodSlots[methodHash(methodStr, methodHashSeed) % METHOD_HASH_SLOTS]);
+	return methodNames[method] == methodStr && !methodStr.empty() ? method : Method::NONE;
 }
@@ -0,0 +1,183 @@
+#include "Metrics.hpp"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+LatencyHistogram::LatencyHistogram() : m_count(0), m_sum(0), m_max(0)
+{
+      for (auto &bucket : m_buckets)
+            bucket.store(0, std::memory_order_relaxed);
+}
+
+// Values below SUB_BUCKETS get a bucket each, larger ones are placed by their highest
+// bit and the SUB_BUCKET_BITS bits after it
+size_t LatencyHistogram::bucketFor(uint64_t nanoseconds)
+{
+      if (nanoseconds < SUB_BUCKETS)
+            return nanoseconds;
+      const size_t highest = 63 - std::countl_zero(nanoseconds);
+      if (highest >= MAX_BITS)
+            return BUCKET_COUNT - 1;
+      const size_t shift = highest - SUB_BUCKET_BITS;
+      return (shift + 1) * SUB_BUCKETS + ((nanoseconds >> shift) - SUB_BUCKETS);
+}
+
+uint64_t LatencyHistogram::bucketLimit(size_t bucket)
+{
+      if (bucket < SUB_BUCKETS)
+            return bucket;
+      const size_t shift = bucket / SUB_BUCKETS - 1;
+      const uint64_t low = static_cast<uint64_t>(SUB_BUCKETS + bucket % SUB_BUCKETS) << shift;
+      return low + (uint64_t(1) << shift) - 1;
+}
+
+void LatencyHistogram::record(uint64_t nanoseconds)
+{
+      m_buckets[bucketFor(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+      m_count.fetch_add(1, std::memory_order_relaxed);
+      m_sum.fetch_add(nanoseconds, std::memory_order_relaxed);
+      uint64_t max = m_max.load(std::memory_order_relaxed);
+      while (nanoseconds > max && !m_max.compare_exchange_weak(max, nanoseconds, std::memory_order_relaxed))
+            ;
+}
+
+LatencyHistogram::Summary LatencyHistogram::summary() const
+{
+      // Concurrent records may land between the loads, the bucket counts are what is reported
+      std::array<uint64_t, BUCKET_COUNT> counts;
+      uint64_t total = 0;
+      for (size_t i = 0; i < BUCKET_COUNT; i++)
+            total += counts[i] = m_buckets[i].load(std::memory_order_relaxed);
+
+      Summary s;
+      if (total == 0)
+            return s;
+      s.count = total;
+      s.max = m_max.load(std::memory_order_relaxed);
+      s.mean = m_sum.load(std::memory_order_relaxed) / std::max<uint64_t>(1, m_count.load(std::memory_order_relaxed));
+
+      const std::pair<double, uint64_t Summary::*> percentiles[] = {{0.5, &Summary::p50}, {0.9, &Summary::p90}, {0.99, &Summary::p99}, {0.999, &Summary::p999}};
+      uint64_t seen = 0;
+      size_t next = 0, bucket = 0;
+      for (; bucket < BUCKET_COUNT && next < std::size(percentiles); bucket++)
+      {
+            seen += counts[bucket];
+            while (next < std::size(percentiles) && seen >= std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(percentiles[next].first * total))))
+                  s.*percentiles[next++].second = std::min(bucketLimit(bucket), s.max);
+      }
+      return s;
+}
+
+void to_json(nlohmann::json &j, const LatencyHistogram::Summary &s)
+{
+      j = {{"count", s.count}, {"mean", s.mean}, {"p50", s.p50}, {"p90", s.p90}, {"p99", s.p99}, {"p999", s.p999}, {"max", s.max}};
+}
+
+void to_json(nlohmann::json &j, const MetricsSnapshot &s)
+{
+      nlohmann::json methods = nlohmann::json::object();
+      for (const auto &m : s.methods)
+            methods[m.method] = m.latency;
+      j = {{"unit", "ns"},
+           {"methods", methods},
+           {"queue", {{"depth", s.queueDepth}, {"maxDepth", s.maxQueueDepth}, {"wait", s.queueWait}}},
+           {"parse", s.parse},
+           {"serialize", s.serialize},
+           {"messagesIn", s.messagesIn},
+           {"messagesOut", s.messagesOut},
+           {"bytesIn", s.bytesIn},
+           {"bytesOut", s.bytesOut},
+           {"documents", {{"open", s.openDocuments}, {"bytes", s.documentBytes}}}};
+}
+
+ServerMetrics::ServerMetrics() : m_queueDepth(0), m_maxQueueDepth(0), m_messagesIn(0), m_messagesOut(0), m_bytesIn(0), m_bytesOut(0)
+{
+      for (auto &method : m_methods)
+            method.store(nullptr, std::memory_order_relaxed);
+}
+
+ServerMetrics::~ServerMetrics()
+{
+      for (auto &method : m_methods)
+            delete method.load();
+}
+
+void ServerMetrics::messageReceived(size_t bytes, std::chrono::nanoseconds parse)
+{
+      m_messagesIn.fetch_add(1, std::memory_order_relaxed);
+      m_bytesIn.fetch_add(bytes, std::memory_order_relaxed);
+      m_parse.record(parse);
+}
+
+void ServerMetrics::messageSent(size_t bytes, std::chrono::nanoseconds serialize)
+{
+      m_messagesOut.fetch_add(1, std::memory_order_relaxed);
+      m_bytesOut.fetch_add(bytes, std::memory_order_relaxed);
+      m_serialize.record(serialize);
+}
+
+void ServerMetrics::messageHandled(Message::Method method, std::chrono::nanoseconds latency)
+{
+      auto &slot = m_methods[method < Message::METHOD_COUNT ? method : Message::Method::NONE];
+      LatencyHistogram *histogram = slot.load(std::memory_order_acquire);
+      if (!histogram)
+      {
+            // Whoever loses the race frees its copy and uses the winner's
+            auto *fresh = new LatencyHistogram();
+            if (slot.compare_exchange_strong(histogram, fresh, std::memory_order_acq_rel))
+                  histogram = fresh;
+            else
+                  delete fresh;
+      }
+      histogram->record(latency);
+}
+
+void ServerMetrics::requestQueued()
+{
+      size_t depth = m_queueDepth.fetch_add(1, std::memory_order_relaxed) + 1;
+      size_t max = m_maxQueueDepth.load(std::memory_order_relaxed);
+      while (depth > max && !m_maxQueueDepth.compare_exchange_weak(max, depth, std::memory_order_relaxed))
+            ;
+}
+
+void ServerMetrics::requestDequeued(std::chrono::nanoseconds wait)
+{
+      m_queueDepth.fetch_sub(1, std::memory_order_relaxed);
+      m_queueWait.record(wait);
+}
+
+const LatencyHistogram *ServerMetrics::latency(Message::Method method) const
+{
+      return method < Message::METHOD_COUNT ? m_methods[method].load(std::memory_order_acquire) : nullptr;
+}
+
+MetricsSnapshot ServerMetrics::snapshot() const
+{
+      MetricsSnapshot s;
+      for (size_t i = 0; i < Message::METHOD_COUNT; i++)
+      {
+            if (const LatencyHistogram *histogram = m_methods[i].load(std::memory_order_acquire))
+            {
+                  std::string name = i == Message::Method::NONE ? "custom" : Message::methodToString(static_cast<Message::Method>(i));
+                  s.methods.push_back({std::move(name), histogram->summary()});
+            }
+      }
+      s.queueWait = m_queueWait.summary();
+      s.parse = m_parse.summary();
+      s.serialize = m_serialize.summary();
+      s.queueDepth = m_queueDepth.load(std::memory_order_relaxed);
+      s.maxQueueDepth = m_maxQueueDepth.load(std::memory_order_relaxed);
+      s.messagesIn = m_messagesIn.load(std::memory_order_relaxed);
+      s.messagesOut = m_messagesOut.load(std::memory_order_relaxed);
+      s.bytesIn = m_bytesIn.load(std::memory_order_relaxed);
+      s.bytesOut = m_bytesOut.load(std::memory_order_relaxed);
+      return s;
+}
+
+uint64_t percentile(const std::vector<uint64_t> &sorted, double p)
+{
+      if (sorted.empty())
+            return 0;
+      size_t rank = static_cast<size_t>(std::ceil(p * sorted.size()));
+      return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+}
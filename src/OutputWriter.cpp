@@ -0,0 +1,160 @@
+#include "OutputWriter.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <iostream>
+#include <sys/uio.h>
+#include <unistd.h>
+
+OutputWriter::OutputWriter(std::ostream &out) : m_out(nullptr), m_fd(-1), m_pendingBytes(0), m_stopping(false)
+{
+      setStream(out);
+}
+
+OutputWriter::~OutputWriter()
+{
+      {
+            std::lock_guard<std::mutex> lock(m_queueMutex);
+            m_stopping = true;
+      }
+      m_cv.notify_all();
+      if (m_flusher.joinable())
+            m_flusher.join();
+      flush();
+}
+
+void OutputWriter::setStream(std::ostream &out)
+{
+      flush();
+      std::lock_guard<std::mutex> lock(m_writeMutex);
+      m_out = &out;
+      m_fd = (&out == &std::cout) ? STDOUT_FILENO : -1;
+}
+
+void OutputWriter::write(std::string header, std::string body, const FlushPolicy &policy)
+{
+      bool writeNow;
+      {
+            std::lock_guard<std::mutex> lock(m_queueMutex);
+            if (m_pending.empty())
+                  m_deadline = std::chrono::steady_clock::now() + policy.maxDelay;
+            else
+                  m_deadline = std::min(m_deadline, std::chrono::steady_clock::now() + policy.maxDelay);
+
+            m_pendingBytes += header.size() + body.size();
+            m_pending.push_back(std::move(header));
+            m_pending.push_back(std::move(body));
+
+            writeNow = policy.maxDelay.count() == 0 || m_pendingBytes >= policy.maxBytes;
+            if (!writeNow && !m_flusher.joinable())
+                  m_flusher = std::thread(&OutputWriter::run, this);
+      }
+
+      if (writeNow)
+            flush();
+      else
+            m_cv.notify_one();
+}
+
+void OutputWriter::flush()
+{
+      std::lock_guard<std::mutex> writeLock(m_writeMutex);
+      std::vector<std::string> batch;
+      {
+            std::lock_guard<std::mutex> lock(m_queueMutex);
+            batch.swap(m_pending);
+            m_pendingBytes = 0;
+      }
+      if (!batch.empty())
+            writeBatch(batch);
+}
+
+std::unique_lock<std::mutex> OutputWriter::lockStream() const
+{
+      return std::unique_lock<std::mutex>(m_writeMutex);
+}
+
+const std::ostream *OutputWriter::stream() const
+{
+      return m_out;
+}
+
+// Called with m_writeMutex held
+void OutputWriter::writeBatch(std::vector<std::string> &batch)
+{
+      if (m_fd >= 0)
+      {
+            writeToFd(batch);
+            return;
+      }
+
+      try
+      {
+            for (const std::string &buffer : batch)
+                  m_out->write(buffer.data(), buffer.size());
+            m_out->flush();
+      }
+      catch (...)
+      {
+            // Nothing sensible left to do with a broken output stream
+      }
+}
+
+void OutputWriter::writeToFd(const std::vector<std::string> &batch)
+{
+      // Anything written through std::cout directly must go out first
+      std::cout.flush();
+
+      std::vector<iovec> iov;
+      iov.reserve(batch.size());
+      for (const std::string &buffer : batch)
+      {
+            if (!buffer.empty())
+                  iov.push_back({const_cast<char *>(buffer.data()), buffer.size()});
+      }
+
+      size_t first = 0;
+      while (first < iov.size())
+      {
+            int count = static_cast<int>(std::min<size_t>(iov.size() - first, IOV_MAX));
+            ssize_t written = ::writev(m_fd, iov.data() + first, count);
+            if (written < 0)
+            {
+                  if (errno == EINTR)
+                        continue;
+                  return; // The client went away
+            }
+
+            // Skip the fully written buffers and trim a partially written one
+            size_t remaining = static_cast<size_t>(written);
+            while (first < iov.size() && remaining >= iov[first].iov_len)
+                  remaining -= iov[first++].iov_len;
+            if (first < iov.size())
+            {
+                  iov[first].iov_base = static_cast<char *>(iov[first].iov_base) + remaining;
+                  iov[first].iov_len -= remaining;
+            }
+      }
+}
+
+void OutputWriter::run()
+{
+      std::unique_lock<std::mutex> lock(m_queueMutex);
+      while (!m_stopping)
+      {
+            if (m_pending.empty())
+            {
+                  m_cv.wait(lock);
+                  continue;
+            }
+            if (std::chrono::steady_clock::now() < m_deadline)
+            {
+                  m_cv.wait_until(lock, m_deadline);
+                  continue;
+            }
+
+            lock.unlock();
+            flush();
+            lock.lock();
+      }
+}
@@ -0,0 +1,374 @@
+#include "PieceTable.hpp"
+#include "PositionEncoding.hpp"
+#include <algorithm>
+#include <unordered_set>
+
+struct PieceTable::Node
+{
+      Piece piece;
+      uint32_t priority;
+      NodePtr left;
+      NodePtr right;
+
+      // Subtree totals
+      size_t length;
+      size_t newlines;
+      size_t count;
+      size_t nonAsciiPieces;
+
+      static size_t lengthOf(const NodePtr &n) { return n ? n->length : 0; }
+      static size_t newlinesOf(const NodePtr &n) { return n ? n->newlines : 0; }
+      static size_t countOf(const NodePtr &n) { return n ? n->count : 0; }
+      static size_t nonAsciiPiecesOf(const NodePtr &n) { return n ? n->nonAsciiPieces : 0; }
+};
+
+// Once a document is made of many tiny pieces (typically after a long typing
+// session) it is flattened back into a single buffer.
+static constexpr size_t MIN_PIECES_BEFORE_COMPACT = 1024;
+static constexpr size_t MIN_AVERAGE_PIECE_LENGTH = 64;
+
+PieceTable::PieceTable() : m_root(nullptr), m_seed(0x9e3779b9) {}
+
+PieceTable::PieceTable(std::string_view content) : PieceTable()
+{
+      insert(0, content);
+}
+
+size_t PieceTable::length() const
+{
+      return Node::lengthOf(m_root);
+}
+
+size_t PieceTable::lineCount() const
+{
+      return Node::newlinesOf(m_root) + 1;
+}
+
+uint32_t PieceTable::nextPriority()
+{
+      // xorshift32
+      m_seed ^= m_seed << 13;
+      m_seed ^= m_seed >> 17;
+      m_seed ^= m_seed << 5;
+      return m_seed;
+}
+
+std::shared_ptr<const PieceTable::Buffer> PieceTable::makeBuffer(std::string_view text)
+{
+      auto buffer = std::make_shared<Buffer>();
+      buffer->text = text;
+      for (size_t i = text.find('\n'); i != std::string_view::npos; i = text.find('\n', i + 1))
+            buffer->newlines.push_back(i);
+      for (size_t i = findNonAscii(text); i < text.size(); i = findNonAscii(text, i))
+      {
+            buffer->nonAscii.push_back(i);
+            while (i < text.size() && static_cast<unsigned char>(text[i]) >= 0x80)
+                  i++;
+            buffer->nonAscii.push_back(i);
+      }
+      return buffer;
+}
+
+PieceTable::Piece PieceTable::makePiece(const std::shared_ptr<const Buffer> &buffer, size_t start, size_t length)
+{
+      const auto &nl = buffer->newlines;
+      auto first = std::lower_bound(nl.begin(), nl.end(), start);
+      auto last = std::lower_bound(first, nl.end(), start + length);
+      return {buffer, start, length, static_cast<size_t>(last - first), rangeIsAscii(*buffer, start, start + length)};
+}
+
+bool PieceTable::rangeIsAscii(const Buffer &buffer, size_t from, size_t to)
+{
+      // First run ending after `from`; the range is ASCII unless that run starts before `to`
+      const auto &runs = buffer.nonAscii;
+      size_t lo = 0, hi = runs.size() / 2;
+      while (lo < hi)
+      {
+            size_t mid = (lo + hi) / 2;
+            if (runs[2 * mid + 1] <= from)
+                  lo = mid + 1;
+            else
+                  hi = mid;
+      }
+      return lo == runs.size() / 2 || runs[2 * lo] >= to;
+}
+
+PieceTable::NodePtr PieceTable::makeNode(const Piece &piece, uint32_t priority, NodePtr left, NodePtr right)
+{
+      auto node = std::make_shared<Node>();
+      node->length = Node::lengthOf(left) + piece.length + Node::lengthOf(right);
+      node->newlines = Node::newlinesOf(left) + piece.newlines + Node::newlinesOf(right);
+      node->count = Node::countOf(left) + 1 + Node::countOf(right);
+      node->nonAsciiPieces = Node::nonAsciiPiecesOf(left) + (piece.ascii ? 0 : 1) + Node::nonAsciiPiecesOf(right);
+      node->piece = piece;
+      node->priority = priority;
+      node->left = std::move(left);
+      node->right = std::move(right);
+      return node;
+}
+
+// Splits `node` so that the first tree holds exactly `offset` bytes
+std::pair<PieceTable::NodePtr, PieceTable::NodePtr> PieceTable::split(const NodePtr &node, size_t offset)
+{
+      if (!node)
+            return {nullptr, nullptr};
+
+      const size_t leftLength = Node::lengthOf(node->left);
+      const Piece &piece = node->piece;
+
+      if (offset <= leftLength)
+      {
+            auto [a, b] = split(node->left, offset);
+            return {a, makeNode(piece, node->priority, b, node->right)};
+      }
+      if (offset >= leftLength + piece.length)
+      {
+            auto [a, b] = split(node->right, offset - leftLength - piece.length);
+            return {makeNode(piece, node->priority, node->left, a), b};
+      }
+
+      // The split point falls inside this node's piece
+      const size_t cut = offset - leftLength;
+      Piece head = makePiece(piece.buffer, piece.start, cut);
+      Piece tail = makePiece(piece.buffer, piece.start + cut, piece.length - cut);
+      return {makeNode(head, node->priority, node->left, nullptr), makeNode(tail, node->priority, nullptr, node->right)};
+}
+
+PieceTable::NodePtr PieceTable::merge(const NodePtr &left, const NodePtr &right)
+{
+      if (!left)
+            return right;
+      if (!right)
+            return left;
+
+      if (left->priority > right->priority)
+            return makeNode(left->piece, left->priority, left->left, merge(left->right, right));
+      return makeNode(right->piece, right->priority, merge(left, right->left), right->right);
+}
+
+void PieceTable::insert(size_t offset, std::string_view text)
+{
+      replace(offset, 0, text);
+}
+
+void PieceTable::erase(size_t offset, size_t length)
+{
+      replace(offset, length, {});
+}
+
+void PieceTable::replace(size_t offset, size_t length, std::string_view text)
+{
+      offset = std::min(offset, this->length());
+      length = std::min(length, this->length() - offset);
+      if (length == 0 && text.empty())
+            return;
+
+      auto [head, rest] = split(m_root, offset);
+      auto tail = split(rest, length).second;
+
+      if (!text.empty())
+      {
+            auto buffer = makeBuffer(text);
+            head = merge(head, makeNode(makePiece(buffer, 0, text.size()), nextPriority(), nullptr, nullptr));
+      }
+      m_root = merge(head, tail);
+
+      compactIfFragmented();
+}
+
+void PieceTable::compactIfFragmented()
+{
+      const size_t pieces = Node::countOf(m_root);
+      if (pieces < MIN_PIECES_BEFORE_COMPACT || pieces * MIN_AVERAGE_PIECE_LENGTH < length())
+            return;
+
+      auto buffer = makeBuffer(toString());
+      m_root = makeNode(makePiece(buffer, 0, buffer->text.size()), nextPriority(), nullptr, nullptr);
+}
+
+void PieceTable::appendRange(const NodePtr &node, size_t from, size_t to, std::string &out)
+{
+      if (!node || from >= to)
+            return;
+
+      const size_t leftLength = Node::lengthOf(node->left);
+      const Piece &piece = node->piece;
+      const size_t pieceEnd = leftLength + piece.length;
+
+      if (from < leftLength)
+            appendRange(node->left, from, std::min(to, leftLength), out);
+
+      const size_t a = std::max(from, leftLength), b = std::min(to, pieceEnd);
+      if (a < b)
+            out.append(piece.buffer->text, piece.start + a - leftLength, b - a);
+
+      if (to > pieceEnd)
+            appendRange(node->right, std::max(from, pieceEnd) - pieceEnd, to - pieceEnd, out);
+}
+
+std::string PieceTable::slice(size_t offset, size_t length) const
+{
+      offset = std::min(offset, this->length());
+      length = std::min(length, this->length() - offset);
+
+      std::string out;
+      out.reserve(length);
+      appendRange(m_root, offset, offset + length, out);
+      return out;
+}
+
+std::optional<std::string_view> PieceTable::view(size_t offset, size_t length) const
+{
+      offset = std::min(offset, this->length());
+      length = std::min(length, this->length() - offset);
+      if (length == 0)
+            return std::string_view();
+
+      const Node *node = m_root.get();
+      while (node)
+      {
+            const size_t leftLength = Node::lengthOf(node->left);
+            if (offset < leftLength)
+            {
+                  node = node->left.get();
+                  continue;
+            }
+            offset -= leftLength;
+
+            const Piece &piece = node->piece;
+            if (offset < piece.length)
+            {
+                  if (offset + length > piece.length)
+                        return std::nullopt;
+                  return std::string_view(piece.buffer->text).substr(piece.start + offset, length);
+            }
+            offset -= piece.length;
+            node = node->right.get();
+      }
+      return std::nullopt;
+}
+
+std::string PieceTable::toString() const
+{
+      return slice(0, length());
+}
+
+size_t PieceTable::memoryUsage() const
+{
+      std::unordered_set<const Buffer *> buffers;
+      std::vector<const Node *> pending;
+      size_t bytes = 0;
+      if (m_root)
+            pending.push_back(m_root.get());
+      while (!pending.empty())
+      {
+            const Node *node = pending.back();
+            pending.pop_back();
+            // The node shares its allocation with the shared_ptr control block
+            bytes += sizeof(Node) + 2 * sizeof(void *);
+            const Buffer *buffer = node->piece.buffer.get();
+            if (buffers.insert(buffer).second)
+                  bytes += sizeof(Buffer) + buffer->text.capacity() + (buffer->newlines.capacity() + buffer->nonAscii.capacity()) * sizeof(size_t);
+            if (node->left)
+                  pending.push_back(node->left.get());
+            if (node->right)
+                  pending.push_back(node->right.get());
+      }
+      return bytes;
+}
+
+size_t PieceTable::lineStart(size_t line) const
+{
+      if (line == 0)
+            return 0;
+      if (line >= lineCount())
+            return length();
+
+      // Find the line-th newline, the line starts right after it
+      size_t k = line, offset = 0;
+      const Node *node = m_root.get();
+      while (node)
+      {
+            const size_t leftNewlines = Node::newlinesOf(node->left);
+            if (k <= leftNewlines)
+            {
+                  node = node->left.get();
+                  continue;
+            }
+            k -= leftNewlines;
+            offset += Node::lengthOf(node->left);
+
+            const Piece &piece = node->piece;
+            if (k <= piece.newlines)
+            {
+                  const auto &nl = piece.buffer->newlines;
+                  auto first = std::lower_bound(nl.begin(), nl.end(), piece.start);
+                  return offset + (*(first + (k - 1)) - piece.start) + 1;
+            }
+            k -= piece.newlines;
+            offset += piece.length;
+            node = node->right.get();
+      }
+      return length();
+}
+
+size_t PieceTable::lineAt(size_t offset) const
+{
+      offset = std::min(offset, length());
+
+      // Count the newlines before offset
+      size_t line = 0;
+      const Node *node = m_root.get();
+      while (node)
+      {
+            const size_t leftLength = Node::lengthOf(node->left);
+            if (offset <= leftLength)
+            {
+                  node = node->left.get();
+                  continue;
+            }
+            line += Node::newlinesOf(node->left);
+            offset -= leftLength;
+
+            const Piece &piece = node->piece;
+            if (offset <= piece.length)
+            {
+                  const auto &nl = piece.buffer->newlines;
+                  auto first = std::lower_bound(nl.begin(), nl.end(), piece.start);
+                  auto last = std::lower_bound(first, nl.end(), piece.start + offset);
+                  return line + (last - first);
+            }
+            line += piece.newlines;
+            offset -= piece.length;
+            node = node->right.get();
+      }
+      return line;
+}
+
+bool PieceTable::isAscii(size_t offset, size_t length) const
+{
+      offset = std::min(offset, this->length());
+      length = std::min(length, this->length() - offset);
+      return isAscii(m_root, offset, offset + length);
+}
+
+bool PieceTable::isAscii(const NodePtr &node, size_t from, size_t to)
+{
+      if (!node || from >= to || node->nonAsciiPieces == 0)
+            return true;
+
+      const size_t leftLength = Node::lengthOf(node->left);
+      const Piece &piece = node->piece;
+      const size_t pieceEnd = leftLength + piece.length;
+
+      if (from < leftLength && !isAscii(node->left, from, std::min(to, leftLength)))
+            return false;
+
+      const size_t a = std::max(from, leftLength), b = std::min(to, pieceEnd);
+      if (a < b && !piece.ascii && !rangeIsAscii(*piece.buffer, piece.start + a - leftLength, piece.start + b - leftLength))
+            return false;
+
+      if (to > pieceEnd)
+            return isAscii(node->right, std::max(from, pieceEnd) - pieceEnd, to - pieceEnd);
+      return true;
+}
@@ -0,0 +1,106 @@
+#include "PositionEncoding.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+std::string_view positionEncodingName(PositionEncoding encoding)
+{
+      switch (encoding)
+      {
+      case PositionEncoding::UTF8:
+            return "utf-8";
+      case PositionEncoding::UTF32:
+            return "utf-32";
+      default:
+            return "utf-16";
+      }
+}
+
+std::optional<PositionEncoding> parsePositionEncoding(std::string_view name)
+{
+      if (name == "utf-8")
+            return PositionEncoding::UTF8;
+      if (name == "utf-16")
+            return PositionEncoding::UTF16;
+      if (name == "utf-32")
+            return PositionEncoding::UTF32;
+      return std::nullopt;
+}
+
+size_t findNonAscii(std::string_view text, size_t from)
+{
+      constexpr uint64_t HIGH_BITS = 0x8080808080808080ull;
+
+      size_t i = from;
+      for (; i + sizeof(uint64_t) <= text.size(); i += sizeof(uint64_t))
+      {
+            uint64_t word;
+            std::memcpy(&word, text.data() + i, sizeof(word));
+            if (word & HIGH_BITS)
+                  break;
+      }
+      for (; i < text.size(); i++)
+      {
+            if (static_cast<unsigned char>(text[i]) >= 0x80)
+                  return i;
+      }
+      return text.size();
+}
+
+// Length in bytes of the UTF-8 sequence starting with `lead`. Stray continuation
+// bytes and invalid leads count as one byte, so malformed text still makes progress.
+static size_t sequenceLength(unsigned char lead)
+{
+      if (lead < 0xC0)
+            return 1;
+      if (lead < 0xE0)
+            return 2;
+      if (lead < 0xF0)
+            return 3;
+      if (lead < 0xF8)
+            return 4;
+      return 1;
+}
+
+// Code units taken by a character whose UTF-8 form is `length` bytes long
+static size_t unitsFor(size_t length, PositionEncoding encoding)
+{
+      return encoding == PositionEncoding::UTF16 && length == 4 ? 2 : 1;
+}
+
+size_t byteOffsetFromUnits(std::string_view line, size_t units, PositionEncoding encoding)
+{
+      if (encoding == PositionEncoding::UTF8)
+            return std::min(units, line.size());
+
+      // Up to the first non-ASCII byte, every byte is one code unit in both encodings
+      size_t byte = findNonAscii(line.substr(0, std::min(units, line.size())));
+      units -= byte;
+      while (units > 0 && byte < line.size())
+      {
+            const size_t length = sequenceLength(static_cast<unsigned char>(line[byte]));
+            const size_t taken = unitsFor(length, encoding);
+            if (taken > units)
+                  break;
+            units -= taken;
+            byte = std::min(byte + length, line.size());
+      }
+      return byte;
+}
+
+size_t unitsFromByteOffset(std::string_view line, size_t bytes, PositionEncoding encoding)
+{
+      bytes = std::min(bytes, line.size());
+      if (encoding == PositionEncoding::UTF8)
+            return bytes;
+
+      size_t byte = findNonAscii(line.substr(0, bytes));
+      size_t units = byte;
+      while (byte < bytes)
+      {
+            const size_t length = sequenceLength(static_cast<unsigned char>(line[byte]));
+            units += unitsFor(length, encoding);
+            byte += length;
+      }
+      return units;
+}
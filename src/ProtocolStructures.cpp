@@ -1,4 +1,5 @@
 #include "ProtocolStructures.hpp"
+#include <limits>
 
 void to_json(nlohmann::json &j, const ServerCapabilities::TextDocumentSyncOptions &syncOptions){
       j = nlohmann::json{{"change", syncOptions.change}, {"openClose", syncOptions.openClose}};
@@ -6,8 +7,9 @@ void to_json(nlohmann::json &j, const ServerCapabilities::TextDocumentSyncOption
 
 void to_json(nlohmann::json &j, const ServerCapabilities &capabilities)
 {
-      // TODO: handle encoding
-      j = nlohmann::json{{"positionEncoding", "utf-16"}, {"textDocumentSync", capabilities.textDocumentSync}};
+      // An empty encoding means none was negotiated, which leaves the protocol default
+      j = nlohmann::json{{"positionEncoding", capabilities.positionEncoding.empty() ? "utf-16" : capabilities.positionEncoding},
+                         {"textDocumentSync", capabilities.textDocumentSync}};
 
       if (capabilities.advertisedCapabilities & ServerCapabilities::completionProvider) j["completionProvider"] = true;
       if (capabilities.advertisedCapabilities & ServerCapabilities::hoverProvider) j["hoverProvider"] = true;
@@ -87,6 +89,306 @@ void to_json(nlohmann::json &j, const textDocumentPositionParams &td)
       j = {{"textDocument", td.textDocument}, {"position", td.position}};
 }
 
+void to_json(nlohmann::json &j, const SymbolInformation &s)
+{
+      j = {{"name", s.name}, {"kind", s.kind}, {"location", s.location}};
+
+      if (s.containerName.has_value()) j["containerName"] = s.containerName.value();
+}
+
+void writeJson(JsonWriter &w, const ServerInfo &serverInfo)
+{
+      w.beginObject();
+      w.member("name", serverInfo.name);
+      w.member("version", serverInfo.version);
+      w.endObject();
+}
+
+void writeJson(JsonWriter &w, const Position &p)
+{
+      w.beginObject();
+      w.member("character", p.character);
+      w.member("line", p.line);
+      w.endObject();
+}
+
+void writeJson(JsonWriter &w, const Range &r)
+{
+      w.beginObject();
+      w.member("end", r.end);
+      w.member("start", r.start);
+      w.endObject();
+}
+
+void writeJson(JsonWriter &w, const Location &l)
+{
+      w.beginObject();
+      w.member("range", l.range);
+      w.member("uri", l.uri);
+      w.endObject();
+}
+
+void writeJson(JsonWriter &w, const textDocumentIdentifier &p)
+{
+      w.beginObject();
+      w.member("uri", p.uri);
+      w.endObject();
+}
+
+void writeJson(JsonWriter &w, const textDocumentPositionParams &td)
+{
+      w.beginObject();
+      w.member("position", td.position);
+      w.member("textDocument", td.textDocument);
+      w.endObject();
+}
+
+void writeJson(JsonWriter &w, const MarkupContent &p)
+{
+      w.beginObject();
+      w.member("kind", p.kind);
+      w.member("value", p.value);
+      w.endObject();
+}
+
+void writeJson(JsonWriter &w, const hoverResult &h)
+{
+      w.beginObject();
+      w.member("contents", h.contents);
+      w.optionalMember("range", h.range);
+      w.endObject();
+}
+
+void writeJson(JsonWriter &w, const SymbolInformation &s)
+{
+      w.beginObject();
+      w.optionalMember("containerName", s.containerName);
+      w.member("kind", static_cast<int>(s.kind));
+      w.member("location", s.location);
+      w.member("name", s.name);
+      w.endObject();
+}
+
+static bool readNumber(JsonReader &r, uint &out)
+{
+      uint64_t n;
+      if (!r.readUInt(n) || n > std::numeric_limits<uint>::max())
+            return false;
+      out = static_cast<uint>(n);
+      return true;
+}
+
+static bool readNumber(JsonReader &r, int &out)
+{
+      int64_t n;
+      if (!r.readInt(n) || n < std::numeric_limits<int>::min() || n > std::numeric_limits<int>::max())
+            return false;
+      out = static_cast<int>(n);
+      return true;
+}
+
+// Progress tokens may be strings or integers, only string tokens are kept
+static bool readProgressToken(JsonReader &r, std::optional<ProgressToken> &token)
+{
+      if (r.peek() != JsonReader::Type::String)
+            return r.skipValue();
+      token.emplace();
+      return r.readString(*token);
+}
+
+template <typename T>
+static bool readOptional(JsonReader &r, std::optional<T> &out)
+{
+      if (r.peek() == JsonReader::Type::Null)
+      {
+            out.reset();
+            return r.readNull();
+      }
+      out.emplace();
+      return readJson(r, *out);
+}
+
+// Calls `member(key)` for every member of an object. `member` returns false if
+// the value was malformed, unknown members are skipped.
+template <typename F>
+static bool readObject(JsonReader &r, F member)
+{
+      if (!r.beginObject())
+            return false;
+      std::string_view key;
+      while (r.nextMember(key))
+      {
+            if (!member(key))
+                  return false;
+      }
+      return r.ok();
+}
+
+bool readJson(JsonReader &r, Position &p)
+{
+      bool line = false, character = false;
+      return readObject(r, [&](std::string_view key)
+                        {
+                              if (key == "line")
+                                    return line = readNumber(r, p.line);
+                              if (key == "character")
+                                    return character = readNumber(r, p.character);
+                              return r.skipValue(); }) &&
+             line && character;
+}
+
+bool readJson(JsonReader &r, Range &range)
+{
+      bool start = false, end = false;
+      return readObject(r, [&](std::string_view key)
+                        {
+                              if (key == "start")
+                                    return start = readJson(r, range.start);
+                              if (key == "end")
+                                    return end = readJson(r, range.end);
+                              return r.skipValue(); }) &&
+             start && end;
+}
+
+bool readJson(JsonReader &r, Location &l)
+{
+      bool uri = false, range = false;
+      return readObject(r, [&](std::string_view key)
+                        {
+                              if (key == "uri")
+                                    return uri = r.readString(l.uri);
+                              if (key == "range")
+                                    return range = readJson(r, l.range);
+                              return r.skipValue(); }) &&
+             uri && range;
+}
+
+bool readJson(JsonReader &r, textDocumentIdentifier &p)
+{
+      bool uri = false;
+      return readObject(r, [&](std::string_view key)
+                        {
+                              if (key == "uri")
+                                    return uri = r.readString(p.uri);
+                              return r.skipValue(); }) &&
+             uri;
+}
+
+bool readJson(JsonReader &r, versionedTextDocumentIdentifier &p)
+{
+      bool uri = false, version = false;
+      return readObject(r, [&](std::string_view key)
+                        {
+                              if (key == "uri")
+                                    return uri = r.readString(p.uri);
+                              if (key == "version")
+                                    return version = readNumber(r, p.version);
+                              return r.skipValue(); }) &&
+             uri && version;
+}
+
+// Shared by every textDocument/position request: hover, definition, ...
+template <typename T>
+static bool readPositionParams(JsonReader &r, T &p)
+{
+      bool textDocument = false, position = false;
+      return readObject(r, [&](std::string_view key)
+                        {
+                              if (key == "textDocument")
+                                    return textDocument = readJson(r, p.textDocument);
+                              if (key == "position")
+                                    return position = readJson(r, p.position);
+                              if constexpr (std::is_base_of_v<workDoneProgressParams, T>)
+                              {
+                                    if (key == "workDoneToken")
+                                          return readProgressToken(r, p.workDoneToken);
+                              }
+                              if constexpr (std::is_base_of_v<PartialResultParams, T>)
+                              {
+                                    if (key == "partialResultToken")
+                                          return readProgressToken(r, p.partialResultToken);
+                              }
+                              return r.skipValue(); }) &&
+             textDocument && position;
+}
+
+bool readJson(JsonReader &r, textDocumentPositionParams &td)
+{
+      return readPositionParams(r, td);
+}
+
+bool readJson(JsonReader &r, hoverParams &p)
+{
+      return readPositionParams(r, p);
+}
+
+bool readJson(JsonReader &r, declarationParams &p)
+{
+      return readPositionParams(r, p);
+}
+
+bool readJson(JsonReader &r, definitionParams &p)
+{
+      return readPositionParams(r, p);
+}
+
+bool readJson(JsonReader &r, TextDocumentContentChangeEvent &e)
+{
+      bool text = false;
+      return readObject(r, [&](std::string_view key)
+                        {
+                              if (key == "text")
+                                    return text = r.readString(e.text);
+                              if (key == "range")
+                                    return readOptional(r, e.range);
+                              if (key == "rangeLength")
+                              {
+                                    e.rangeLength.emplace();
+                                    return readNumber(r, *e.rangeLength);
+                              }
+                              return r.skipValue(); }) &&
+             text;
+}
+
+bool readJson(JsonReader &r, DidChangeTextDocumentParams &p)
+{
+      bool textDocument = false, contentChanges = false;
+      return readObject(r, [&](std::string_view key)
+                        {
+                              if (key == "textDocument")
+                                    return textDocument = readJson(r, p.textDocument);
+                              if (key == "contentChanges")
+                              {
+                                    if (!r.beginArray())
+                                          return false;
+                                    p.contentChanges.clear();
+                                    while (r.nextElement())
+                                    {
+                                          // Construct in place so the change text is read straight into the vector
+                                          if (!readJson(r, p.contentChanges.emplace_back()))
+                                                return false;
+                                    }
+                                    return contentChanges = r.ok();
+                              }
+                              return r.skipValue(); }) &&
+             textDocument && contentChanges;
+}
+
+bool readJson(JsonReader &r, WorkspaceSymbolParams &p)
+{
+      bool query = false;
+      return readObject(r, [&](std::string_view key)
+                        {
+                              if (key == "query")
+                                    return query = r.readString(p.query);
+                              if (key == "workDoneToken")
+                                    return readProgressToken(r, p.workDoneToken);
+                              if (key == "partialResultToken")
+                                    return readProgressToken(r, p.partialResultToken);
+                              return r.skipValue(); }) &&
+             query;
+}
+
 void from_json(const nlohmann::json &j, Position &p)
 {
       j.at("line").get_to(p.line);
@@ -134,3 +436,8 @@ void from_json(const nlohmann::json &j, versionedTextDocumentIdentifier &td)
       j.at("uri").get_to(td.uri);
       j.at("version").get_to(td.version);
 }
+
+void from_json(const nlohmann::json &j, WorkspaceSymbolParams &p)
+{
+      j.at("query").get_to(p.query);
+}
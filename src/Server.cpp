@@ -1,20 +1,28 @@
 #include "Server.hpp"
 #include "Message.hpp"
+#include "JsonReader.hpp"
+#include "Logger.hpp"
 #include <iostream>
 #include <fstream>
 #include <chrono>
 #include "ProtocolStructures.hpp"
 #include <map>
+#include <cstdlib>
 
-LSPServer::LSPServer() : m_listener(), force_shutdown(false), thread_exiting(false), isOKtoExit(false), m_shutdownRequested(false), m_initialized(false), m_input_stream(&std::cin), m_output_stream(&std::cout) {}
+LSPServer::LSPServer() : m_listener(), force_shutdown(false), thread_exiting(false), isOKtoExit(false), m_shutdownRequested(false), m_initialized(false), m_input_stream(&std::cin), m_output(std::cout), m_flushPolicy(FlushPolicy::immediate())
+{
+      registerCallback<nlohmann::json, MetricsSnapshot>("$/lspp/metrics", [this](const nlohmann::json &)
+                                                        { return metricsSnapshot(); });
+}
 
 LSPServer::~LSPServer()
 {
       stop();
       exit();
+      m_changeCoalescer.stop();
 }
 
-int LSPServer::init(const uint64_t &capabilities, std::istream &in, std::ostream &out)
+int LSPServer::init(const uint64_t &capabilities, std::istream &in, std::ostream &out, size_t workerThreads)
 {
       force_shutdown.store(false);
       thread_exiting.store(false);
@@ -24,8 +32,13 @@ int LSPServer::init(const uint64_t &capabilities, std::istream &in, std::ostream
       m_capabilities.advertisedCapabilities = capabilities;
 
       m_input_stream = &in;
-      m_output_stream = &out;
+      m_output.setStream(out);
+      if (const char *path = std::getenv("LSPP_RECORD_FILE"); path && !m_recorder.isOpen())
+            m_recorder.open(path);
+      if (const char *path = std::getenv("LSPP_TRACE_FILE"); path && !m_tracer.isEnabled())
+            m_tracer.open(path);
 
+      m_workers.start(workerThreads);
       m_listener = std::thread(server_main, this);
       return 0;
 }
@@ -53,61 +66,105 @@ int LSPServer::exit()
       return isOKtoExit ? 0 : 1;
 }
 
-void LSPServer::send(const Response &response, bool flush)
+void LSPServer::send(const Response &response)
 {
-      // Lock the output stream to prevent data races
-      std::lock_guard<std::mutex> lock(m_output_mutex);
-      
+      send(response, m_flushPolicy);
+}
+
+void LSPServer::send(const Response &response, const FlushPolicy &policy)
+{
+      std::string body;
+      const auto start = std::chrono::steady_clock::now();
       try
       {
-            std::string output = response.toString();
-            // Extract JSON body from wire format for logging
-            auto bodyStart = output.find("\r\n\r\n");
-            if (bodyStart != std::string::npos)
-            {
-                  Message::log("OUTBOUND: " + output.substr(bodyStart + 4));
-            }
-            (*m_output_stream) << output;
-            if (flush)
-                  m_output_stream->flush();
-      }
-      catch (const std::bad_alloc &)
-      {
-            // Output minimal response on allocation failure
-            (*m_output_stream) << "Content-Length: 2\r\n\r\n{}";
-            if (flush)
-                  m_output_stream->flush();
+            body = response.body();
       }
       catch (...)
       {
-            // Other exceptions - try minimal response
-            try
-            {
-                  (*m_output_stream) << "Content-Length: 2\r\n\r\n{}";
-                  if (flush)
-                        m_output_stream->flush();
-            }
-            catch (...)
-            {
-                  // Give up
-            }
+            // Unserializable result (e.g. invalid UTF-8) - send a minimal response
+            body = "{}";
       }
+      const auto serialized = std::chrono::steady_clock::now();
+      m_tracer.record("serialize", start, serialized);
+
+      LSPP_LOG(LogLevel::Debug, "OUTBOUND: " + body);
+      std::string header = Response::header(body.size());
+      if (m_recorder.isOpen())
+            m_recorder.record(FrameDirection::Outbound, header, body);
+      m_metrics.messageSent(header.size() + body.size(), serialized - start);
+      // Includes waiting for the output lock, and the write itself when the policy flushes
+      TraceSpan span(m_tracer, "write");
+      m_output.write(std::move(header), std::move(body), policy);
+}
+
+void LSPServer::setFlushPolicy(const FlushPolicy &policy)
+{
+      m_flushPolicy = policy;
+}
+
+bool LSPServer::recordSession(const std::string &path)
+{
+      return m_recorder.open(path);
+}
+
+bool LSPServer::traceTo(const std::string &path)
+{
+      return m_tracer.open(path);
+}
+
+const ServerMetrics &LSPServer::metrics() const
+{
+      return m_metrics;
+}
+
+MetricsSnapshot LSPServer::metricsSnapshot() const
+{
+      MetricsSnapshot snapshot = m_metrics.snapshot();
+      snapshot.openDocuments = m_documentHandler.documentCount();
+      snapshot.documentBytes = m_documentHandler.memoryUsage();
+      return snapshot;
 }
 
 std::string LSPServer::getOutputSafe(std::ostringstream *out_stream) const
 {
-      std::lock_guard<std::mutex> lock(m_output_mutex);
-      if (out_stream && m_output_stream == out_stream)
+      auto lock = m_output.lockStream();
+      if (out_stream && m_output.stream() == out_stream)
       {
             return out_stream->str();
       }
       return "";
 }
 
+// Context of the request the calling thread is processing
+static thread_local const RequestContext *t_currentRequest = nullptr;
+
+const RequestContext *LSPServer::currentRequest()
+{
+      return t_currentRequest;
+}
+
+// Error returned for requests the client cancelled before they completed
+static const nlohmann::json requestCancelledError = {{"code", -32800}, {"message", "Request cancelled"}};
+
+// Lifecycle requests change server state and are handled in order on the listener thread
+static bool isLifecycleMethod(Message::Method method)
+{
+      return method == Message::Method::INITIALIZE || method == Message::Method::SHUTDOWN || method == Message::Method::EXIT;
+}
+
+// The whole life of a message on its own track, from having read it to having handled it
+static void traceMessage(Tracer &tracer, uint64_t traceId, const Message &message, std::chrono::steady_clock::time_point received)
+{
+      if (tracer.isEnabled())
+            tracer.recordAsync("message", traceId, received, std::chrono::steady_clock::now(), message.documentURI());
+}
+
 void LSPServer::server_main(LSPServer *server)
 {
       Message message;
-      textDocument document;
+      FrameReader reader(*server->m_input_stream);
+      if (server->m_tracer.isEnabled())
+            server->m_tracer.setThreadName("listener");
 
       while (!server->force_shutdown.load())
       {
@@ -115,20 +172,33 @@ void LSPServer::server_main(LSPServer *server)
             if (server->force_shutdown.load())
                   break;
 
-            int readBytes = message.readMessage(*server->m_input_stream);
+            const auto readStart = std::chrono::steady_clock::now();
+            int readBytes = message.readMessage(reader);
             if (readBytes < 0)
             {
                   // EOF or stream error - exit gracefully
                   break;
             }
+            if (server->m_recorder.isOpen())
+                  server->m_recorder.record(FrameDirection::Inbound, reader.frame());
             if (readBytes == 0)
             {
                   // Invalid message, but stream is still OK - continue
                   continue;
             }
+            server->m_metrics.messageReceived(reader.frame().size(), message.scanTime());
+            TraceContext traceContext(message);
+            const uint64_t traceId = server->m_tracer.nextAsyncId();
+            if (server->m_tracer.isEnabled())
+            {
+                  // Scanning is the tail of the read, everything before it is waiting for and framing input
+                  const auto readEnd = std::chrono::steady_clock::now();
+                  server->m_tracer.record("read", readStart, readEnd - message.scanTime());
+                  server->m_tracer.record("parse", readEnd - message.scanTime(), readEnd);
+            }
             try
             {
-                  Message::log("INBOUND: " + message.get());
+                  LSPP_LOG(LogLevel::Debug, "INBOUND: " + std::string(message.payload()));
             }
             catch (...)
             {
@@ -139,17 +209,59 @@ void LSPServer::server_main(LSPServer *server)
 
             if (!message.id().has_value()) // Notification
             {
-                  server->processNotification(message);
+                  {
+                        TraceSpan span(server->m_tracer, "callback");
+                        server->processNotification(message);
+                  }
+                  server->m_metrics.messageHandled(message.method(), std::chrono::steady_clock::now() - now);
+                  traceMessage(server->m_tracer, traceId, message, now);
+            }
+            else if (server->m_workers.size() > 0 && !isLifecycleMethod(message.method()))
+            {
+                  // The payload lives in the reader's buffer, the queued copy owns its own
+                  auto queued = std::make_shared<const Message>(message);
+                  CancellationToken cancellation = server->m_cancellations.add(*message.id());
+                  server->m_metrics.requestQueued();
+                  server->m_workers.submit([server, queued, cancellation, now, traceId]
+                                           {
+                                                 const auto dequeued = std::chrono::steady_clock::now();
+                                                 TraceContext traceContext(*queued);
+                                                 server->m_tracer.recordAsync("queue", traceId, now, dequeued);
+                                                 server->m_metrics.requestDequeued(dequeued - now);
+                                                 Response response = [&]
+                                                 {
+                                                       // Unregistered however the request ends, before its response goes out
+                                                       CancellationRegistry::Registration registration(server->m_cancellations, *queued->id());
+                                                       // Cancelled while still queued: answer without running the handler
+                                                       if (cancellation.isCancelled())
+                                                       {
+                                                             Response cancelled(*queued);
+                                                             cancelled.setError(requestCancelledError);
+                                                             return cancelled;
+                                                       }
+                                                       TraceSpan span(server->m_tracer, "callback");
+                                                       return server->answerRequest(*queued, cancellation);
+                                                 }();
+                                                 server->send(response);
+                                                 server->m_metrics.messageHandled(queued->method(), std::chrono::steady_clock::now() - now);
+                                                 traceMessage(server->m_tracer, traceId, *queued, now); },
+                                           server->priorityForMethod(message));
             }
             else // Request
             {
-                  Response response = server->processRequest(message);
+                  Response response = [&]
+                  {
+                        TraceSpan span(server->m_tracer, "callback");
+                        return server->answerRequest(message);
+                  }();
                   server->send(response);
+                  server->m_metrics.messageHandled(message.method(), std::chrono::steady_clock::now() - now);
+                  traceMessage(server->m_tracer, traceId, message, now);
             }
 
             try
             {
-                  Message::log("Processed in " + std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - now).count()) + " ms");
+                  LSPP_LOG(LogLevel::Debug, "Processed in " + std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - now).count()) + " ms");
             }
             catch (...)
             {
@@ -157,16 +269,74 @@ void LSPServer::server_main(LSPServer *server)
             }
       }
       
+      // Let queued requests finish and send their responses
+      server->m_workers.stop();
+      server->m_output.flush();
+      server->m_recorder.close();
+      server->m_tracer.close();
+      // Nobody is left to act on an analysis of the final edits
+      server->m_changeCoalescer.stop();
+
       // Signal that thread is exiting (before destroying local objects)
       server->thread_exiting.store(true);
 }
 
+void LSPServer::onDocumentSettled(ChangeCoalescer::SettledCallback callback, std::chrono::milliseconds quietPeriod, std::chrono::milliseconds maxDelay)
+{
+      m_changeCoalescer.setCallback(std::move(callback), quietPeriod, maxDelay);
+}
+
+SymbolIndex &LSPServer::enableWorkspaceSymbols()
+{
+      registerCallback<WorkspaceSymbolParams, std::vector<SymbolInformation>>(Message::Method::WORKSPACE_SYMBOL, [this](const WorkspaceSymbolParams &params)
+                                                                             { return m_symbolIndex.search(params.query); });
+      m_indexSymbols = true;
+      return m_symbolIndex;
+}
+
+// Only records the snapshot, the symbols are extracted on the symbol index's own threads
+void LSPServer::indexOpenDocument(const std::string &uri)
+{
+      if (auto snapshot = m_documentHandler.getOpenDocument(uri))
+            m_symbolIndex.documentChanged(uri, *snapshot);
+}
+
 bool LSPServer::hasCapability(uint64_t capability) const
 {
       return (m_capabilities.advertisedCapabilities & capability);
 }
 
-Response LSPServer::processRequest(const Message &message)
+PositionEncoding LSPServer::positionEncoding() const
+{
+      return m_documentHandler.positionEncoding();
+}
+
+PositionEncoding LSPServer::negotiatePositionEncoding(const Message &initialize)
+{
+      bool offered[3] = {false, false, false};
+      JsonReader reader(initialize.paramsSpan());
+      if (reader.beginObject() && reader.findMember("capabilities") && reader.beginObject() && reader.findMember("general") &&
+          reader.beginObject() && reader.findMember("positionEncodings") && reader.beginArray())
+      {
+            while (reader.nextElement())
+            {
+                  std::string_view name;
+                  if (!reader.readStringView(name))
+                        break;
+                  if (auto encoding = parsePositionEncoding(name))
+                        offered[static_cast<int>(*encoding)] = true;
+            }
+      }
+
+      for (PositionEncoding preferred : {PositionEncoding::UTF8, PositionEncoding::UTF32})
+      {
+            if (offered[static_cast<int>(preferred)])
+                  return preferred;
+      }
+      return PositionEncoding::UTF16;
+}
+
+Response LSPServer::processRequest(const Message &message, const CancellationToken &cancellation)
 {
       Response response(message);
 
@@ -194,7 +364,12 @@ Response LSPServer::processRequest(const Message &message)
       {
       case Message::Method::INITIALIZE:
       {
-            InitializeResult initResult{{"utf-16", ServerCapabilities::TextDocumentSyncOptions::Incremental, m_capabilities.advertisedCapabilities}, {"LSPP", "1.0"}};
+            PositionEncoding encoding = negotiatePositionEncoding(message);
+            m_documentHandler.setPositionEncoding(encoding);
+            m_symbolIndex.setPositionEncoding(encoding);
+            m_changeCoalescer.setPositionEncoding(encoding);
+            m_capabilities.positionEncoding = positionEncodingName(encoding);
+            InitializeResult initResult{{m_capabilities.positionEncoding, ServerCapabilities::TextDocumentSyncOptions::Incremental, m_capabilities.advertisedCapabilities}, {"LSPP", "1.0"}};
             response.setResult(initResult);
             m_initialized = true;
             break;
@@ -214,17 +389,33 @@ Response LSPServer::processRequest(const Message &message)
             // If no capability required (0) or capability is advertised, try to invoke callback
             if (requiredCapability == 0 || hasCapability(requiredCapability))
             {
-                  auto result = invokeCallback(message);
-                  if (result)
+                  RequestContext context{message.id(), message.method(), cancellation, std::nullopt};
+                  if (!message.documentURI().empty())
+                        context.document = m_documentHandler.findHandle(message.documentURI());
+                  t_currentRequest = &context;
+                  bool handled;
+                  try
+                  {
+                        handled = invokeCallback(message, context, response);
+                  }
+                  catch (...)
+                  {
+                        t_currentRequest = nullptr;
+                        throw;
+                  }
+                  t_currentRequest = nullptr;
+
+                  if (cancellation.isCancelled())
                   {
-                        response.setResult(*result);
+                        // Whatever the handler produced, the client no longer wants it
+                        response.setError(requestCancelledError);
                   }
-                  else if (requiredCapability != 0)
+                  else if (!handled && requiredCapability != 0)
                   {
                         // Capability advertised but no callback registered
                         response.setError({{"code", -32601}, {"message", "Method not implemented"}});
                   }
-                  else
+                  else if (!handled)
                   {
                         // Unknown method
                         response.setError({{"code", -32601}, {"message", "Method not found"}});
@@ -242,6 +433,36 @@ Response LSPServer::processRequest(const Message &message)
       return response;
 }
 
+Response LSPServer::answerRequest(const Message &message, const CancellationToken &cancellation)
+{
+      // The client waits for an answer to every request, a throwing callback must not leave it hanging
+      try
+      {
+            return processRequest(message, cancellation);
+      }
+      catch (const InvalidParamsError &e)
+      {
+            LSPP_LOG(LogLevel::Warning, "Invalid params for " + Message::methodToString(message.method()) + ": " + e.what());
+            Response response(message);
+            response.setError({{"code", -32602}, {"message", std::string("Invalid params: ") + e.what()}});
+            return response;
+      }
+      catch (const std::exception &e)
+      {
+            LSPP_LOG(LogLevel::Error, "Request " + Message::methodToString(message.method()) + " failed: " + e.what());
+            Response response(message);
+            response.setError({{"code", -32603}, {"message", std::string("Internal error: ") + e.what()}});
+            return response;
+      }
+      catch (...)
+      {
+            LSPP_LOG(LogLevel::Error, "Request " + Message::methodToString(message.method()) + " failed");
+            Response response(message);
+            response.setError({{"code", -32603}, {"message", "Internal error"}});
+            return response;
+      }
+}
+
 void LSPServer::processNotification(const Message &message)
 {
       switch (message.method())
@@ -254,17 +475,84 @@ void LSPServer::processNotification(const Message &message)
             break;
       case Message::Method::TEXT_DOCUMENT_DID_OPEN:
       {
-            m_documentHandler.openDocument(message.documentURI(), message.params()["textDocument"]["text"]);
+            // Read the text straight from the payload rather than through a parsed params tree
+            std::string text;
+            int64_t version = 0;
+            bool hasText = false;
+            JsonReader reader(message.paramsSpan());
+            if (reader.beginObject() && reader.findMember("textDocument") && reader.beginObject())
+            {
+                  std::string_view key;
+                  while (reader.nextMember(key))
+                  {
+                        if (key == "text")
+                              hasText = reader.readString(text);
+                        else if (key == "version")
+                              reader.readInt(version);
+                        else
+                              reader.skipValue();
+                  }
+            }
+            if (!hasText)
+                  break;
+            m_documentHandler.openDocument(message.documentURI(), text, static_cast<int>(version));
+            if (m_indexSymbols)
+                  indexOpenDocument(message.documentURI());
             break;
       }
       case Message::Method::TEXT_DOCUMENT_DID_CHANGE:
       {
-            m_documentHandler.updateDocument(message.documentURI(), message.params());
+            DidChangeTextDocumentParams params;
+            JsonReader reader(message.paramsSpan());
+            if (!readJson(reader, params))
+            {
+                  // Notifications cannot be answered with an error, a malformed one is dropped
+                  try
+                  {
+                        params = message.params();
+                  }
+                  catch (const nlohmann::json::exception &e)
+                  {
+                        LSPP_LOG(LogLevel::Warning, std::string("Dropping malformed didChange: ") + e.what());
+                        break;
+                  }
+            }
+            if (!m_documentHandler.updateDocument(message.documentURI(), params))
+                  break;
+            if (m_indexSymbols)
+                  indexOpenDocument(message.documentURI());
+            if (!m_changeCoalescer.enabled())
+                  break;
+            // Edits are applied right away, only the settled callback is deferred
+            for (const auto &change : params.contentChanges)
+            {
+                  if (change.range.has_value())
+                        m_changeCoalescer.documentChanged(message.documentURI(), change.range.value(), change.text);
+                  else
+                        m_changeCoalescer.documentReplaced(message.documentURI(), change.text);
+            }
             break;
       }
       case Message::Method::TEXT_DOCUMENT_DID_CLOSE:
       {
             m_documentHandler.closeDocument(message.documentURI());
+            m_changeCoalescer.documentClosed(message.documentURI());
+            if (m_indexSymbols)
+                  m_symbolIndex.documentClosed(message.documentURI());
+            break;
+      }
+      case Message::Method::CANCEL_REQUEST:
+      {
+            // Unknown or already answered ids are ignored, as the protocol allows. Ids that
+            // Message::readId rejects cannot belong to a pending request either.
+            JsonReader reader(message.paramsSpan());
+            if (reader.beginObject() && reader.findMember("id"))
+            {
+                  if (auto id = Message::readId(reader))
+                        m_cancellations.cancel(*id);
+                  else
+                        LSPP_LOG(LogLevel::Debug, "Ignoring $/cancelRequest for an unsupported id: " + std::string(message.paramsSpan()));
+            }
             break;
       }
       default:
@@ -272,49 +560,199 @@ void LSPServer::processNotification(const Message &message)
       }
 }
 
-bool DocumentHandler::updateDocument(const std::string &uri, const DidChangeTextDocumentParams &params)
+DocumentHandle DocumentHandler::handleFor(const std::string &uri)
 {
+      return m_uris.intern(uri);
+}
+std::optional<DocumentHandle> DocumentHandler::findHandle(const std::string &uri) const
+{
+      return m_uris.find(uri);
+}
+std::optional<std::string> DocumentHandler::uriFor(DocumentHandle handle) const
+{
+      return m_uris.uri(handle);
+}
+void DocumentHandler::setPositionEncoding(PositionEncoding encoding)
+{
+      m_positionEncoding.store(encoding, std::memory_order_relaxed);
+}
+PositionEncoding DocumentHandler::positionEncoding() const
+{
+      return m_positionEncoding.load(std::memory_order_relaxed);
+}
+DocumentHandler::Shard &DocumentHandler::shardFor(DocumentHandle handle)
+{
+      return m_shards[handle % SHARD_COUNT];
+}
+const DocumentHandler::Shard &DocumentHandler::shardFor(DocumentHandle handle) const
+{
+      return m_shards[handle % SHARD_COUNT];
+}
+bool DocumentHandler::updateDocument(DocumentHandle handle, const DidChangeTextDocumentParams &params)
+{
+      Shard &shard = shardFor(handle);
+      OpenDocument current;
+      {
+            std::shared_lock<std::shared_mutex> lock(shard.mutex);
+            auto it = shard.documents.find(handle);
+            if (shard.documents.end() == it)
+                  return false;
+            current = it->second;
+      }
 
-      auto optionalDocument = getOpenDocument(uri);
-      if (!optionalDocument.has_value())
-            return false;
-
-      textDocument &document = optionalDocument.value();
+      // Readers may still hold the current version, so edit a copy. Copying a textDocument
+      // shares its storage; only the pieces touched by the edits are new. The same goes for
+      // the identifier index, whose copy shares the blocks of lines the edits leave alone.
+      auto document = std::make_shared<textDocument>(*current.document);
+      auto identifiers = current.identifiers ? std::make_shared<IdentifierIndex>(*current.identifiers) : nullptr;
+      const PositionEncoding encoding = positionEncoding();
       for (auto &j : params.contentChanges)
       {
             if (j.range.has_value())
             {
                   const Range &contentChanged = j.range.value();
 
-                  int startIndex = document.findPos(contentChanged.start.line, contentChanged.start.character);
-                  int endIndex = document.findPos(contentChanged.end.line, contentChanged.end.character);
+                  int startIndex = document->findPos(contentChanged.start.line, contentChanged.start.character, encoding);
+                  int endIndex = document->findPos(contentChanged.end.line, contentChanged.end.character, encoding);
 
-                  document.m_content.replace(startIndex, endIndex - startIndex, j.text);
+                  document->replace(startIndex, endIndex - startIndex, j.text);
+                  if (identifiers)
+                        identifiers->update(*document, contentChanged, j.text);
             }
             else
-                  document.m_content = j.text;
+            {
+                  document->setContent(j.text);
+                  if (identifiers)
+                        identifiers->rebuild(*document);
+            }
       }
 
+      std::unique_lock<std::shared_mutex> lock(shard.mutex);
+      auto it = shard.documents.find(handle);
+      if (shard.documents.end() == it)
+            return false;
+      it->second.document = std::move(document);
+      it->second.version = params.textDocument.version;
+      it->second.identifiers = std::move(identifiers);
       return true;
 }
-bool DocumentHandler::openDocument(const std::string &uri, const std::string &document)
+bool DocumentHandler::openDocument(DocumentHandle handle, const std::string &document, int version)
 {
-      return m_openDocuments.emplace(uri, document).second;
+      if (documentIsOpen(handle))
+            return false;
+
+      // Built before taking the lock, so readers of the shard are not held up by it
+      auto text = std::make_shared<const textDocument>(document);
+      std::shared_ptr<IdentifierIndex> identifiers;
+      if (m_indexIdentifiers)
+      {
+            identifiers = std::make_shared<IdentifierIndex>(m_identifierRules, positionEncoding());
+            identifiers->rebuild(*text);
+      }
+
+      Shard &shard = shardFor(handle);
+      std::unique_lock<std::shared_mutex> lock(shard.mutex);
+      return shard.documents.emplace(handle, OpenDocument{std::move(text), version, std::move(identifiers)}).second;
 }
-bool DocumentHandler::closeDocument(const std::string &uri)
+std::shared_ptr<const IdentifierIndex> DocumentHandler::identifiersOf(DocumentHandle handle) const
 {
-      return m_openDocuments.erase(uri) > 0;
+      const Shard &shard = shardFor(handle);
+      std::shared_lock<std::shared_mutex> lock(shard.mutex);
+      auto it = shard.documents.find(handle);
+      return it == shard.documents.end() ? nullptr : it->second.identifiers;
 }
-bool DocumentHandler::documentIsOpen(const std::string &uri) const
+void DocumentHandler::enableIdentifierIndex(const WordRules &rules)
+{
+      m_indexIdentifiers = true;
+      m_identifierRules = rules;
+}
+std::vector<Location> DocumentHandler::findIdentifier(DocumentHandle handle, std::string_view identifier) const
+{
+      auto identifiers = identifiersOf(handle);
+      auto uri = uriFor(handle);
+      if (!identifiers || !uri)
+            return {};
+      return identifiers->locations(identifier, *uri);
+}
+std::shared_ptr<const IdentifierIndex> DocumentHandler::getIdentifierIndex(DocumentHandle handle) const
+{
+      return identifiersOf(handle);
+}
+bool DocumentHandler::closeDocument(DocumentHandle handle)
+{
+      {
+            Shard &shard = shardFor(handle);
+            std::unique_lock<std::shared_mutex> lock(shard.mutex);
+            if (shard.documents.erase(handle) == 0)
+                  return false;
+      }
+      // Requests still holding the handle find the document closed, handles are not reused
+      m_uris.release(handle);
+      return true;
+}
+bool DocumentHandler::documentIsOpen(DocumentHandle handle) const
+{
+      const Shard &shard = shardFor(handle);
+      std::shared_lock<std::shared_mutex> lock(shard.mutex);
+      return shard.documents.count(handle) != 0;
+}
+size_t DocumentHandler::documentCount() const
 {
-      return m_openDocuments.count(uri) != 0;
+      size_t count = 0;
+      for (const Shard &shard : m_shards)
+      {
+            std::shared_lock<std::shared_mutex> lock(shard.mutex);
+            count += shard.documents.size();
+      }
+      return count;
 }
-std::optional<std::reference_wrapper<textDocument>> DocumentHandler::getOpenDocument(const std::string &uri)
+
+size_t DocumentHandler::memoryUsage() const
 {
-      auto it = m_openDocuments.find(uri);
-      if (m_openDocuments.end() == it)
+      size_t bytes = 0;
+      for (const Shard &shard : m_shards)
+      {
+            std::shared_lock<std::shared_mutex> lock(shard.mutex);
+            for (const auto &[handle, open] : shard.documents)
+                  bytes += open.document->memoryUsage();
+      }
+      return bytes;
+}
+
+std::optional<DocumentSnapshot> DocumentHandler::getOpenDocument(DocumentHandle handle) const
+{
+      const Shard &shard = shardFor(handle);
+      std::shared_lock<std::shared_mutex> lock(shard.mutex);
+      auto it = shard.documents.find(handle);
+      if (shard.documents.end() == it)
       {
             return std::nullopt;
       }
-      return std::make_optional<std::reference_wrapper<textDocument>>(it->second);
+      return DocumentSnapshot(it->second.document, it->second.version);
+}
+bool DocumentHandler::openDocument(const std::string &uri, const std::string &document, int version)
+{
+      return openDocument(handleFor(uri), document, version);
+}
+bool DocumentHandler::closeDocument(const std::string &uri)
+{
+      auto handle = findHandle(uri);
+      return handle.has_value() && closeDocument(*handle);
+}
+bool DocumentHandler::updateDocument(const std::string &uri, const DidChangeTextDocumentParams &params)
+{
+      auto handle = findHandle(uri);
+      return handle.has_value() && updateDocument(*handle, params);
+}
+bool DocumentHandler::documentIsOpen(const std::string &uri) const
+{
+      auto handle = findHandle(uri);
+      return handle.has_value() && documentIsOpen(*handle);
+}
+std::optional<DocumentSnapshot> DocumentHandler::getOpenDocument(const std::string &uri) const
+{
+      auto handle = findHandle(uri);
+      if (!handle.has_value())
+            return std::nullopt;
+      return getOpenDocument(*handle);
 }
@@ -0,0 +1,108 @@
+#include "SessionRecording.hpp"
+#include <fstream>
+#include <iterator>
+
+static void putLittleEndian(std::string &out, uint64_t value, size_t bytes)
+{
+      for (size_t i = 0; i < bytes; i++)
+            out += static_cast<char>((value >> (8 * i)) & 0xFF);
+}
+
+static uint64_t getLittleEndian(const char *data, size_t bytes)
+{
+      uint64_t value = 0;
+      for (size_t i = 0; i < bytes; i++)
+            value |= static_cast<uint64_t>(static_cast<unsigned char>(data[i])) << (8 * i);
+      return value;
+}
+
+static constexpr size_t FRAME_PREFIX_SIZE = 1 + 8 + 4;
+
+std::string_view RecordedFrame::payload() const
+{
+      size_t headerEnd = frame.find("\r\n\r\n");
+      if (headerEnd == std::string::npos)
+            return {};
+      return std::string_view(frame).substr(headerEnd + 4);
+}
+
+SessionRecorder::SessionRecorder() : m_file(nullptr), m_open(false) {}
+
+SessionRecorder::~SessionRecorder()
+{
+      close();
+}
+
+bool SessionRecorder::open(const std::string &path)
+{
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (m_file)
+            std::fclose(m_file);
+      m_file = std::fopen(path.c_str(), "wb");
+      if (!m_file)
+      {
+            m_open = false;
+            return false;
+      }
+      // Recording must not slow the server down with a write per frame
+      std::setvbuf(m_file, nullptr, _IOFBF, 1 << 20);
+      std::fwrite(MAGIC.data(), 1, MAGIC.size(), m_file);
+      m_start = std::chrono::steady_clock::now();
+      m_open = true;
+      return true;
+}
+
+void SessionRecorder::close()
+{
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_open = false;
+      if (m_file)
+            std::fclose(m_file);
+      m_file = nullptr;
+}
+
+void SessionRecorder::record(FrameDirection direction, std::string_view header, std::string_view body)
+{
+      const auto now = std::chrono::steady_clock::now();
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (!m_file)
+            return;
+
+      std::string prefix;
+      prefix.reserve(FRAME_PREFIX_SIZE);
+      prefix += static_cast<char>(direction);
+      putLittleEndian(prefix, std::chrono::duration_cast<std::chrono::nanoseconds>(now - m_start).count(), 8);
+      putLittleEndian(prefix, header.size() + body.size(), 4);
+
+      std::fwrite(prefix.data(), 1, prefix.size(), m_file);
+      std::fwrite(header.data(), 1, header.size(), m_file);
+      std::fwrite(body.data(), 1, body.size(), m_file);
+}
+
+std::optional<std::vector<RecordedFrame>> readSessionRecording(const std::string &path)
+{
+      std::ifstream file(path, std::ios::binary);
+      if (!file)
+            return std::nullopt;
+      const std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+      if (!std::string_view(data).starts_with(SessionRecorder::MAGIC))
+            return std::nullopt;
+
+      std::vector<RecordedFrame> frames;
+      size_t at = SessionRecorder::MAGIC.size();
+      while (data.size() - at >= FRAME_PREFIX_SIZE)
+      {
+            const char *prefix = data.data() + at;
+            const size_t size = getLittleEndian(prefix + 9, 4);
+            if (data.size() - at - FRAME_PREFIX_SIZE < size)
+                  break;
+
+            RecordedFrame frame;
+            frame.direction = static_cast<FrameDirection>(prefix[0]);
+            frame.nanoseconds = getLittleEndian(prefix + 1, 8);
+            frame.frame = data.substr(at + FRAME_PREFIX_SIZE, size);
+            frames.push_back(std::move(frame));
+            at += FRAME_PREFIX_SIZE + size;
+      }
+      return frames;
+}
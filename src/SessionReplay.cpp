@@ -0,0 +1,211 @@
+#include "SessionReplay.hpp"
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <istream>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <streambuf>
+#include <thread>
+#include <unordered_map>
+#include "FrameReader.hpp"
+#include "JsonReader.hpp"
+#include "Server.hpp"
+
+// Input stream the replay writes frames into while the server reads them. Reads block
+// until a frame arrives, like reads from a client's pipe.
+class FeedBuffer : public std::streambuf
+{
+      std::mutex m_mutex;
+      std::condition_variable m_cv;
+      std::deque<std::string> m_queue;
+      std::string m_current;
+      bool m_finished = false;
+
+public:
+      void push(std::string frame)
+      {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_queue.push_back(std::move(frame));
+            m_cv.notify_one();
+      }
+
+      // Reads past the last frame see end of file
+      void finish()
+      {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_finished = true;
+            m_cv.notify_one();
+      }
+
+protected:
+      int_type underflow() override
+      {
+            if (gptr() < egptr())
+                  return traits_type::to_int_type(*gptr());
+
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cv.wait(lock, [this]
+                      { return !m_queue.empty() || m_finished; });
+            if (m_queue.empty())
+                  return traits_type::eof();
+
+            m_current = std::move(m_queue.front());
+            m_queue.pop_front();
+            setg(m_current.data(), m_current.data(), m_current.data() + m_current.size());
+            return traits_type::to_int_type(*gptr());
+      }
+
+      std::streamsize showmanyc() override
+      {
+            return egptr() - gptr();
+      }
+};
+
+// Output stream that splits what the server writes back into frames and reports the
+// id of every response as soon as its last byte is written
+class CaptureBuffer : public std::streambuf
+{
+      std::function<void(int64_t id)> m_onResponse;
+      FrameSplitter m_frames;
+
+      void scan()
+      {
+            while (auto body = m_frames.next())
+                  responseWritten(*body);
+      }
+
+      void responseWritten(std::string_view body)
+      {
+            int64_t id = 0;
+            bool hasId = false, isRequest = false;
+            std::string_view key;
+            JsonReader reader(body);
+            if (!reader.beginObject())
+                  return;
+            while (reader.nextMember(key))
+            {
+                  if (key == "id")
+                        hasId = reader.readInt(id);
+                  else
+                  {
+                        // Server to client requests carry a method, they answer nothing
+                        isRequest = isRequest || key == "method";
+                        reader.skipValue();
+                  }
+            }
+            if (hasId && !isRequest)
+                  m_onResponse(id);
+      }
+
+public:
+      explicit CaptureBuffer(std::function<void(int64_t id)> onResponse) : m_onResponse(std::move(onResponse)) {}
+
+protected:
+      int_type overflow(int_type c) override
+      {
+            if (!traits_type::eq_int_type(c, traits_type::eof()))
+            {
+                  const char ch = traits_type::to_char_type(c);
+                  m_frames.append(&ch, 1);
+                  scan();
+            }
+            return traits_type::not_eof(c);
+      }
+
+      std::streamsize xsputn(const char *s, std::streamsize n) override
+      {
+            m_frames.append(s, n);
+            scan();
+            return n;
+      }
+};
+
+ReplayReport replaySession(LSPServer &server, uint64_t capabilities, const std::vector<RecordedFrame> &frames, const ReplayOptions &options)
+{
+      using Clock = std::chrono::steady_clock;
+      struct Pending
+      {
+            std::string method;
+            Clock::time_point sent;
+      };
+
+      std::mutex mutex;
+      std::unordered_map<int64_t, Pending> pending;
+      std::map<std::string, std::vector<uint64_t>> latencies;
+      size_t responses = 0;
+
+      CaptureBuffer capture([&](int64_t id)
+                            {
+                                  const auto now = Clock::now();
+                                  std::lock_guard<std::mutex> lock(mutex);
+                                  auto it = pending.find(id);
+                                  if (it == pending.end())
+                                        return;
+                                  latencies[it->second.method].push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(now - it->second.sent).count());
+                                  pending.erase(it);
+                                  responses++; });
+      FeedBuffer feed;
+      std::istream in(&feed);
+      std::ostream out(&capture);
+      server.init(capabilities, in, out, options.workerThreads);
+
+      size_t messages = 0;
+      std::optional<uint64_t> firstFrame;
+      const auto start = Clock::now();
+      for (const RecordedFrame &frame : frames)
+      {
+            if (frame.direction != FrameDirection::Inbound)
+                  continue;
+
+            if (!firstFrame)
+                  firstFrame = frame.nanoseconds;
+            if (options.paced && options.speed > 0)
+            {
+                  std::chrono::nanoseconds offset(static_cast<int64_t>((frame.nanoseconds - *firstFrame) / options.speed));
+                  std::this_thread::sleep_until(start + offset);
+            }
+
+            int64_t id = 0;
+            bool hasId = false;
+            std::string method;
+            std::string_view key;
+            JsonReader reader(frame.payload());
+            if (reader.beginObject())
+            {
+                  while (reader.nextMember(key))
+                  {
+                        if (key == "id")
+                              hasId = reader.readInt(id);
+                        else if (key == "method")
+                              reader.readString(method);
+                        else
+                              reader.skipValue();
+                  }
+            }
+            // Registered before the server can possibly answer
+            if (hasId && !method.empty())
+            {
+                  std::lock_guard<std::mutex> lock(mutex);
+                  pending[id] = {method, Clock::now()};
+            }
+            feed.push(frame.frame);
+            messages++;
+      }
+
+      // The server stops at end of input once queued requests are answered
+      feed.finish();
+      server.exit();
+      const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+      ReplayReport report{messages, responses, seconds, seconds > 0 ? messages / seconds : 0, {}};
+      for (auto &[method, samples] : latencies)
+      {
+            std::sort(samples.begin(), samples.end());
+            report.methods.push_back({method, samples.size(), percentile(samples, 0.5), percentile(samples, 0.99), percentile(samples, 0.999), samples.back()});
+      }
+      return report;
+}
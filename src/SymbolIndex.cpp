@@ -0,0 +1,588 @@
+#include "SymbolIndex.hpp"
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iterator>
+#include <latch>
+#include <sstream>
+
+static char toLowerAscii(char c)
+{
+      return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+static std::string lowered(std::string_view s)
+{
+      std::string out(s.size(), '\0');
+      std::transform(s.begin(), s.end(), out.begin(), toLowerAscii);
+      return out;
+}
+
+// Distinct trigrams of a lowercased name, sorted
+static std::vector<uint32_t> trigramsOf(std::string_view s)
+{
+      std::vector<uint32_t> out;
+      for (size_t i = 0; i + 3 <= s.size(); i++)
+      {
+            out.push_back(static_cast<uint32_t>(static_cast<unsigned char>(s[i])) << 16 |
+                          static_cast<uint32_t>(static_cast<unsigned char>(s[i + 1])) << 8 |
+                          static_cast<uint32_t>(static_cast<unsigned char>(s[i + 2])));
+      }
+      std::sort(out.begin(), out.end());
+      out.erase(std::unique(out.begin(), out.end()), out.end());
+      return out;
+}
+
+// Posting keys of single characters, above the 24 bits a trigram takes
+static std::vector<uint32_t> charactersOf(std::string_view s)
+{
+      std::vector<uint32_t> out;
+      for (char c : s)
+            out.push_back(uint32_t(1) << 24 | static_cast<unsigned char>(c));
+      std::sort(out.begin(), out.end());
+      out.erase(std::unique(out.begin(), out.end()), out.end());
+      return out;
+}
+
+// Every posting key of a lowercased name
+static std::vector<uint32_t> keysOf(std::string_view s)
+{
+      std::vector<uint32_t> out = trigramsOf(s), characters = charactersOf(s);
+      out.insert(out.end(), characters.begin(), characters.end());
+      return out;
+}
+
+// Span of the characters of `query` found in order in `name`, or npos
+static size_t subsequenceSpan(std::string_view name, std::string_view query)
+{
+      size_t first = std::string_view::npos, at = 0;
+      for (char c : query)
+      {
+            at = name.find(c, at);
+            if (at == std::string_view::npos)
+                  return std::string_view::npos;
+            if (first == std::string_view::npos)
+                  first = at;
+            at++;
+      }
+      return first == std::string_view::npos ? 0 : at - first;
+}
+
+void SymbolIndex::setExtractor(Extractor extractor)
+{
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_extractor = std::move(extractor);
+}
+
+void SymbolIndex::setPositionEncoding(PositionEncoding encoding)
+{
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_encoding = encoding;
+}
+
+SymbolIndex::Shard &SymbolIndex::shardFor(const std::string &uri)
+{
+      return m_shards[std::hash<std::string>{}(uri) % SHARD_COUNT];
+}
+
+std::vector<SymbolInformation> SymbolIndex::extract(const std::string &uri, const textDocument &document)
+{
+      Extractor extractor;
+      PositionEncoding encoding;
+      {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            extractor = m_extractor;
+            encoding = m_encoding;
+      }
+      if (extractor)
+            return extractor(uri, document);
+      return identifierSymbols(uri, document, defaultWordRules, encoding);
+}
+
+void SymbolIndex::setDocument(const std::string &uri, const textDocument &document)
+{
+      setSymbols(uri, extract(uri, document));
+}
+
+void SymbolIndex::setSymbols(const std::string &uri, std::vector<SymbolInformation> symbols)
+{
+      Shard &shard = shardFor(uri);
+      std::unique_lock<std::shared_mutex> lock(shard.mutex);
+      eraseDocument(shard, uri);
+      insertSymbols(shard, uri, std::move(symbols));
+}
+
+void SymbolIndex::insertSymbols(Shard &shard, const std::string &uri, std::vector<SymbolInformation> symbols)
+{
+      std::vector<uint32_t> &ids = shard.documents[uri];
+      ids.reserve(symbols.size());
+      for (auto &symbol : symbols)
+      {
+            uint32_t id;
+            if (!shard.freeSlots.empty())
+            {
+                  id = shard.freeSlots.back();
+                  shard.freeSlots.pop_back();
+            }
+            else
+            {
+                  id = static_cast<uint32_t>(shard.entries.size());
+                  shard.entries.emplace_back();
+            }
+
+            Entry &entry = shard.entries[id];
+            entry.lowered = lowered(symbol.name);
+            entry.symbol = std::move(symbol);
+            entry.live = true;
+            for (uint32_t key : keysOf(entry.lowered))
+            {
+                  auto &posting = shard.postings[key];
+                  posting.insert(std::lower_bound(posting.begin(), posting.end(), id), id);
+            }
+            ids.push_back(id);
+      }
+      shard.liveEntries += ids.size();
+}
+
+void SymbolIndex::eraseDocument(Shard &shard, const std::string &uri)
+{
+      auto it = shard.documents.find(uri);
+      if (it == shard.documents.end())
+            return;
+
+      for (uint32_t id : it->second)
+      {
+            Entry &entry = shard.entries[id];
+            for (uint32_t key : keysOf(entry.lowered))
+            {
+                  auto posting = shard.postings.find(key);
+                  if (posting == shard.postings.end())
+                        continue;
+                  auto at = std::lower_bound(posting->second.begin(), posting->second.end(), id);
+                  if (at != posting->second.end() && *at == id)
+                        posting->second.erase(at);
+                  if (posting->second.empty())
+                        shard.postings.erase(posting);
+            }
+            entry = Entry{};
+            shard.freeSlots.push_back(id);
+      }
+      shard.liveEntries -= it->second.size();
+      shard.documents.erase(it);
+}
+
+void SymbolIndex::removeDocument(const std::string &uri)
+{
+      {
+            // Changes still being extracted are dropped along with the pending one
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_pending.erase(uri);
+            m_latest.erase(uri);
+      }
+      Shard &shard = shardFor(uri);
+      std::unique_lock<std::shared_mutex> lock(shard.mutex);
+      eraseDocument(shard, uri);
+}
+
+void SymbolIndex::documentChanged(const std::string &uri, const DocumentSnapshot &snapshot)
+{
+      queue(uri, snapshot);
+}
+
+void SymbolIndex::queue(const std::string &uri, std::optional<DocumentSnapshot> snapshot)
+{
+      bool queued;
+      {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (snapshot)
+                  m_open.insert(uri);
+            else
+                  m_open.erase(uri);
+
+            const uint64_t sequence = m_nextSequence++;
+            m_latest[uri] = sequence;
+            // A task for an already pending change is queued and picks up this one instead
+            queued = !m_pending.insert_or_assign(uri, Pending{std::move(snapshot), sequence}).second;
+      }
+      if (queued)
+            return;
+      startPool();
+      m_pool.submit([this, uri]
+                    { indexPending(uri); }, WorkerPool::Priority::Background);
+}
+
+void SymbolIndex::startPool()
+{
+      std::call_once(m_poolStarted, [this]
+                     { m_pool.start(std::clamp<size_t>(std::thread::hardware_concurrency(), 2, SHARD_COUNT) - 1); });
+}
+
+static bool isBelow(const std::filesystem::path &path, const std::filesystem::path &root)
+{
+      auto relative = path.lexically_relative(root);
+      return !relative.empty() && *relative.begin() != "..";
+}
+
+static std::optional<std::string> readFile(const std::filesystem::path &path)
+{
+      std::ifstream file(path, std::ios::binary);
+      if (!file)
+            return std::nullopt;
+      std::ostringstream content;
+      content << file.rdbuf();
+      return content.str();
+}
+
+void SymbolIndex::documentClosed(const std::string &uri)
+{
+      // The editor may have discarded unsaved changes, the file is what the workspace holds now
+      queue(uri, std::nullopt);
+}
+
+size_t SymbolIndex::indexDirectory(const std::filesystem::path &root, const std::vector<std::string> &extensions)
+{
+      std::error_code error;
+      const std::filesystem::path base = std::filesystem::absolute(root, error).lexically_normal();
+      if (error)
+            return 0;
+      {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_roots.push_back(base);
+      }
+
+      size_t indexed = 0;
+      auto options = std::filesystem::directory_options::skip_permission_denied;
+      for (auto it = std::filesystem::recursive_directory_iterator(base, options, error); !error && it != std::filesystem::recursive_directory_iterator(); it.increment(error))
+      {
+            if (!it->is_regular_file(error))
+                  continue;
+            const std::filesystem::path &path = it->path();
+            if (!extensions.empty() && std::find(extensions.begin(), extensions.end(), path.extension().string()) == extensions.end())
+                  continue;
+
+            const std::string uri = pathToUri(path);
+            {
+                  // Open documents are indexed from the editor's buffer instead
+                  std::lock_guard<std::mutex> lock(m_mutex);
+                  if (m_open.count(uri))
+                        continue;
+            }
+            if (auto content = readFile(path))
+            {
+                  setDocument(uri, textDocument(*content));
+                  indexed++;
+            }
+      }
+      return indexed;
+}
+
+void SymbolIndex::indexPending()
+{
+      std::vector<std::string> uris;
+      uint64_t upTo;
+      {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            upTo = m_nextSequence - 1;
+            for (const auto &[uri, pending] : m_pending)
+                  uris.push_back(uri);
+      }
+      for (const std::string &uri : uris)
+            indexPending(uri);
+
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_indexed.wait(lock, [&]
+                     { return m_extracting.empty() || *m_extracting.begin() > upTo; });
+}
+
+void SymbolIndex::indexPending(const std::string &uri)
+{
+      Pending pending;
+      std::optional<std::filesystem::path> path;
+      {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto it = m_pending.find(uri);
+            if (it == m_pending.end())
+                  return;
+            pending = std::move(it->second);
+            m_pending.erase(it);
+            m_extracting.insert(pending.sequence);
+
+            if (!pending.snapshot && (path = uriToPath(uri)) &&
+                std::none_of(m_roots.begin(), m_roots.end(), [&](const std::filesystem::path &root)
+                             { return isBelow(*path, root); }))
+                  path.reset();
+      }
+      auto finished = [&]
+      {
+            {
+                  std::lock_guard<std::mutex> lock(m_mutex);
+                  m_extracting.erase(pending.sequence);
+            }
+            m_indexed.notify_all();
+      };
+
+      std::optional<std::vector<SymbolInformation>> symbols;
+      try
+      {
+            if (pending.snapshot)
+                  symbols = extract(uri, pending.snapshot->get());
+            else if (auto content = path ? readFile(*path) : std::nullopt)
+                  symbols = extract(uri, textDocument(*content));
+      }
+      catch (...)
+      {
+            finished();
+            throw;
+      }
+
+      {
+            Shard &shard = shardFor(uri);
+            std::unique_lock<std::shared_mutex> lock(shard.mutex);
+            bool newest;
+            {
+                  std::lock_guard<std::mutex> latestLock(m_mutex);
+                  auto latest = m_latest.find(uri);
+                  newest = latest != m_latest.end() && latest->second == pending.sequence;
+                  if (newest)
+                        m_latest.erase(latest);
+            }
+            if (newest)
+            {
+                  eraseDocument(shard, uri);
+                  if (symbols)
+                        insertSymbols(shard, uri, std::move(*symbols));
+            }
+      }
+      finished();
+}
+
+std::vector<uint32_t> SymbolIndex::holdingAll(const Shard &shard, const std::vector<uint32_t> &keys)
+{
+      std::vector<uint32_t> ids;
+      if (keys.empty())
+      {
+            for (uint32_t id = 0; id < shard.entries.size(); id++)
+                  ids.push_back(id);
+            return ids;
+      }
+
+      std::vector<const std::vector<uint32_t> *> lists;
+      for (uint32_t key : keys)
+      {
+            auto posting = shard.postings.find(key);
+            if (posting == shard.postings.end())
+                  return ids;
+            lists.push_back(&posting->second);
+      }
+      std::sort(lists.begin(), lists.end(), [](auto *a, auto *b)
+                { return a->size() < b->size(); });
+
+      ids = *lists[0];
+      std::vector<uint32_t> next;
+      for (size_t i = 1; i < lists.size() && !ids.empty(); i++)
+      {
+            next.clear();
+            std::set_intersection(ids.begin(), ids.end(), lists[i]->begin(), lists[i]->end(), std::back_inserter(next));
+            ids.swap(next);
+      }
+      return ids;
+}
+
+std::vector<SymbolIndex::Match> SymbolIndex::searchShard(const Shard &shard, std::string_view query, size_t limit, bool fuzzy)
+{
+      struct Candidate
+      {
+            int rank;
+            size_t detail;
+            uint32_t id;
+      };
+      std::vector<Candidate> found;
+
+      std::shared_lock<std::shared_mutex> lock(shard.mutex);
+      // Only names holding every trigram of the query can contain it, or every character for shorter queries
+      for (uint32_t id : holdingAll(shard, query.size() >= 3 ? trigramsOf(query) : charactersOf(query)))
+      {
+            const Entry &entry = shard.entries[id];
+            size_t at = entry.lowered.find(query);
+            if (!entry.live || at == std::string::npos)
+                  continue;
+            int rank = entry.lowered.size() == query.size() ? 0 : at == 0 ? 1 : 2;
+            found.push_back({rank, at, id});
+      }
+
+      if (fuzzy && query.size() > 1 && found.size() < limit)
+      {
+            // Both passes go through ids in order, so the names matched above are skipped by walking them along
+            const size_t substrings = found.size();
+            size_t next = 0;
+            for (uint32_t id : holdingAll(shard, charactersOf(query)))
+            {
+                  while (next < substrings && found[next].id < id)
+                        next++;
+                  const Entry &entry = shard.entries[id];
+                  if (!entry.live || (next < substrings && found[next].id == id))
+                        continue;
+                  size_t span = subsequenceSpan(entry.lowered, query);
+                  if (span != std::string_view::npos)
+                        found.push_back({3, span, id});
+            }
+      }
+
+      auto better = [&](const Candidate &a, const Candidate &b)
+      {
+            const std::string &x = shard.entries[a.id].lowered, &y = shard.entries[b.id].lowered;
+            if (a.rank != b.rank)
+                  return a.rank < b.rank;
+            if (a.detail != b.detail)
+                  return a.detail < b.detail;
+            if (x.size() != y.size())
+                  return x.size() < y.size();
+            return x < y;
+      };
+      const size_t kept = std::min(limit, found.size());
+      std::partial_sort(found.begin(), found.begin() + kept, found.end(), better);
+
+      std::vector<Match> out;
+      out.reserve(kept);
+      for (size_t i = 0; i < kept; i++)
+            out.push_back({found[i].rank, found[i].detail, shard.entries[found[i].id].symbol});
+      return out;
+}
+
+std::vector<SymbolInformation> SymbolIndex::search(std::string_view query, size_t limit, bool fuzzy)
+{
+      indexPending();
+      const std::string q = lowered(query);
+
+      std::vector<Match> matches;
+      if (size() < PARALLEL_SEARCH_THRESHOLD)
+      {
+            for (const Shard &shard : m_shards)
+            {
+                  auto found = searchShard(shard, q, limit, fuzzy);
+                  std::move(found.begin(), found.end(), std::back_inserter(matches));
+            }
+      }
+      else
+      {
+            startPool();
+            std::array<std::vector<Match>, SHARD_COUNT> found;
+            std::latch done(SHARD_COUNT - 1);
+            for (size_t i = 1; i < SHARD_COUNT; i++)
+            {
+                  m_pool.submit([&, i]
+                                {
+                                      // A shard that fails is left out rather than leaving the search waiting
+                                      try
+                                      {
+                                            found[i] = searchShard(m_shards[i], q, limit, fuzzy);
+                                      }
+                                      catch (...)
+                                      {
+                                      }
+                                      done.count_down(); });
+            }
+            found[0] = searchShard(m_shards[0], q, limit, fuzzy);
+            done.wait();
+            for (auto &shardMatches : found)
+                  std::move(shardMatches.begin(), shardMatches.end(), std::back_inserter(matches));
+      }
+
+      auto better = [](const Match &a, const Match &b)
+      {
+            if (a.rank != b.rank)
+                  return a.rank < b.rank;
+            if (a.detail != b.detail)
+                  return a.detail < b.detail;
+            if (a.symbol.name.size() != b.symbol.name.size())
+                  return a.symbol.name.size() < b.symbol.name.size();
+            return a.symbol.name < b.symbol.name;
+      };
+      const size_t kept = std::min(limit, matches.size());
+      std::partial_sort(matches.begin(), matches.begin() + kept, matches.end(), better);
+
+      std::vector<SymbolInformation> out;
+      out.reserve(kept);
+      for (size_t i = 0; i < kept; i++)
+            out.push_back(std::move(matches[i].symbol));
+      return out;
+}
+
+size_t SymbolIndex::size() const
+{
+      size_t total = 0;
+      for (const Shard &shard : m_shards)
+      {
+            std::shared_lock<std::shared_mutex> lock(shard.mutex);
+            total += shard.liveEntries;
+      }
+      return total;
+}
+
+std::vector<SymbolInformation> SymbolIndex::identifierSymbols(const std::string &uri, const textDocument &document, const WordRules &rules, PositionEncoding encoding)
+{
+      std::vector<SymbolInformation> symbols;
+      std::unordered_set<std::string_view> seen;
+
+      for (size_t line = 0; line < document.lineCount(); line++)
+      {
+            std::string_view text = document.lineView(line);
+            const bool ascii = encoding == PositionEncoding::UTF8 || findNonAscii(text) == text.size();
+
+            rules.forEachIdentifier(text, [&](size_t begin, size_t end)
+                                    {
+                                          std::string_view name = text.substr(begin, end - begin);
+                                          // Single characters are not worth listing
+                                          if (name.size() > 1 && seen.insert(name).second)
+                                          {
+                                                uint start = ascii ? begin : unitsFromByteOffset(text, begin, encoding);
+                                                uint stop = ascii ? end : start + unitsFromByteOffset(name, name.size(), encoding);
+                                                symbols.push_back({std::string(name), SymbolKind::Variable, {uri, {{static_cast<uint>(line), start}, {static_cast<uint>(line), stop}}}, std::nullopt});
+                  } });
+      }
+      return symbols;
+}
+
+std::string SymbolIndex::pathToUri(const std::filesystem::path &path)
+{
+      static constexpr char hex[] = "0123456789ABCDEF";
+      std::string generic = path.generic_string();
+      std::string uri = generic.starts_with('/') ? "file://" : "file:///";
+      for (char c : generic)
+      {
+            unsigned char u = static_cast<unsigned char>(c);
+            if (std::isalnum(u) || c == '/' || c == '-' || c == '.' || c == '_' || c == '~' || c == ':')
+                  uri += c;
+            else
+            {
+                  uri += '%';
+                  uri += hex[u >> 4];
+                  uri += hex[u & 0xF];
+            }
+      }
+      return uri;
+}
+
+std::optional<std::filesystem::path> SymbolIndex::uriToPath(std::string_view uri)
+{
+      constexpr std::string_view scheme = "file://";
+      if (!uri.starts_with(scheme))
+            return std::nullopt;
+      uri.remove_prefix(scheme.size());
+
+      std::string path;
+      for (size_t i = 0; i < uri.size(); i++)
+      {
+            if (uri[i] == '%' && i + 2 < uri.size() && std::isxdigit(static_cast<unsigned char>(uri[i + 1])) && std::isxdigit(static_cast<unsigned char>(uri[i + 2])))
+            {
+                  path += static_cast<char>(std::stoi(std::string(uri.substr(i + 1, 2)), nullptr, 16));
+                  i += 2;
+            }
+            else
+                  path += uri[i];
+      }
+      // file:///C:/dir names a drive path on Windows
+      if (path.size() > 2 && path[0] == '/' && path[2] == ':')
+            path.erase(0, 1);
+      return std::filesystem::path(path).lexically_normal();
+}
@@ -0,0 +1,253 @@
+#include "Tracer.hpp"
+#include <algorithm>
+#include <cstdio>
+#include "JsonWriter.hpp"
+
+namespace
+{
+      struct CurrentRequest
+      {
+            int64_t id = Tracer::NO_ID;
+            Message::Method method = Message::Method::NONE;
+      };
+      thread_local CurrentRequest t_request;
+
+      // Tells tracers apart even when one is created where a destroyed one lived
+      std::atomic<uint64_t> g_nextSerial(1);
+
+      // Trace timestamps are microseconds, kept to the nanosecond
+      std::string microseconds(uint64_t nanoseconds)
+      {
+            char text[32];
+            std::snprintf(text, sizeof(text), "%llu.%03llu", static_cast<unsigned long long>(nanoseconds / 1000), static_cast<unsigned long long>(nanoseconds % 1000));
+            return text;
+      }
+
+      std::string eventJson(const Tracer::Event &event, uint32_t tid, char phase)
+      {
+            std::string out;
+            JsonWriter writer(out);
+            writer.beginObject();
+            writer.key("name");
+            writer.value(event.name);
+            writer.key("cat");
+            writer.value("lspp");
+            writer.key("ph");
+            writer.value(std::string_view(&phase, 1));
+            writer.key("pid");
+            writer.value(1);
+            writer.key("tid");
+            writer.value(tid);
+            writer.key("ts");
+            writer.raw(microseconds(phase == 'e' ? event.start + event.duration : event.start));
+            if (event.asyncId)
+            {
+                  writer.key("id");
+                  writer.value(event.asyncId);
+            }
+            else
+            {
+                  writer.key("dur");
+                  writer.raw(microseconds(event.duration));
+            }
+            if (phase != 'e')
+            {
+                  writer.key("args");
+                  writer.beginObject();
+                  if (event.id != Tracer::NO_ID)
+                  {
+                        writer.key("id");
+                        writer.value(event.id);
+                  }
+                  writer.key("method");
+                  writer.value(event.method == Message::Method::NONE ? std::string("custom") : Message::methodToString(event.method));
+                  if (!event.uri.empty())
+                  {
+                        writer.key("uri");
+                        writer.value(event.uri);
+                  }
+                  writer.endObject();
+            }
+            writer.endObject();
+            return out;
+      }
+}
+
+TraceContext::TraceContext(std::optional<RequestId> id, Message::Method method) : m_previousId(t_request.id), m_previousMethod(t_request.method)
+{
+      t_request.id = id ? *id : Tracer::NO_ID;
+      t_request.method = method;
+}
+
+TraceContext::~TraceContext()
+{
+      t_request.id = m_previousId;
+      t_request.method = m_previousMethod;
+}
+
+int64_t TraceContext::currentId()
+{
+      return t_request.id;
+}
+
+Message::Method TraceContext::currentMethod()
+{
+      return t_request.method;
+}
+
+Tracer::Tracer() : m_serial(g_nextSerial.fetch_add(1)), m_nextAsyncId(1), m_enabled(false) {}
+
+Tracer::~Tracer()
+{
+      close();
+}
+
+bool Tracer::open(const std::string &path)
+{
+      std::lock_guard<std::mutex> lock(m_mutex);
+      std::FILE *file = std::fopen(path.c_str(), "w");
+      if (!file)
+            return false;
+      std::fclose(file);
+
+      m_enabled.store(false, std::memory_order_relaxed);
+      for (auto &buffer : m_buffers)
+      {
+            std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+            buffer->events.clear();
+            buffer->dropped = 0;
+      }
+      m_path = path;
+      m_origin = Clock::now();
+      m_enabled.store(true, std::memory_order_release);
+      return true;
+}
+
+bool Tracer::close()
+{
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (!m_enabled.exchange(false))
+            return false;
+      std::FILE *file = std::fopen(m_path.c_str(), "w");
+      if (!file)
+            return false;
+      std::setvbuf(file, nullptr, _IOFBF, 1 << 20);
+
+      uint64_t dropped = 0;
+      bool first = true;
+      // One small document per event, appended to the open traceEvents array
+      auto emit = [&](const std::string &event)
+      {
+            std::fputs(first ? "\n" : ",\n", file);
+            std::fputs(event.c_str(), file);
+            first = false;
+      };
+      std::fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", file);
+      for (auto &buffer : m_buffers)
+      {
+            std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+            dropped += buffer->dropped;
+
+            std::string out;
+            JsonWriter metadata(out);
+            metadata.beginObject();
+            metadata.key("name");
+            metadata.value("thread_name");
+            metadata.key("ph");
+            metadata.value("M");
+            metadata.key("pid");
+            metadata.value(1);
+            metadata.key("tid");
+            metadata.value(buffer->tid);
+            metadata.key("args");
+            metadata.beginObject();
+            metadata.key("name");
+            metadata.value(buffer->name);
+            metadata.endObject();
+            metadata.endObject();
+            emit(out);
+
+            for (const Event &event : buffer->events)
+            {
+                  // Async spans are a begin and an end event, others a single complete event
+                  if (!event.asyncId)
+                        emit(eventJson(event, buffer->tid, 'X'));
+                  else
+                  {
+                        emit(eventJson(event, buffer->tid, 'b'));
+                        emit(eventJson(event, buffer->tid, 'e'));
+                  }
+            }
+            buffer->events.clear();
+            buffer->events.shrink_to_fit();
+      }
+      std::fprintf(file, "\n],\"otherData\":{\"droppedSpans\":%llu}}\n", static_cast<unsigned long long>(dropped));
+      return std::fclose(file) == 0;
+}
+
+Tracer::ThreadBuffer &Tracer::threadBuffer()
+{
+      // The last buffer used by this thread, valid while its tracer is alive
+      thread_local uint64_t cachedSerial = 0;
+      thread_local ThreadBuffer *cachedBuffer = nullptr;
+      if (cachedSerial == m_serial)
+            return *cachedBuffer;
+
+      std::lock_guard<std::mutex> lock(m_mutex);
+      ThreadBuffer *&buffer = m_byThread[std::this_thread::get_id()];
+      if (!buffer)
+      {
+            m_buffers.push_back(std::make_unique<ThreadBuffer>());
+            buffer = m_buffers.back().get();
+            buffer->tid = static_cast<uint32_t>(m_buffers.size());
+            buffer->name = "thread " + std::to_string(buffer->tid);
+      }
+      cachedSerial = m_serial;
+      cachedBuffer = buffer;
+      return *buffer;
+}
+
+uint64_t Tracer::since(Clock::time_point t) const
+{
+      return t > m_origin ? std::chrono::duration_cast<std::chrono::nanoseconds>(t - m_origin).count() : 0;
+}
+
+void Tracer::append(Event event)
+{
+      ThreadBuffer &buffer = threadBuffer();
+      std::lock_guard<std::mutex> lock(buffer.mutex);
+      if (buffer.events.size() >= MAX_EVENTS_PER_THREAD)
+      {
+            buffer.dropped++;
+            return;
+      }
+      buffer.events.push_back(std::move(event));
+}
+
+void Tracer::record(const char *name, Clock::time_point start, Clock::time_point end, std::string uri)
+{
+      if (!isEnabled())
+            return;
+      const uint64_t from = since(start);
+      append({name, from, std::max(from, since(end)) - from, 0, t_request.id, t_request.method, std::move(uri)});
+}
+
+void Tracer::recordAsync(const char *name, uint64_t asyncId, Clock::time_point start, Clock::time_point end, std::string uri)
+{
+      if (!isEnabled())
+            return;
+      const uint64_t from = since(start);
+      append({name, from, std::max(from, since(end)) - from, asyncId, t_request.id, t_request.method, std::move(uri)});
+}
+
+uint64_t Tracer::nextAsyncId()
+{
+      return m_nextAsyncId.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Tracer::setThreadName(std::string name)
+{
+      ThreadBuffer &buffer = threadBuffer();
+      std::lock_guard<std::mutex> lock(buffer.mutex);
+      buffer.name = std::move(name);
+}
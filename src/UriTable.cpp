@@ -0,0 +1,52 @@
+#include "UriTable.hpp"
+#include <mutex>
+
+DocumentHandle UriTable::intern(std::string_view uri)
+{
+      if (auto handle = find(uri))
+            return *handle;
+
+      std::unique_lock<std::shared_mutex> lock(m_mutex);
+      // Another thread may have interned it between the two locks
+      auto it = m_handles.find(uri);
+      if (it != m_handles.end())
+            return it->second;
+
+      DocumentHandle handle = m_next++;
+      m_handles.emplace(m_uris.emplace(handle, uri).first->second, handle);
+      return handle;
+}
+
+std::optional<DocumentHandle> UriTable::find(std::string_view uri) const
+{
+      std::shared_lock<std::shared_mutex> lock(m_mutex);
+      auto it = m_handles.find(uri);
+      if (it == m_handles.end())
+            return std::nullopt;
+      return it->second;
+}
+
+std::optional<std::string> UriTable::uri(DocumentHandle handle) const
+{
+      std::shared_lock<std::shared_mutex> lock(m_mutex);
+      auto it = m_uris.find(handle);
+      if (it == m_uris.end())
+            return std::nullopt;
+      return it->second;
+}
+
+void UriTable::release(DocumentHandle handle)
+{
+      std::unique_lock<std::shared_mutex> lock(m_mutex);
+      auto it = m_uris.find(handle);
+      if (it == m_uris.end())
+            return;
+      m_handles.erase(it->second);
+      m_uris.erase(it);
+}
+
+size_t UriTable::size() const
+{
+      std::shared_lock<std::shared_mutex> lock(m_mutex);
+      return m_uris.size();
+}
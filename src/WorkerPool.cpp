@@ -0,0 +1,114 @@
+#include "WorkerPool.hpp"
+#include <exception>
+#include "Logger.hpp"
+
+WorkerPool::WorkerPool() : m_interactiveBurst(0), m_stopping(false) {}
+
+WorkerPool::~WorkerPool()
+{
+      stop();
+}
+
+void WorkerPool::start(size_t workers)
+{
+      stop();
+
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stopping = false;
+      for (size_t i = 0; i < workers; i++)
+            m_workers.emplace_back(&WorkerPool::run, this);
+}
+
+void WorkerPool::stop()
+{
+      {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+      }
+      m_cv.notify_all();
+
+      for (auto &worker : m_workers)
+      {
+            if (worker.joinable())
+                  worker.join();
+      }
+      m_workers.clear();
+}
+
+void WorkerPool::submit(std::function<void()> task, Priority priority)
+{
+      {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (priority == Priority::Interactive)
+                  m_interactive.push_back(std::move(task));
+            else
+                  m_background.push_back(std::move(task));
+      }
+      m_cv.notify_one();
+}
+
+size_t WorkerPool::size() const
+{
+      std::lock_guard<std::mutex> lock(m_mutex);
+      return m_workers.size();
+}
+
+size_t WorkerPool::pending() const
+{
+      std::lock_guard<std::mutex> lock(m_mutex);
+      return m_interactive.size() + m_background.size();
+}
+
+size_t WorkerPool::pending(Priority priority) const
+{
+      std::lock_guard<std::mutex> lock(m_mutex);
+      return priority == Priority::Interactive ? m_interactive.size() : m_background.size();
+}
+
+// Called with m_mutex held and at least one task queued
+std::function<void()> WorkerPool::takeNext()
+{
+      bool backgroundsTurn = m_interactive.empty() || (!m_background.empty() && m_interactiveBurst >= MAX_INTERACTIVE_BURST);
+      std::deque<std::function<void()>> &queue = backgroundsTurn ? m_background : m_interactive;
+
+      if (backgroundsTurn || m_background.empty())
+            m_interactiveBurst = 0;
+      else
+            m_interactiveBurst++;
+
+      std::function<void()> task = std::move(queue.front());
+      queue.pop_front();
+      return task;
+}
+
+void WorkerPool::run()
+{
+      while (true)
+      {
+            std::function<void()> task;
+            {
+                  std::unique_lock<std::mutex> lock(m_mutex);
+                  m_cv.wait(lock, [this]
+                            { return m_stopping || !m_interactive.empty() || !m_background.empty(); });
+
+                  // Drain the queues before honoring a stop request
+                  if (m_interactive.empty() && m_background.empty())
+                        return;
+                  task = takeNext();
+            }
+
+            try
+            {
+                  task();
+            }
+            catch (const std::exception &e)
+            {
+                  // A failing task must not take the worker down
+                  LSPP_LOG(LogLevel::Error, std::string("Worker task failed: ") + e.what());
+            }
+            catch (...)
+            {
+                  LSPP_LOG(LogLevel::Error, "Worker task failed");
+            }
+      }
+}
@@ -1,79 +1,169 @@
 #include "textDocument.hpp"
-#include <sstream>
+#include <algorithm>
 
-textDocument::textDocument() : m_content("") {}
+textDocument::textDocument() : m_text(), m_flat(""), m_flatValid(true) {}
 
-textDocument::textDocument(const std::string &content) : m_content(content) {}
+textDocument::textDocument(const std::string &content) : m_text(content), m_flat(""), m_flatValid(false) {}
 
-std::string textDocument::getLine(int n)
-{
-      std::istringstream stream(m_content);
-      std::string line;
+textDocument::textDocument(const textDocument &other) : m_text(other.m_text), m_flat(), m_flatValid(false) {}
 
-      if (n < 0)
-            return "";
+textDocument &textDocument::operator=(const textDocument &other)
+{
+      if (this != &other)
+      {
+            m_text = other.m_text;
+            m_flat.clear();
+            m_flatValid = false;
+            m_lines.clear();
+      }
+      return *this;
+}
 
-      do
+const std::string &textDocument::getContent() const
+{
+      std::lock_guard<std::mutex> lock(m_flatMutex);
+      if (!m_flatValid)
       {
-            std::getline(stream, line);
-            n--;
-      } while (n >= 0 && stream.good());
+            m_flat = m_text.toString();
+            m_flatValid = true;
+      }
+      return m_flat;
+}
 
-      if (n == -1)
-            return line;
-      else
-            return "";
+void textDocument::setContent(const std::string &content)
+{
+      m_text = PieceTable(content);
+      m_flatValid = false;
+      m_lines.clear();
 }
 
-bool textDocument::isWordDelimiter(const char c)
+void textDocument::replace(size_t start, size_t length, const std::string &text)
 {
-      for (size_t i = 0; i < sizeof(word_delimiters); i++)
-            if (c == word_delimiters[i])
-                  return true;
+      m_text.replace(start, length, text);
+      m_flatValid = false;
+      m_lines.clear();
+}
 
-      return false;
+std::string textDocument::slice(size_t start, size_t length) const
+{
+      return m_text.slice(start, length);
 }
 
-std::string textDocument::wordUnderCursor(const int line, const int character)
+size_t textDocument::length() const
 {
-      std::string lineContents = getLine(line);
+      return m_text.length();
+}
 
-      if (character < 0 || character >= lineContents.length())
-            return "";
-      if (textDocument::isWordDelimiter(lineContents[character]))
+size_t textDocument::lineCount() const
+{
+      return m_text.lineCount();
+}
+
+// Offset one past the last character of `line`, excluding its '\n'
+size_t textDocument::lineEnd(size_t line) const
+{
+      if (line + 1 < m_text.lineCount())
+            return m_text.lineStart(line + 1) - 1;
+      return m_text.length();
+}
+
+std::string textDocument::getLine(int n) const
+{
+      if (n < 0 || static_cast<size_t>(n) >= m_text.lineCount())
             return "";
 
-      int word_start = character, word_end = character;
+      const size_t start = m_text.lineStart(n);
+      return m_text.slice(start, lineEnd(n) - start);
+}
+
+std::string_view textDocument::lineView(int n) const
+{
+      if (n < 0 || static_cast<size_t>(n) >= m_text.lineCount())
+            return {};
+
+      const size_t start = m_text.lineStart(n);
+      const size_t length = lineEnd(n) - start;
+      if (auto view = m_text.view(start, length))
+            return *view;
+
+      // The line spans several pieces: use the contiguous copy if there is one, otherwise
+      // copy just this line
+      std::lock_guard<std::mutex> lock(m_flatMutex);
+      if (m_flatValid)
+            return std::string_view(m_flat).substr(start, length);
+      auto [it, inserted] = m_lines.try_emplace(static_cast<size_t>(n));
+      if (inserted)
+            it->second = m_text.slice(start, length);
+      return it->second;
+}
 
-      while (word_start >= 0 && !textDocument::isWordDelimiter(lineContents.at(word_start)))
-      {
+bool textDocument::isWordDelimiter(const char c)
+{
+      return !defaultWordRules.isWordChar(c);
+}
+
+std::string_view textDocument::wordUnderCursor(const int line, const int column, PositionEncoding encoding, const WordRules &rules) const
+{
+      std::string_view lineContents = lineView(line);
+
+      if (column < 0)
+            return {};
+      const size_t character = encoding == PositionEncoding::UTF8 ? column : byteOffsetFromUnits(lineContents, column, encoding);
+      if (character >= lineContents.length())
+            return {};
+      if (!rules.isWordChar(lineContents[character]))
+            return {};
+
+      size_t word_start = character, word_end = character + 1;
+      while (word_start > 0 && rules.isWordChar(lineContents[word_start - 1]))
             word_start--;
-      }
-      while (word_end < lineContents.length() && !textDocument::isWordDelimiter(lineContents.at(word_end)))
-      {
+      while (word_end < lineContents.length() && rules.isWordChar(lineContents[word_end]))
             word_end++;
-      }
 
-      word_start++;
       return lineContents.substr(word_start, word_end - word_start);
 }
 
-int textDocument::findPos(const int line, const int character) const
+// Positions past the end of a line resolve to the end of that line, and lines
+// past the end of the document resolve to the end of the document.
+int textDocument::findPos(const int line, const int character, PositionEncoding encoding) const
 {
-      std::istringstream stream(m_content);
-      std::string lineContents;
-      int result = 0;
+      if (line < 0)
+            return 0;
+      if (static_cast<size_t>(line) >= m_text.lineCount())
+            return m_text.length();
+
+      const size_t start = m_text.lineStart(line);
+      const size_t length = lineEnd(line) - start;
+      const size_t units = static_cast<size_t>(std::max(character, 0));
+      if (encoding == PositionEncoding::UTF8 || m_text.isAscii(start, length))
+            return start + std::min(units, length);
+      return start + byteOffsetFromUnits(m_text.slice(start, length), units, encoding);
+}
 
-      for (int l = 0; l < line; l++)
-      {
-            std::getline(stream, lineContents);
-            result += lineContents.length() + 1; // Take into account \n character
-      }
+Position textDocument::positionAt(size_t offset, PositionEncoding encoding) const
+{
+      offset = std::min(offset, m_text.length());
+      const size_t line = m_text.lineAt(offset);
+      const size_t start = m_text.lineStart(line);
+      size_t character = offset - start;
+      if (encoding != PositionEncoding::UTF8 && !m_text.isAscii(start, character))
+            character = unitsFromByteOffset(m_text.slice(start, character), character, encoding);
+      return {static_cast<uint>(line), static_cast<uint>(character)};
+}
 
-      for (int c = 0; c < character; c++)
-      {
-            stream.get();
-            result++;
-      }
-      return result;
-}
\ No newline at end of file
+size_t textDocument::memoryUsage() const
+{
+      std::lock_guard<std::mutex> lock(m_flatMutex);
+      size_t lines = 0;
+      for (const auto &[line, text] : m_lines)
+            lines += sizeof(text) + text.capacity();
+      return sizeof(textDocument) + m_text.memoryUsage() + m_flat.capacity() + lines;
+}
+
+bool textDocument::lineIsAscii(size_t line) const
+{
+      if (line >= m_text.lineCount())
+            return true;
+      const size_t start = m_text.lineStart(line);
+      return m_text.isAscii(start, lineEnd(line) - start);
+}
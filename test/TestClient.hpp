@@ -3,11 +3,17 @@
 #include <sstream>
 #include <thread>
 #include <chrono>
+#include <mutex>
 #include <optional>
 #include <vector>
+#include <cerrno>
+#include <csignal>
+#include <unistd.h>
+#include <sys/wait.h>
 #include <nlohmann/json.hpp>
 
 #include "Server.hpp"
+#include "FrameReader.hpp"
 
 namespace testutil
 {
@@ -187,4 +193,128 @@ namespace testutil
             return {responses, code};
       }
 
+      /* A server process speaking LSP over pipes to its stdin and stdout */
+      class ServerProcess
+      {
+            pid_t m_pid = -1;
+            int m_toServer = -1;
+            int m_fromServer = -1;
+            std::mutex m_writeMutex;
+            FrameSplitter m_splitter;
+
+      public:
+            explicit ServerProcess(const std::vector<std::string> &command)
+            {
+                  int in[2], out[2];
+                  if (command.empty() || pipe(in) != 0)
+                        return;
+                  if (pipe(out) != 0)
+                  {
+                        close(in[0]);
+                        close(in[1]);
+                        return;
+                  }
+                  // A server that went away must show up as a failed send, not kill the client
+                  std::signal(SIGPIPE, SIG_IGN);
+
+                  m_pid = fork();
+                  if (m_pid == 0)
+                  {
+                        dup2(in[0], STDIN_FILENO);
+                        dup2(out[1], STDOUT_FILENO);
+                        close(in[0]);
+                        close(in[1]);
+                        close(out[0]);
+                        close(out[1]);
+                        std::vector<char *> argv;
+                        for (const auto &arg : command)
+                              argv.push_back(const_cast<char *>(arg.c_str()));
+                        argv.push_back(nullptr);
+                        execvp(argv[0], argv.data());
+                        _exit(127);
+                  }
+                  close(in[0]);
+                  close(out[1]);
+                  m_toServer = in[1];
+                  m_fromServer = out[0];
+            }
+
+            ~ServerProcess()
+            {
+                  wait();
+            }
+
+            ServerProcess(const ServerProcess &) = delete;
+            ServerProcess &operator=(const ServerProcess &) = delete;
+
+            bool running() const
+            {
+                  return m_pid > 0;
+            }
+
+            // Frames and writes one message, safe to call from several threads
+            bool send(const std::string &payloadJson)
+            {
+                  const std::string wire = makeWireMessage(payloadJson);
+                  std::lock_guard<std::mutex> lock(m_writeMutex);
+                  size_t written = 0;
+                  while (m_toServer >= 0 && written < wire.size())
+                  {
+                        ssize_t n = write(m_toServer, wire.data() + written, wire.size() - written);
+                        if (n < 0 && errno == EINTR)
+                              continue;
+                        if (n <= 0)
+                              return false;
+                        written += n;
+                  }
+                  return written == wire.size();
+            }
+
+            // Blocks for the next payload, std::nullopt once the server closed its output.
+            // Only one thread may receive.
+            std::optional<std::string> receive()
+            {
+                  char buffer[64 * 1024];
+                  while (true)
+                  {
+                        if (auto payload = m_splitter.next())
+                              return std::string(*payload);
+                        if (m_fromServer < 0)
+                              return std::nullopt;
+                        ssize_t n = read(m_fromServer, buffer, sizeof(buffer));
+                        if (n < 0 && errno == EINTR)
+                              continue;
+                        if (n <= 0)
+                              return std::nullopt;
+                        m_splitter.append(buffer, n);
+                  }
+            }
+
+            // Ends the server's input, so it sees end of file
+            void closeInput()
+            {
+                  std::lock_guard<std::mutex> lock(m_writeMutex);
+                  if (m_toServer >= 0)
+                        close(m_toServer);
+                  m_toServer = -1;
+            }
+
+            // Closes the pipes and returns the exit status, -1 if the server did not exit normally
+            int wait()
+            {
+                  closeInput();
+                  if (m_fromServer >= 0)
+                        close(m_fromServer);
+                  m_fromServer = -1;
+                  if (m_pid <= 0)
+                        return -1;
+
+                  int status = 0;
+                  while (waitpid(m_pid, &status, 0) < 0 && errno == EINTR)
+                        ;
+                  m_pid = -1;
+                  return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+            }
+      };
+
 } // namespace testutil
@@ -1,5 +1,6 @@
 #include <gtest/gtest.h>
 #include "ProtocolStructures.hpp"
+#include "Message.hpp"
 #include <fstream>
 #include <istream>
 
@@ -53,6 +54,78 @@ TEST(JSON, serialize_InitializeResult) {
 
       ASSERT_TRUE(j == expected);
 }
+TEST(JSON, writer_matches_dump) {
+      hoverResult h{{MarkupKind::Markdown, "quote \" slash \\ newline \n tab \t bell \x07 utf8 \xc3\xa9"}, Range{{1, 2}, {3, 4}}};
+      std::vector<Location> locations = {{"file:///a.cpp", {{0, 0}, {0, 5}}}, {"file:///b.cpp", {{10, 1}, {12, 0}}}};
+      std::optional<hoverResult> none;
+
+      std::string out;
+      JsonWriter w(out);
+      w.beginArray();
+      w.value(h);
+      w.value(locations);
+      w.value(none);
+      w.value(ServerInfo{"LSPP", "1.0"});
+      w.endArray();
+
+      ASSERT_EQ(json::array({h, locations, nullptr, json{{"name", "LSPP"}, {"version", "1.0"}}}).dump(), out);
+}
+TEST(JSON, writer_replaces_invalid_utf8_like_dump) {
+      const std::vector<std::string> inputs = {"\xff", "a\xc3", "\xc3\xa9\xe2\x82", "\xe2\x82\x28", "\xed\xa0\x80", "\xe0\x80\xaf",
+                                               "\xf0\x9f\x98", "\xf0\x9f\x98\x80", "\xf4\x90\x80\x80", "\xf8\x88\x80\x80\x80", "x\x80y"};
+      for (const std::string &input : inputs)
+      {
+            std::string out;
+            JsonWriter w(out);
+            w.value(input);
+            ASSERT_EQ(json(input).dump(-1, ' ', false, json::error_handler_t::replace), out) << out;
+            ASSERT_NO_THROW(json::parse(out));
+      }
+
+      // Responses built from a tree replace the same bytes instead of throwing
+      Response response(std::optional<RequestId>(1));
+      response.setResult(json("bad \xff byte"));
+      ASSERT_EQ("{\"id\":1,\"result\":\"bad \xef\xbf\xbd byte\"}", response.body());
+}
+
+TEST(JSON, reader_decodes_params) {
+      const std::string change = R"({"textDocument": {"uri": "file:///a.cpp", "version": 4},
+            "contentChanges": [{"range": {"start": {"line": 1, "character": 2}, "end": {"line": 1, "character": 4}}, "rangeLength": 2, "text": "a\n\"b\""},
+                               {"text": "whole", "extra": [1, {"x": null}]}]})";
+      DidChangeTextDocumentParams p;
+      JsonReader r(change);
+      ASSERT_TRUE(readJson(r, p));
+
+      DidChangeTextDocumentParams expected = json::parse(change);
+      ASSERT_EQ(expected.textDocument.uri, p.textDocument.uri);
+      ASSERT_EQ(2u, p.contentChanges.size());
+      ASSERT_EQ("a\n\"b\"", p.contentChanges[0].text);
+      ASSERT_EQ(expected.contentChanges[0].text, p.contentChanges[0].text);
+      ASSERT_TRUE(p.contentChanges[0].range.has_value());
+      ASSERT_EQ(1u, p.contentChanges[0].range->start.line);
+      ASSERT_EQ(4u, p.contentChanges[0].range->end.character);
+      ASSERT_EQ(2u, p.contentChanges[0].rangeLength.value());
+      ASSERT_FALSE(p.contentChanges[1].range.has_value());
+      ASSERT_EQ("whole", p.contentChanges[1].text);
+
+      hoverParams h;
+      JsonReader hr(R"({"workDoneToken": 7, "position": {"character": 3, "line": 9}, "textDocument": {"uri": "file:///b.cpp"}})");
+      ASSERT_TRUE(readJson(hr, h));
+      ASSERT_EQ("file:///b.cpp", h.textDocument.uri);
+      ASSERT_EQ(9u, h.position.line);
+      ASSERT_EQ(3u, h.position.character);
+      ASSERT_FALSE(h.workDoneToken.has_value());
+
+      WorkspaceSymbolParams ws;
+      JsonReader wr(R"({"partialResultToken": "p", "query": "pars\u0065"})");
+      ASSERT_TRUE(readJson(wr, ws));
+      ASSERT_EQ("parse", ws.query);
+
+      // Missing required members are rejected
+      Position missing;
+      JsonReader mr(R"({"line": 1})");
+      ASSERT_FALSE(readJson(mr, missing));
+}
 /*
 TEST(JSON, serialize_TYPE) {
       TYPE t{PARAMS};
@@ -1,5 +1,7 @@
 #include <gtest/gtest.h>
 #include "Message.hpp"
+#include "JsonReader.hpp"
+#include "Logger.hpp"
 #include <fstream>
 #include <istream>
 
@@ -81,6 +83,209 @@ TEST(Message, method_lookup)
       }
 }
 
+TEST(Message, method_lookup_covers_every_method)
+{
+      for (int i = Message::Method::NONE + 1; i < Message::METHOD_COUNT; i++)
+      {
+            auto method = static_cast<Message::Method>(i);
+            ASSERT_FALSE(Message::methodName(method).empty());
+            ASSERT_EQ(method, Message::stringToMethod(Message::methodName(method)));
+      }
+
+      // Near misses must not resolve to a protocol method
+      ASSERT_EQ(Message::Method::NONE, Message::stringToMethod(""));
+      ASSERT_EQ(Message::Method::NONE, Message::stringToMethod("textDocument/hove"));
+      ASSERT_EQ(Message::Method::NONE, Message::stringToMethod("textDocument/hoverx"));
+      ASSERT_EQ(Message::Method::NONE, Message::stringToMethod("custom/method"));
+      ASSERT_EQ("", Message::methodToString(Message::Method::NONE));
+}
+
+TEST(FrameReader, splitsStream)
+{
+      std::string big(100000, 'x');
+      std::istringstream s("Content-Length: 7\r\n\r\n{\"a\":1}"
+                           "content-length:   8\r\nContent-Type: application/vscode-jsonrpc; charset=utf-8\r\n\r\n{\"bb\":2}"
+                           "Content-Type: missing-length\r\n\r\n"
+                           "Content-Length: " + std::to_string(big.size()) + "\r\n\r\n" + big +
+                           "Content-Length: 7\r\n\r\n{\"c\":3}");
+      FrameReader reader(s, 16);
+      std::string_view payload;
+
+      ASSERT_EQ(7, reader.next(payload));
+      ASSERT_EQ("{\"a\":1}", payload);
+      ASSERT_EQ(8, reader.next(payload));
+      ASSERT_EQ("{\"bb\":2}", payload);
+      ASSERT_EQ("content-length:   8\r\nContent-Type: application/vscode-jsonrpc; charset=utf-8\r\n\r\n{\"bb\":2}", reader.frame());
+      ASSERT_EQ(0, reader.next(payload)); // Skipped, no Content-Length
+      ASSERT_EQ(static_cast<int>(big.size()), reader.next(payload));
+      ASSERT_EQ(big, payload);
+      ASSERT_EQ("Content-Length: " + std::to_string(big.size()) + "\r\n\r\n" + big, reader.frame());
+      ASSERT_EQ(7, reader.next(payload));
+      ASSERT_EQ("{\"c\":3}", payload);
+      ASSERT_EQ(-1, reader.next(payload));
+}
+
+TEST(FrameReader, truncatedPayload)
+{
+      std::istringstream s("Content-Length: 50\r\n\r\n{\"a\":1}");
+      FrameReader reader(s);
+      std::string_view payload;
+
+      ASSERT_EQ(-1, reader.next(payload));
+      ASSERT_TRUE(payload.empty());
+}
+
+TEST(FrameSplitter, skipsMalformedHeaders)
+{
+      const std::string wire = "Content-Type: missing-length\r\n\r\n"
+                               "Content-Length: 7\r\n\r\n{\"a\":1}"
+                               "Content-Length: 8\r\n\r\n{\"bb\":2}";
+      FrameSplitter splitter;
+      // Fed a byte at a time, as a slow pipe would
+      for (size_t i = 0; i + 3 < wire.size(); i++)
+      {
+            splitter.append(&wire[i], 1);
+            if (auto payload = splitter.next())
+            {
+                  ASSERT_EQ("{\"a\":1}", *payload);
+            }
+      }
+      splitter.append(wire.data() + wire.size() - 3, 3);
+      ASSERT_EQ("{\"bb\":2}", splitter.next());
+      ASSERT_FALSE(splitter.next().has_value());
+}
+
+TEST(Message, readFromFrameReader)
+{
+      std::istringstream s("Content-Length: 54\r\n\r\n{\"jsonrpc\":\"2.0\",\"id\":4,\"method\":\"textDocument/hover\"}");
+      FrameReader reader(s);
+      Message m;
+
+      ASSERT_EQ(54, m.readMessage(reader));
+      ASSERT_EQ(Message::Method::HOVER, m.method());
+      ASSERT_EQ(4, m.id());
+
+      // Copies own their payload
+      Message copy = m;
+      copy.detach();
+      ASSERT_NE(m.payload().data(), copy.payload().data());
+      ASSERT_EQ(m.payload(), copy.payload());
+}
+
+TEST(JsonReader, scansWithoutTree)
+{
+      JsonReader reader(R"( {"skip": {"a": [1, "]}", {"b": null}], "c": "\"}"}, "n": -12, "s": "tab\there é😀", "t": true} )");
+      std::string_view key;
+      std::string text;
+      int64_t n;
+      bool b;
+
+      ASSERT_TRUE(reader.beginObject());
+      ASSERT_TRUE(reader.findMember("n"));
+      ASSERT_TRUE(reader.readInt(n));
+      ASSERT_EQ(-12, n);
+      ASSERT_TRUE(reader.nextMember(key));
+      ASSERT_EQ("s", key);
+      ASSERT_TRUE(reader.readString(text));
+      ASSERT_EQ("tab\there \xc3\xa9\xf0\x9f\x98\x80", text);
+      ASSERT_TRUE(reader.nextMember(key));
+      ASSERT_TRUE(reader.readBool(b));
+      ASSERT_TRUE(b);
+      ASSERT_FALSE(reader.nextMember(key));
+      ASSERT_TRUE(reader.ok());
+
+      JsonReader broken(R"({"a": "unterminated})");
+      ASSERT_TRUE(broken.beginObject());
+      ASSERT_FALSE(broken.findMember("b"));
+      ASSERT_FALSE(broken.ok());
+}
+
+TEST(Message, routingFieldsWithoutParams)
+{
+      const std::string payload = R"({"params":{"position":{"line":1},"textDocument":{"version":3,"uri":"file:///a\/b.cpp"}},"method":"textDocument/hover","jsonrpc":"2.0","id":12})";
+      std::istringstream s("Content-Length: " + std::to_string(payload.size()) + "\r\n\r\n" + payload);
+      Message m(s);
+
+      ASSERT_TRUE(m.isValid());
+      ASSERT_EQ("2.0", m.jsonrpc());
+      ASSERT_EQ(12, m.id());
+      ASSERT_EQ("textDocument/hover", m.method_description());
+      ASSERT_EQ("file:///a/b.cpp", m.documentURI());
+      ASSERT_EQ(R"({"position":{"line":1},"textDocument":{"version":3,"uri":"file:///a\/b.cpp"}})", m.paramsSpan());
+      ASSERT_EQ(1, m.params()["position"]["line"]);
+
+      std::istringstream notJson("Content-Length: 5\r\n\r\n[1,2]");
+      Message invalid(notJson);
+      ASSERT_FALSE(invalid.isValid());
+      ASSERT_EQ(Message::Method::NONE, invalid.method());
+      ASSERT_FALSE(invalid.id().has_value());
+      ASSERT_TRUE(invalid.params().empty());
+}
+
+TEST(Message, readsIdsInRequestIdRange)
+{
+      auto read = [](const std::string &json)
+      {
+            JsonReader reader(json);
+            std::optional<RequestId> id;
+            if (reader.beginObject() && reader.findMember("id"))
+                  id = Message::readId(reader);
+            return id;
+      };
+      ASSERT_EQ(-7, read(R"({"id": -7})"));
+      ASSERT_EQ(2147483647, read(R"({"id": 2147483647})"));
+      // Truncating would make these collide with ids 3 and 0
+      ASSERT_FALSE(read(R"({"id": 4294967299})").has_value());
+      ASSERT_FALSE(read(R"({"id": -4294967296})").has_value());
+      ASSERT_FALSE(read(R"({"id": "3"})").has_value());
+
+      const std::string payload = R"({"jsonrpc":"2.0","id":4294967299,"method":"shutdown"})";
+      std::istringstream s("Content-Length: " + std::to_string(payload.size()) + "\r\n\r\n" + payload);
+      Message m(s);
+      ASSERT_TRUE(m.isValid());
+      ASSERT_FALSE(m.id().has_value());
+      ASSERT_EQ(Message::Method::SHUTDOWN, m.method());
+}
+
+TEST(Logger, filtersLevelsAndFormatsLazily)
+{
+      std::string path = ::testing::TempDir() + "lspp_logger_test.log";
+      std::remove(path.c_str());
+
+      int formatted = 0;
+      auto expensive = [&formatted](const std::string &text)
+      {
+            formatted++;
+            return text;
+      };
+      {
+            Logger logger(path, LogLevel::Info);
+            ASSERT_FALSE(logger.enabled(LogLevel::Debug));
+            if (logger.enabled(LogLevel::Debug))
+                  logger.write(LogLevel::Debug, expensive("hidden"));
+            for (int i = 0; i < 100; i++)
+                  logger.write(LogLevel::Info, "line " + std::to_string(i));
+            logger.write(LogLevel::Error, expensive("broken"));
+            logger.flush();
+            ASSERT_EQ(0u, logger.dropped());
+      }
+      ASSERT_EQ(1, formatted);
+
+      std::ifstream file(path);
+      std::string line;
+      std::vector<std::string> lines;
+      while (std::getline(file, line))
+            lines.push_back(line);
+      ASSERT_EQ(101u, lines.size());
+      ASSERT_NE(std::string::npos, lines[0].find("info>>line 0"));
+      ASSERT_NE(std::string::npos, lines[99].find("info>>line 99"));
+      ASSERT_NE(std::string::npos, lines[100].find("error>>broken"));
+
+      ASSERT_EQ(LogLevel::Warning, Logger::parseLevel("warning", LogLevel::Info));
+      ASSERT_EQ(LogLevel::Info, Logger::parseLevel("loud", LogLevel::Info));
+      std::remove(path.c_str());
+}
+
 int main()
 {
       ::testing::InitGoogleTest();
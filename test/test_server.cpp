@@ -3,9 +3,18 @@
 #include <string>
 #include <thread>
 #include <chrono>
+#include <atomic>
+#include <future>
+#include <mutex>
+#include <vector>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <set>
 
 #include "Server.hpp"
 #include "Message.hpp"
+#include "SessionReplay.hpp"
 #include "TestClient.hpp"
 
 
@@ -57,6 +66,33 @@ TEST(Server, RespondsToInitialize) {
 
 }
 
+TEST(Server, NegotiatesPositionEncoding) {
+      auto negotiate = [](const std::string &params)
+      {
+            std::istringstream wire(testutil::makeWireMessage(R"({"jsonrpc": "2.0", "id": 1, "method": "initialize", "params": )" + params + "}"));
+            return LSPServer::negotiatePositionEncoding(Message(wire));
+      };
+      auto offering = [](const std::string &encodings)
+      {
+            return R"({"capabilities": {"general": {"positionEncodings": )" + encodings + "}}}";
+      };
+      ASSERT_EQ(PositionEncoding::UTF8, negotiate(offering(R"(["utf-16", "utf-8"])")));
+      ASSERT_EQ(PositionEncoding::UTF32, negotiate(offering(R"(["utf-32", "utf-16"])")));
+      ASSERT_EQ(PositionEncoding::UTF16, negotiate(offering(R"(["latin-1"])")));
+      ASSERT_EQ(PositionEncoding::UTF16, negotiate("{}"));
+
+      LSPServer server;
+      std::istringstream in(testutil::makeWireMessage(R"({"jsonrpc": "2.0", "id": 1, "method": "initialize", "params": {"capabilities": {"general": {"positionEncodings": ["utf-8"]}}}})") +
+                            testutil::makeWireMessage(R"({"jsonrpc": "2.0", "method": "exit"})"));
+      std::ostringstream out;
+      server.init(ServerCapabilities::hoverProvider, in, out);
+      server.exit();
+
+      auto responses = testutil::parseAllResponses(out.str());
+      ASSERT_EQ("utf-8", responses[0]["result"]["capabilities"]["positionEncoding"]);
+      ASSERT_EQ(PositionEncoding::UTF8, server.positionEncoding());
+}
+
 TEST(Server, AdvertisesOnlyInitCapabilities) {
 	const std::string payload = R"({
 		"jsonrpc": "2.0",
@@ -235,4 +271,798 @@ TEST(Server, RequestAfterShutdownReturnsInvalidRequest) {
 
       // 4) exit after shutdown should be OK and server exit code 0
       ASSERT_EQ(0, batch.serverExitCode);
-}
\ No newline at end of file
+}
+
+TEST(CancellationRegistry, RegistrationRemovesTheRequest) {
+      CancellationRegistry registry;
+      {
+            CancellationRegistry::Registration registration(registry, 7);
+            registry.add(7);
+            ASSERT_TRUE(registry.cancel(7));
+      }
+      ASSERT_FALSE(registry.cancel(7));
+
+      try
+      {
+            CancellationRegistry::Registration registration(registry, 8);
+            registry.add(8);
+            throw std::runtime_error("handler failed");
+      }
+      catch (const std::runtime_error &)
+      {
+      }
+      ASSERT_FALSE(registry.cancel(8));
+}
+
+TEST(Server, DropsMalformedDidChange) {
+      LSPServer server;
+      server.registerCallback<hoverParams, std::optional<hoverResult>>(
+          Message::Method::HOVER,
+          [](const hoverParams &) -> std::optional<hoverResult>
+          {
+                return hoverResult{{MarkupKind::PlainText, "still here"}, std::nullopt};
+          });
+
+      std::istringstream in(testutil::makeWireMessage(R"({"jsonrpc": "2.0", "id": 1, "method": "initialize", "params": {}})") +
+                            testutil::makeWireMessage(R"({"jsonrpc": "2.0", "method": "textDocument/didOpen", "params": {"textDocument": {"uri": "file:///a.c", "languageId": "c", "version": 1, "text": "abc"}}})") +
+                            testutil::makeWireMessage(R"({"jsonrpc": "2.0", "method": "textDocument/didChange", "params": {"textDocument": {"uri": "file:///a.c"}, "contentChanges": [{"text": "lost"}]}})") +
+                            testutil::makeWireMessage(R"({"jsonrpc": "2.0", "id": 2, "method": "textDocument/hover", "params": {"textDocument": {"uri": "file:///a.c"}, "position": {"line": 0, "character": 0}}})"));
+      std::ostringstream out;
+      server.init(ServerCapabilities::hoverProvider, in, out);
+      server.exit();
+
+      auto responses = testutil::parseAllResponses(server.getOutputSafe(&out));
+      ASSERT_EQ(2u, responses.size());
+      ASSERT_EQ(2, responses[1]["id"]);
+      ASSERT_EQ("still here", responses[1]["result"]["contents"]["value"]);
+}
+
+TEST(Server, AnswersRequestsWhoseCallbackThrows) {
+      for (size_t workers : {0, 1})
+      {
+            LSPServer server;
+            server.registerCallback<hoverParams, std::optional<hoverResult>>(
+                Message::Method::HOVER,
+                [](const hoverParams &) -> std::optional<hoverResult>
+                { throw std::runtime_error("broken"); });
+
+            std::istringstream in(testutil::makeWireMessage(R"({"jsonrpc": "2.0", "id": 1, "method": "initialize", "params": {}})") +
+                                  testutil::makeWireMessage(R"({"jsonrpc": "2.0", "id": 2, "method": "textDocument/hover", "params": {"textDocument": {"uri": "file:///a.c"}, "position": "nowhere"}})") +
+                                  testutil::makeWireMessage(R"({"jsonrpc": "2.0", "id": 3, "method": "textDocument/hover", "params": {"textDocument": {"uri": "file:///a.c"}, "position": {"line": 0, "character": 0}}})"));
+            std::ostringstream out;
+            server.init(ServerCapabilities::hoverProvider, in, out, workers);
+            server.exit();
+
+            auto responses = testutil::parseAllResponses(server.getOutputSafe(&out));
+            ASSERT_EQ(3u, responses.size());
+            std::sort(responses.begin(), responses.end(), [](const nlohmann::json &a, const nlohmann::json &b)
+                      { return a["id"] < b["id"]; });
+            ASSERT_EQ(-32602, responses[1]["error"]["code"]);
+            ASSERT_EQ(-32603, responses[2]["error"]["code"]);
+      }
+}
+
+TEST(Server, WorkerPoolDoesNotBlockOnSlowRequests) {
+      LSPServer server;
+      server.registerCallback<textDocumentPositionParams, std::optional<hoverResult>>(
+          Message::Method::REFERENCES,
+          [](const textDocumentPositionParams &) -> std::optional<hoverResult>
+          {
+                std::this_thread::sleep_for(std::chrono::milliseconds(300));
+                return hoverResult{{MarkupKind::PlainText, "slow"}, std::nullopt};
+          });
+      server.registerCallback<hoverParams, std::optional<hoverResult>>(
+          Message::Method::HOVER,
+          [](const hoverParams &) -> std::optional<hoverResult>
+          {
+                return hoverResult{{MarkupKind::PlainText, "fast"}, std::nullopt};
+          });
+
+      const std::string position = R"("params": {"textDocument": {"uri": "file:///tmp/x.cpp"}, "position": {"line": 0, "character": 0}})";
+      std::istringstream in(testutil::makeWireMessage(R"({"jsonrpc": "2.0", "id": 1, "method": "initialize", "params": {}})") +
+                            testutil::makeWireMessage(R"({"jsonrpc": "2.0", "id": 2, "method": "textDocument/references", )" + position + "}") +
+                            testutil::makeWireMessage(R"({"jsonrpc": "2.0", "id": 3, "method": "textDocument/hover", )" + position + "}"));
+      std::ostringstream out;
+
+      server.init(ServerCapabilities::hoverProvider | ServerCapabilities::referencesProvider, in, out, 2);
+      server.exit();
+
+      auto responses = testutil::parseAllResponses(server.getOutputSafe(&out));
+      ASSERT_EQ(3u, responses.size());
+      ASSERT_EQ(1, responses[0]["id"]);
+      // The hover was queued behind the slow request but answered first
+      ASSERT_EQ(3, responses[1]["id"]);
+      ASSERT_EQ("fast", responses[1]["result"]["contents"]["value"]);
+      ASSERT_EQ(2, responses[2]["id"]);
+      ASSERT_EQ("slow", responses[2]["result"]["contents"]["value"]);
+}
+
+TEST(Server, CancelledRequestsReturnRequestCancelled) {
+      LSPServer server;
+      std::atomic<bool> hoverRan(false);
+      server.registerCallback<textDocumentPositionParams, std::optional<hoverResult>>(
+          Message::Method::REFERENCES,
+          [](const textDocumentPositionParams &, const RequestContext &context) -> std::optional<hoverResult>
+          {
+                // Poll for cancellation instead of sleeping the full duration
+                for (int i = 0; i < 2000 && !context.cancellation.isCancelled(); i++)
+                      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                return hoverResult{{MarkupKind::PlainText, "slow"}, std::nullopt};
+          });
+      server.registerCallback<hoverParams, std::optional<hoverResult>>(
+          Message::Method::HOVER,
+          [&hoverRan](const hoverParams &) -> std::optional<hoverResult>
+          {
+                hoverRan = true;
+                return hoverResult{{MarkupKind::PlainText, "fast"}, std::nullopt};
+          });
+
+      const std::string position = R"("params": {"textDocument": {"uri": "file:///tmp/x.cpp"}, "position": {"line": 0, "character": 0}})";
+      std::istringstream in(testutil::makeWireMessage(R"({"jsonrpc": "2.0", "id": 1, "method": "initialize", "params": {}})") +
+                            testutil::makeWireMessage(R"({"jsonrpc": "2.0", "id": 2, "method": "textDocument/references", )" + position + "}") +
+                            testutil::makeWireMessage(R"({"jsonrpc": "2.0", "id": 3, "method": "textDocument/hover", )" + position + "}") +
+                            testutil::makeWireMessage(R"({"jsonrpc": "2.0", "method": "$/cancelRequest", "params": {"id": 3}})") +
+                            testutil::makeWireMessage(R"({"jsonrpc": "2.0", "method": "$/cancelRequest", "params": {"id": 2}})"));
+      std::ostringstream out;
+
+      auto start = std::chrono::steady_clock::now();
+      // A single worker keeps the hover queued behind the slow request
+      server.init(ServerCapabilities::hoverProvider | ServerCapabilities::referencesProvider, in, out, 1);
+      server.exit();
+      ASSERT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(1500));
+
+      auto responses = testutil::parseAllResponses(server.getOutputSafe(&out));
+      ASSERT_EQ(3u, responses.size());
+      ASSERT_EQ(2, responses[1]["id"]);
+      ASSERT_EQ(-32800, responses[1]["error"]["code"].get<int>());
+      ASSERT_EQ(3, responses[2]["id"]);
+      ASSERT_EQ(-32800, responses[2]["error"]["code"].get<int>());
+      // The queued hover was dropped without running its handler
+      ASSERT_FALSE(hoverRan);
+}
+
+TEST(WorkerPool, InteractiveFirstWithBoundedStarvation) {
+      WorkerPool pool;
+      pool.start(1);
+
+      std::mutex orderMutex;
+      std::vector<std::string> order;
+      auto record = [&](std::string name)
+      {
+            return [&, name]
+            {
+                  std::lock_guard<std::mutex> lock(orderMutex);
+                  order.push_back(name);
+            };
+      };
+
+      // Hold the only worker so everything below queues up
+      std::promise<void> release;
+      std::shared_future<void> released = release.get_future().share();
+      pool.submit([released]
+                  { released.wait(); });
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+      pool.submit(record("background"), WorkerPool::Priority::Background);
+      for (size_t i = 0; i < WorkerPool::MAX_INTERACTIVE_BURST + 2; i++)
+            pool.submit(record("interactive"));
+      ASSERT_EQ(1u, pool.pending(WorkerPool::Priority::Background));
+
+      release.set_value();
+      pool.stop();
+
+      ASSERT_EQ(WorkerPool::MAX_INTERACTIVE_BURST + 3, order.size());
+      // Background work waits for interactive work, but only for a bounded burst of it
+      for (size_t i = 0; i < WorkerPool::MAX_INTERACTIVE_BURST; i++)
+            ASSERT_EQ("interactive", order[i]);
+      ASSERT_EQ("background", order[WorkerPool::MAX_INTERACTIVE_BURST]);
+}
+
+TEST(Server, InteractiveRequestsOvertakeBackgroundWork) {
+      ASSERT_EQ(WorkerPool::Priority::Interactive, LSPServer::defaultPriorityForMethod(Message::Method::HOVER));
+      ASSERT_EQ(WorkerPool::Priority::Background, LSPServer::defaultPriorityForMethod(Message::Method::TEXT_DOCUMENT_SEMANTIC_TOKENS_FULL));
+
+      LSPServer server;
+      auto respond = [](std::string name, int delayMs)
+      {
+            return std::function<std::string(const nlohmann::json &)>([name, delayMs](const nlohmann::json &)
+                                                                      {
+                                                                            std::this_thread::sleep_for(std::chrono::milliseconds(delayMs));
+                                                                            return name; });
+      };
+      server.registerCallback<nlohmann::json, std::string>("custom/slow", respond("slow", 200));
+      server.registerCallback<nlohmann::json, std::string>("custom/index", respond("index", 0));
+      server.registerCallback<nlohmann::json, std::string>("custom/lookup", respond("lookup", 0));
+      server.setMethodPriority("custom/index", WorkerPool::Priority::Background);
+
+      std::istringstream in(testutil::makeWireMessage(R"({"jsonrpc": "2.0", "id": 1, "method": "initialize", "params": {}})") +
+                            testutil::makeWireMessage(R"({"jsonrpc": "2.0", "id": 2, "method": "custom/slow", "params": {}})") +
+                            testutil::makeWireMessage(R"({"jsonrpc": "2.0", "id": 3, "method": "custom/index", "params": {}})") +
+                            testutil::makeWireMessage(R"({"jsonrpc": "2.0", "id": 4, "method": "custom/lookup", "params": {}})"));
+      std::ostringstream out;
+
+      server.init(0, in, out, 1);
+      server.exit();
+
+      auto responses = testutil::parseAllResponses(server.getOutputSafe(&out));
+      ASSERT_EQ(4u, responses.size());
+      ASSERT_EQ("slow", responses[1]["result"]);
+      // The lookup arrived after the background request but ran before it
+      ASSERT_EQ("lookup", responses[2]["result"]);
+      ASSERT_EQ("index", responses[3]["result"]);
+}
+
+TEST(ChangeCoalescer, FlushesWithoutCallback) {
+      ChangeCoalescer coalescer;
+      ASSERT_NO_THROW(coalescer.flush());
+      coalescer.setCallback(nullptr, std::chrono::milliseconds(0), std::chrono::milliseconds(0));
+      coalescer.documentChanged("file:///a.c", {{0, 0}, {0, 0}}, "x");
+      ASSERT_NO_THROW(coalescer.flush());
+}
+
+TEST(ChangeCoalescer, ShiftsAndMergesDirtyRanges) {
+      std::vector<Range> dirty;
+      // "hello\nworld\n" -> "hello\nwoXrld\n"
+      ChangeCoalescer::applyEdit(dirty, {{1, 2}, {1, 2}}, "X", PositionEncoding::UTF16);
+      ASSERT_EQ(1u, dirty.size());
+
+      // Inserting two lines at the top moves the earlier range down, keeping its columns
+      ChangeCoalescer::applyEdit(dirty, {{0, 0}, {0, 0}}, "a\nb\n", PositionEncoding::UTF16);
+      ASSERT_EQ(2u, dirty.size());
+      ASSERT_EQ(0u, dirty[0].start.line);
+      ASSERT_EQ(2u, dirty[0].end.line);
+      ASSERT_EQ(0u, dirty[0].end.character);
+      ASSERT_EQ(3u, dirty[1].start.line);
+      ASSERT_EQ(2u, dirty[1].start.character);
+      ASSERT_EQ(3u, dirty[1].end.character);
+
+      // An edit spanning both ranges merges them into one
+      ChangeCoalescer::applyEdit(dirty, {{1, 0}, {3, 2}}, "", PositionEncoding::UTF16);
+      ASSERT_EQ(1u, dirty.size());
+      ASSERT_EQ(0u, dirty[0].start.line);
+      ASSERT_EQ(1u, dirty[0].end.line);
+      ASSERT_EQ(1u, dirty[0].end.character);
+
+      // Non-ASCII text advances by code units of the negotiated encoding, not bytes:
+      // "é" is 2 bytes and 1 UTF-16 unit, "😀" is 4 bytes, 2 UTF-16 units and 1 UTF-32 unit
+      std::vector<Range> units;
+      ChangeCoalescer::applyEdit(units, {{0, 3}, {0, 3}}, "é😀", PositionEncoding::UTF16);
+      ASSERT_EQ(3u, units[0].start.character);
+      ASSERT_EQ(6u, units[0].end.character);
+      units.clear();
+      ChangeCoalescer::applyEdit(units, {{0, 3}, {0, 3}}, "é😀", PositionEncoding::UTF32);
+      ASSERT_EQ(5u, units[0].end.character);
+      units.clear();
+      ChangeCoalescer::applyEdit(units, {{0, 3}, {0, 3}}, "x\n\té😀", PositionEncoding::UTF16);
+      ASSERT_EQ(1u, units[0].end.line);
+      ASSERT_EQ(4u, units[0].end.character);
+      units.clear();
+      ChangeCoalescer::applyEdit(units, {{0, 3}, {0, 3}}, "é😀", PositionEncoding::UTF8);
+      ASSERT_EQ(9u, units[0].end.character);
+}
+
+TEST(DocumentHandler, SnapshotsAreUnaffectedByLaterEdits) {
+      DocumentHandler documents;
+      ASSERT_TRUE(documents.openDocument("file:///a.txt", "hello\nworld\n", 1));
+
+      auto before = documents.getOpenDocument("file:///a.txt");
+      ASSERT_TRUE(before.has_value());
+      ASSERT_EQ(1, before->version());
+
+      DidChangeTextDocumentParams params = nlohmann::json::parse(R"({"textDocument": {"uri": "file:///a.txt", "version": 2},
+            "contentChanges": [{"range": {"start": {"line": 1, "character": 0}, "end": {"line": 1, "character": 5}}, "text": "there"}]})");
+      ASSERT_TRUE(documents.updateDocument("file:///a.txt", params));
+
+      auto after = documents.getOpenDocument("file:///a.txt");
+      ASSERT_EQ(2, after->version());
+      ASSERT_EQ("hello\nthere\n", after->get().getContent());
+      ASSERT_EQ("hello\nworld\n", before->get().getContent());
+      ASSERT_EQ("world", before->get().wordUnderCursor(1, 2, PositionEncoding::UTF8));
+
+      // Closing drops the document, but not the snapshots still held
+      ASSERT_TRUE(documents.closeDocument("file:///a.txt"));
+      ASSERT_FALSE(documents.getOpenDocument("file:///a.txt").has_value());
+      ASSERT_EQ("hello\nthere\n", after->get().getContent());
+}
+
+TEST(DocumentHandler, ConcurrentReadersSeeOnlyPublishedVersions) {
+      DocumentHandler documents;
+      const int count = 64;
+      for (int i = 0; i < count; i++)
+            documents.openDocument("file:///doc" + std::to_string(i), "0", 0);
+
+      std::atomic<bool> running(true);
+      std::atomic<bool> consistent(true);
+      std::vector<std::thread> readers;
+      for (int r = 0; r < 4; r++)
+      {
+            readers.emplace_back([&, r]
+                                 {
+                                       for (int i = r; running; i++)
+                                       {
+                                             auto snapshot = documents.getOpenDocument("file:///doc" + std::to_string(i % count));
+                                             // Version n of every document reads "n"
+                                             if (!snapshot || snapshot->get().getContent() != std::to_string(snapshot->version()))
+                                                   consistent = false;
+                                       } });
+      }
+
+      for (int version = 1; version <= 50; version++)
+      {
+            for (int i = 0; i < count; i++)
+            {
+                  DidChangeTextDocumentParams params;
+                  params.textDocument.uri = "file:///doc" + std::to_string(i);
+                  params.textDocument.version = version;
+                  params.contentChanges.push_back({std::nullopt, std::nullopt, std::to_string(version)});
+                  ASSERT_TRUE(documents.updateDocument(params.textDocument.uri, params));
+            }
+      }
+      running = false;
+      for (auto &reader : readers)
+            reader.join();
+
+      ASSERT_TRUE(consistent);
+      ASSERT_EQ(50, documents.getOpenDocument("file:///doc7")->version());
+}
+
+TEST(DocumentHandler, InternsUrisIntoStableHandles) {
+      DocumentHandler documents;
+      ASSERT_FALSE(documents.findHandle("file:///a.txt").has_value());
+
+      DocumentHandle a = documents.handleFor("file:///a.txt");
+      DocumentHandle b = documents.handleFor("file:///b.txt");
+      ASSERT_NE(a, b);
+      ASSERT_EQ(a, documents.handleFor("file:///a.txt"));
+      ASSERT_EQ("file:///b.txt", documents.uriFor(b));
+
+      ASSERT_TRUE(documents.openDocument(a, "alpha", 3));
+      ASSERT_TRUE(documents.documentIsOpen("file:///a.txt"));
+      ASSERT_EQ("alpha", documents.getOpenDocument("file:///a.txt")->get().getContent());
+      ASSERT_FALSE(documents.documentIsOpen(b));
+
+      // Closing releases the handle for good, reopening assigns a new one
+      ASSERT_TRUE(documents.closeDocument(a));
+      ASSERT_FALSE(documents.getOpenDocument(a).has_value());
+      ASSERT_FALSE(documents.uriFor(a).has_value());
+      ASSERT_FALSE(documents.findHandle("file:///a.txt").has_value());
+      ASSERT_FALSE(documents.closeDocument(a));
+      ASSERT_TRUE(documents.openDocument("file:///a.txt", "again"));
+      DocumentHandle reopened = *documents.findHandle("file:///a.txt");
+      ASSERT_NE(a, reopened);
+      ASSERT_FALSE(documents.getOpenDocument(a).has_value());
+      ASSERT_EQ("again", documents.getOpenDocument(reopened)->get().getContent());
+      ASSERT_EQ("file:///a.txt", documents.uriFor(reopened));
+      ASSERT_FALSE(documents.uriFor(12345).has_value());
+}
+
+TEST(DocumentHandler, IndexesIdentifiersAcrossEdits) {
+      DocumentHandler documents;
+      documents.enableIdentifierIndex();
+      DocumentHandle handle = documents.handleFor("file:///a.c");
+      ASSERT_TRUE(documents.openDocument(handle, "int x;\nx = 1;\n", 1));
+      ASSERT_EQ(2u, documents.findIdentifier(handle, "x").size());
+      auto before = documents.getIdentifierIndex(handle);
+
+      DidChangeTextDocumentParams params = nlohmann::json::parse(R"({"textDocument": {"uri": "file:///a.c", "version": 2},
+            "contentChanges": [{"range": {"start": {"line": 1, "character": 0}, "end": {"line": 1, "character": 0}}, "text": "y = x;\n"}]})");
+      ASSERT_TRUE(documents.updateDocument(handle, params));
+
+      auto locations = documents.findIdentifier(handle, "x");
+      ASSERT_EQ(3u, locations.size());
+      ASSERT_EQ("file:///a.c", locations[2].uri);
+      ASSERT_EQ(2u, locations[2].range.start.line);
+      ASSERT_EQ(1u, documents.findIdentifier(handle, "y").size());
+      // The index of the previous version is left as it was
+      ASSERT_EQ(2u, before->occurrences("x").size());
+      ASSERT_NE(before, documents.getIdentifierIndex(handle));
+
+      documents.closeDocument(handle);
+      ASSERT_TRUE(documents.findIdentifier(handle, "x").empty());
+}
+
+TEST(Server, DocumentSettledAfterQuietPeriod) {
+      LSPServer server;
+      std::mutex settledMutex;
+      std::vector<std::pair<std::string, std::vector<Range>>> settled;
+      server.onDocumentSettled([&](const std::string &uri, const std::vector<Range> &dirty)
+                               {
+                                     std::lock_guard<std::mutex> lock(settledMutex);
+                                     settled.emplace_back(uri, dirty); },
+                               std::chrono::milliseconds(20), std::chrono::milliseconds(1000));
+      // Keeps the server alive long enough for the quiet period to pass
+      server.registerCallback<nlohmann::json, std::string>("custom/wait", std::function<std::string(const nlohmann::json &)>([](const nlohmann::json &)
+                                                                                                                            {
+                                                                                                                                  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+                                                                                                                                  return std::string("done"); }));
+
+      std::istringstream in(testutil::makeWireMessage(R"({"jsonrpc": "2.0", "id": 1, "method": "initialize", "params": {}})") +
+                            testutil::makeWireMessage(R"({"jsonrpc": "2.0", "method": "textDocument/didOpen", "params": {"textDocument": {"uri": "file:///a.txt", "languageId": "plaintext", "version": 1, "text": "hello\nworld\n"}}})") +
+                            testutil::makeWireMessage(R"({"jsonrpc": "2.0", "method": "textDocument/didChange", "params": {"textDocument": {"uri": "file:///a.txt", "version": 2}, "contentChanges": [{"range": {"start": {"line": 0, "character": 0}, "end": {"line": 0, "character": 0}}, "text": "XX"}]}})") +
+                            testutil::makeWireMessage(R"({"jsonrpc": "2.0", "method": "textDocument/didChange", "params": {"textDocument": {"uri": "file:///a.txt", "version": 3}, "contentChanges": [{"range": {"start": {"line": 1, "character": 5}, "end": {"line": 1, "character": 5}}, "text": "Y"}]}})") +
+                            testutil::makeWireMessage(R"({"jsonrpc": "2.0", "id": 2, "method": "custom/wait", "params": {}})"));
+      std::ostringstream out;
+
+      server.init(0, in, out, 1);
+      server.exit();
+
+      std::lock_guard<std::mutex> lock(settledMutex);
+      // Both edits are reported together, once
+      ASSERT_EQ(1u, settled.size());
+      ASSERT_EQ("file:///a.txt", settled[0].first);
+      const std::vector<Range> &dirty = settled[0].second;
+      ASSERT_EQ(2u, dirty.size());
+      ASSERT_EQ(0u, dirty[0].start.line);
+      ASSERT_EQ(2u, dirty[0].end.character);
+      ASSERT_EQ(1u, dirty[1].start.line);
+      ASSERT_EQ(5u, dirty[1].start.character);
+      ASSERT_EQ(6u, dirty[1].end.character);
+}
+
+TEST(OutputWriter, BatchesUntilDeadlineOrSize) {
+      std::ostringstream out;
+      OutputWriter writer(out);
+
+      auto policy = FlushPolicy::batched(std::chrono::milliseconds(100), 1024);
+      writer.write(Response::header(2), "{}", policy);
+      writer.write(Response::header(7), "{\"a\":1}", policy);
+      {
+            auto lock = writer.lockStream();
+            ASSERT_TRUE(out.str().empty());
+      }
+
+      // The deadline of the oldest message bounds how long it waits
+      std::this_thread::sleep_for(std::chrono::milliseconds(300));
+      {
+            auto lock = writer.lockStream();
+            ASSERT_EQ("Content-Length: 2\r\n\r\n{}Content-Length: 7\r\n\r\n{\"a\":1}", out.str());
+      }
+
+      // Crossing the size threshold writes right away
+      writer.write(Response::header(2000), std::string(2000, 'x'), policy);
+      auto lock = writer.lockStream();
+      ASSERT_EQ("Content-Length: 2\r\n\r\n{}Content-Length: 7\r\n\r\n{\"a\":1}Content-Length: 2000\r\n\r\n" + std::string(2000, 'x'), out.str());
+}
+
+TEST(Server, BatchedFlushPolicyKeepsResponseOrder) {
+      LSPServer server;
+      server.setFlushPolicy(FlushPolicy::batched());
+      std::istringstream in(testutil::makeWireMessage(R"({"jsonrpc": "2.0", "id": 1, "method": "initialize", "params": {}})") +
+                            testutil::makeWireMessage(R"({"jsonrpc": "2.0", "id": 2, "method": "shutdown"})") +
+                            testutil::makeWireMessage(R"({"jsonrpc": "2.0", "method": "exit"})"));
+      std::ostringstream out;
+
+      server.init(0, in, out);
+      ASSERT_EQ(0, server.exit());
+
+      auto responses = testutil::parseAllResponses(server.getOutputSafe(&out));
+      ASSERT_EQ(2u, responses.size());
+      ASSERT_EQ(1, responses[0]["id"]);
+      ASSERT_EQ(2, responses[1]["id"]);
+}
+
+TEST(Server, TypedResultsAreWrittenDirectly) {
+      LSPServer server;
+      server.registerCallback<textDocumentPositionParams, std::vector<Location>>(
+          Message::Method::REFERENCES,
+          [](const textDocumentPositionParams &params) -> std::vector<Location>
+          {
+                return {{params.textDocument.uri, {{1, 2}, {1, 5}}}, {"file:///other.cpp", {{7, 0}, {7, 3}}}};
+          });
+
+      const std::string position = R"("params": {"textDocument": {"uri": "file:///tmp/x.cpp"}, "position": {"line": 0, "character": 0}})";
+      std::istringstream in(testutil::makeWireMessage(R"({"jsonrpc": "2.0", "id": 1, "method": "initialize", "params": {}})") +
+                            testutil::makeWireMessage(R"({"jsonrpc": "2.0", "id": 2, "method": "textDocument/references", )" + position + "}"));
+      std::ostringstream out;
+
+      server.init(ServerCapabilities::referencesProvider, in, out);
+      server.exit();
+
+      const std::string wire = server.getOutputSafe(&out);
+      const std::string expected = R"({"id":2,"result":[{"range":{"end":{"character":5,"line":1},"start":{"character":2,"line":1}},"uri":"file:///tmp/x.cpp"},)"
+                                   R"({"range":{"end":{"character":3,"line":7},"start":{"character":0,"line":7}},"uri":"file:///other.cpp"}]})";
+      ASSERT_NE(std::string::npos, wire.find("Content-Length: " + std::to_string(expected.size()) + "\r\n\r\n" + expected));
+}
+
+TEST(SymbolIndex, RanksExactPrefixSubstringThenFuzzy) {
+      SymbolIndex index;
+      auto symbol = [](const std::string &name)
+      {
+            return SymbolInformation{name, SymbolKind::Function, {"file:///a.cpp", {{0, 0}, {0, 1}}}, std::nullopt};
+      };
+      index.setSymbols("file:///a.cpp", {symbol("parseHeader"), symbol("parse"), symbol("reparse"), symbol("parser"), symbol("pathResolve")});
+      index.setSymbols("file:///b.cpp", {symbol("PARSEable"), symbol("unrelated")});
+      ASSERT_EQ(7u, index.size());
+
+      auto names = [&](std::string_view query, bool fuzzy = true)
+      {
+            std::vector<std::string> out;
+            for (const auto &found : index.search(query, 256, fuzzy))
+                  out.push_back(found.name);
+            return out;
+      };
+      ASSERT_EQ((std::vector<std::string>{"parse", "parser", "PARSEable", "parseHeader", "reparse", "pathResolve"}), names("parse"));
+      ASSERT_EQ((std::vector<std::string>{"parse", "parser", "PARSEable", "parseHeader", "reparse"}), names("parse", false));
+      ASSERT_EQ((std::vector<std::string>{"parseHeader"}), names("psHdr"));
+      ASSERT_EQ(7u, names("").size());
+      ASSERT_EQ(1u, index.search("parse", 1).size());
+
+      index.setSymbols("file:///a.cpp", {symbol("render")});
+      ASSERT_EQ((std::vector<std::string>{"PARSEable"}), names("parse", false));
+      index.removeDocument("file:///b.cpp");
+      ASSERT_TRUE(names("parse").empty());
+      ASSERT_EQ(1u, index.size());
+}
+
+TEST(SymbolIndex, FollowsOpenDocumentsAndFallsBackToDisk) {
+      const std::filesystem::path root = std::filesystem::temp_directory_path() / "lspp_symbol_index_test";
+      std::filesystem::remove_all(root);
+      std::filesystem::create_directories(root / "src");
+      std::ofstream(root / "src" / "main.cpp") << "int onDisk(int value);\n";
+      std::ofstream(root / "notes.txt") << "ignored words\n";
+
+      SymbolIndex index;
+      ASSERT_EQ(1u, index.indexDirectory(root, {".cpp"}));
+      const std::string uri = SymbolIndex::pathToUri(root / "src" / "main.cpp");
+      ASSERT_EQ(root / "src" / "main.cpp", SymbolIndex::uriToPath(uri));
+      ASSERT_EQ(1u, index.search("onDisk").size());
+
+      // The open buffer replaces the file until it is closed again
+      auto document = std::make_shared<const textDocument>("int inBuffer;\n");
+      index.documentChanged(uri, DocumentSnapshot(document, 2));
+      ASSERT_TRUE(index.search("onDisk", 256, false).empty());
+      auto found = index.search("inBuffer");
+      ASSERT_EQ(1u, found.size());
+      ASSERT_EQ(uri, found[0].location.uri);
+      ASSERT_EQ(4u, found[0].location.range.start.character);
+
+      // Only the newest of several queued versions is indexed
+      for (int version = 3; version < 20; version++)
+            index.documentChanged(uri, DocumentSnapshot(std::make_shared<const textDocument>("int v" + std::to_string(version) + "x;\n"), version));
+      ASSERT_TRUE(index.search("inBuffer", 256, false).empty());
+      auto latest = index.search("x", 256, false);
+      ASSERT_EQ(1u, latest.size());
+      ASSERT_EQ("v19x", latest[0].name);
+
+      index.documentClosed(uri);
+      ASSERT_EQ(1u, index.search("onDisk").size());
+      ASSERT_TRUE(index.search("inBuffer", 256, false).empty());
+
+      index.documentChanged("untitled:scratch", DocumentSnapshot(document, 1));
+      ASSERT_EQ(1u, index.search("inBuffer").size());
+      index.documentClosed("untitled:scratch");
+      ASSERT_TRUE(index.search("inBuffer", 256, false).empty());
+      std::filesystem::remove_all(root);
+}
+
+TEST(Server, AnswersWorkspaceSymbol) {
+      LSPServer server;
+      server.enableWorkspaceSymbols();
+
+      std::istringstream in(testutil::makeWireMessage(R"({"jsonrpc": "2.0", "id": 1, "method": "initialize", "params": {}})") +
+                            testutil::makeWireMessage(R"({"jsonrpc": "2.0", "method": "textDocument/didOpen", "params": {"textDocument": {"uri": "file:///a.c", "languageId": "c", "version": 1, "text": "int count;\n"}}})") +
+                            testutil::makeWireMessage(R"({"jsonrpc": "2.0", "method": "textDocument/didChange", "params": {"textDocument": {"uri": "file:///a.c", "version": 2}, "contentChanges": [{"range": {"start": {"line": 1, "character": 0}, "end": {"line": 1, "character": 0}}, "text": "int counter;\n"}]}})") +
+                            testutil::makeWireMessage(R"({"jsonrpc": "2.0", "id": 2, "method": "workspace/symbol", "params": {"query": "COUNT"}})"));
+      std::ostringstream out;
+      server.init(ServerCapabilities::workspaceSymbolProvider, in, out);
+      server.exit();
+
+      auto responses = testutil::parseAllResponses(server.getOutputSafe(&out));
+      const nlohmann::json *result = nullptr;
+      for (const auto &response : responses)
+            if (response.contains("id") && response["id"] == 2)
+                  result = &response["result"];
+      ASSERT_NE(nullptr, result);
+      ASSERT_EQ(2u, result->size());
+      ASSERT_EQ("count", (*result)[0]["name"]);
+      ASSERT_EQ("counter", (*result)[1]["name"]);
+      ASSERT_EQ(1, (*result)[1]["location"]["range"]["start"]["line"]);
+      ASSERT_EQ(static_cast<int>(SymbolKind::Variable), (*result)[1]["kind"]);
+}
+
+TEST(Server, RecordsAndReplaysSessions) {
+      auto hover = [](LSPServer &server)
+      {
+            server.registerCallback<hoverParams, hoverResult>(Message::Method::HOVER, [](const hoverParams &params)
+                                                              { return hoverResult{{MarkupKind::PlainText, "at " + std::to_string(params.position.line)}, std::nullopt}; });
+      };
+      const std::string path = (std::filesystem::temp_directory_path() / "lspp_session_test.lspprec").string();
+      const std::string wire = testutil::makeWireMessage(R"({"jsonrpc": "2.0", "id": 1, "method": "initialize", "params": {}})") +
+                               testutil::makeWireMessage(R"({"jsonrpc": "2.0", "method": "initialized", "params": {}})") +
+                               testutil::makeWireMessage(R"({"jsonrpc": "2.0", "id": 2, "method": "textDocument/hover", "params": {"textDocument": {"uri": "file:///a.c"}, "position": {"line": 3, "character": 0}}})") +
+                               testutil::makeWireMessage(R"({"jsonrpc": "2.0", "id": 3, "method": "textDocument/hover", "params": {"textDocument": {"uri": "file:///a.c"}, "position": {"line": 4, "character": 0}}})");
+      {
+            LSPServer server;
+            hover(server);
+            ASSERT_TRUE(server.recordSession(path));
+            std::istringstream in(wire);
+            std::ostringstream out;
+            server.init(ServerCapabilities::hoverProvider, in, out);
+            server.exit();
+      }
+
+      auto frames = readSessionRecording(path);
+      ASSERT_TRUE(frames.has_value());
+      std::string inbound;
+      size_t outbound = 0;
+      uint64_t last = 0;
+      for (const auto &frame : *frames)
+      {
+            ASSERT_LE(last, frame.nanoseconds);
+            last = frame.nanoseconds;
+            if (frame.direction == FrameDirection::Inbound)
+                  inbound += frame.frame;
+            else
+                  outbound++;
+      }
+      ASSERT_EQ(wire, inbound);
+      ASSERT_EQ(3u, outbound);
+
+      LSPServer replayed;
+      hover(replayed);
+      ReplayReport report = replaySession(replayed, ServerCapabilities::hoverProvider, *frames, {true, 4.0, 2});
+      ASSERT_EQ(4u, report.messages);
+      ASSERT_EQ(3u, report.responses);
+      ASSERT_EQ(2u, report.methods.size());
+      ASSERT_EQ("initialize", report.methods[0].method);
+      ASSERT_EQ("textDocument/hover", report.methods[1].method);
+      ASSERT_EQ(2u, report.methods[1].requests);
+      ASSERT_LE(report.methods[1].p50, report.methods[1].p999);
+      ASSERT_LE(report.methods[1].p999, report.methods[1].max);
+
+      std::filesystem::remove(path);
+      ASSERT_FALSE(readSessionRecording(path).has_value());
+}
+
+TEST(LatencyHistogram, ReportsBucketPercentiles) {
+      for (uint64_t value : {0ull, 15ull, 16ull, 17ull, 1000ull, 123456789ull})
+      {
+            const size_t bucket = LatencyHistogram::bucketFor(value);
+            ASSERT_LE(value, LatencyHistogram::bucketLimit(bucket));
+            ASSERT_LE(LatencyHistogram::bucketLimit(bucket) - value, value / LatencyHistogram::SUB_BUCKETS);
+            if (bucket > 0)
+            {
+                  ASSERT_LT(LatencyHistogram::bucketLimit(bucket - 1), value);
+            }
+      }
+      ASSERT_EQ(LatencyHistogram::BUCKET_COUNT - 1, LatencyHistogram::bucketFor(~0ull));
+
+      LatencyHistogram histogram;
+      ASSERT_EQ(0u, histogram.summary().count);
+      for (uint64_t i = 1; i <= 1000; i++)
+            histogram.record(i * 1000);
+      auto summary = histogram.summary();
+      ASSERT_EQ(1000u, summary.count);
+      ASSERT_EQ(500500u, summary.mean);
+      ASSERT_EQ(1000000u, summary.max);
+      ASSERT_GE(summary.p50, 500000u);
+      ASSERT_LE(summary.p50, 500000u + 500000u / LatencyHistogram::SUB_BUCKETS);
+      ASSERT_GE(summary.p99, 990000u);
+      ASSERT_LE(summary.p99, summary.p999);
+      ASSERT_LE(summary.p999, summary.max);
+}
+
+TEST(Server, ReportsMetrics) {
+      LSPServer server;
+      server.registerCallback<hoverParams, hoverResult>(Message::Method::HOVER, [](const hoverParams &)
+                                                        { return hoverResult{{MarkupKind::PlainText, "hover"}, std::nullopt}; });
+      std::istringstream in(testutil::makeWireMessage(R"({"jsonrpc": "2.0", "id": 1, "method": "initialize", "params": {}})") +
+                            testutil::makeWireMessage(R"({"jsonrpc": "2.0", "method": "textDocument/didOpen", "params": {"textDocument": {"uri": "file:///a.c", "languageId": "c", "version": 1, "text": "int count;\n"}}})") +
+                            testutil::makeWireMessage(R"({"jsonrpc": "2.0", "id": 2, "method": "textDocument/hover", "params": {"textDocument": {"uri": "file:///a.c"}, "position": {"line": 0, "character": 4}}})") +
+                            testutil::makeWireMessage(R"({"jsonrpc": "2.0", "id": 3, "method": "textDocument/hover", "params": {"textDocument": {"uri": "file:///a.c"}, "position": {"line": 0, "character": 5}}})") +
+                            testutil::makeWireMessage(R"({"jsonrpc": "2.0", "id": 4, "method": "$/lspp/metrics"})"));
+      std::ostringstream out;
+      server.init(ServerCapabilities::hoverProvider, in, out);
+      server.exit();
+
+      const LatencyHistogram *hover = server.metrics().latency(Message::Method::HOVER);
+      ASSERT_NE(nullptr, hover);
+      ASSERT_EQ(2u, hover->summary().count);
+
+      auto responses = testutil::parseAllResponses(server.getOutputSafe(&out));
+      const nlohmann::json *metrics = nullptr;
+      for (const auto &response : responses)
+            if (response.contains("id") && response["id"] == 4)
+                  metrics = &response["result"];
+      ASSERT_NE(nullptr, metrics);
+      ASSERT_EQ("ns", (*metrics)["unit"]);
+      ASSERT_EQ(2u, (*metrics)["methods"]["textDocument/hover"]["count"]);
+      ASSERT_EQ(1u, (*metrics)["methods"]["initialize"]["count"]);
+      ASSERT_EQ(1u, (*metrics)["methods"]["textDocument/didOpen"]["count"]);
+      ASSERT_EQ(5u, (*metrics)["messagesIn"]);
+      ASSERT_GT((*metrics)["bytesIn"].get<uint64_t>(), 0u);
+      ASSERT_EQ(5u, (*metrics)["parse"]["count"]);
+      ASSERT_EQ(1u, (*metrics)["documents"]["open"]);
+      ASSERT_GT((*metrics)["documents"]["bytes"].get<size_t>(), 10u);
+      ASSERT_EQ(0u, (*metrics)["queue"]["depth"]);
+
+      MetricsSnapshot snapshot = server.metricsSnapshot();
+      ASSERT_EQ(4u, snapshot.messagesOut);
+      ASSERT_EQ(0u, snapshot.queueWait.count);
+      ASSERT_EQ(1u, server.metrics().latency(Message::Method::NONE)->summary().count);
+}
+
+TEST(Tracer, WritesChromeTraceEvents) {
+      const std::string path = (std::filesystem::temp_directory_path() / "lspp_tracer_test.json").string();
+      Tracer tracer;
+      {
+            TraceSpan ignored(tracer, "before open");
+      }
+      ASSERT_FALSE(tracer.isEnabled());
+      ASSERT_TRUE(tracer.open(path));
+      tracer.setThreadName("main");
+      {
+            TraceContext context(7, Message::Method::HOVER);
+            TraceSpan span(tracer, "outer");
+            const auto now = Tracer::Clock::now();
+            tracer.recordAsync("async", tracer.nextAsyncId(), now, now + std::chrono::microseconds(5), "file:///a.c");
+      }
+      std::thread([&]
+                  { TraceSpan span(tracer, "other thread"); })
+          .join();
+      ASSERT_TRUE(tracer.close());
+      ASSERT_FALSE(tracer.isEnabled());
+
+      std::ifstream file(path);
+      auto trace = nlohmann::json::parse(file, nullptr, false);
+      ASSERT_FALSE(trace.is_discarded());
+      ASSERT_EQ(0, trace["otherData"]["droppedSpans"]);
+      std::map<std::string, std::vector<nlohmann::json>> byName;
+      for (const auto &event : trace["traceEvents"])
+            byName[event["name"]].push_back(event);
+      ASSERT_EQ(0u, byName.count("before open"));
+
+      ASSERT_EQ(1u, byName["outer"].size());
+      const auto &outer = byName["outer"][0];
+      ASSERT_EQ("X", outer["ph"]);
+      ASSERT_EQ(7, outer["args"]["id"]);
+      ASSERT_EQ("textDocument/hover", outer["args"]["method"]);
+      ASSERT_FALSE(outer["args"].contains("uri"));
+
+      ASSERT_EQ(2u, byName["async"].size());
+      ASSERT_EQ("b", byName["async"][0]["ph"]);
+      ASSERT_EQ("e", byName["async"][1]["ph"]);
+      ASSERT_EQ(byName["async"][0]["id"], byName["async"][1]["id"]);
+      ASSERT_NEAR(5.0, byName["async"][1]["ts"].get<double>() - byName["async"][0]["ts"].get<double>(), 0.01);
+      ASSERT_EQ("file:///a.c", byName["async"][0]["args"]["uri"]);
+
+      ASSERT_EQ(1u, byName["other thread"].size());
+      ASSERT_NE(outer["tid"], byName["other thread"][0]["tid"]);
+      ASSERT_FALSE(byName["other thread"][0]["args"].contains("id"));
+      ASSERT_EQ(2u, byName["thread_name"].size());
+      ASSERT_EQ("main", byName["thread_name"][0]["args"]["name"]);
+      std::filesystem::remove(path);
+}
+
+TEST(Server, TracesRequestStages) {
+      const std::string path = (std::filesystem::temp_directory_path() / "lspp_server_trace_test.json").string();
+      LSPServer server;
+      server.registerCallback<hoverParams, hoverResult>(Message::Method::HOVER, [](const hoverParams &)
+                                                        { return hoverResult{{MarkupKind::PlainText, "hover"}, std::nullopt}; });
+      ASSERT_TRUE(server.traceTo(path));
+      std::istringstream in(testutil::makeWireMessage(R"({"jsonrpc": "2.0", "id": 1, "method": "initialize", "params": {}})") +
+                            testutil::makeWireMessage(R"({"jsonrpc": "2.0", "method": "textDocument/didOpen", "params": {"textDocument": {"uri": "file:///a.c", "languageId": "c", "version": 1, "text": "int count;\n"}}})") +
+                            testutil::makeWireMessage(R"({"jsonrpc": "2.0", "id": 2, "method": "textDocument/hover", "params": {"textDocument": {"uri": "file:///a.c"}, "position": {"line": 0, "character": 4}}})"));
+      std::ostringstream out;
+      server.init(ServerCapabilities::hoverProvider, in, out, 1);
+      server.exit();
+
+      std::ifstream file(path);
+      auto trace = nlohmann::json::parse(file, nullptr, false);
+      ASSERT_FALSE(trace.is_discarded());
+      std::set<std::string> hoverStages;
+      for (const auto &event : trace["traceEvents"])
+      {
+            if (event.contains("args") && event["args"].contains("id") && event["args"]["id"] == 2)
+            {
+                  hoverStages.insert(event["name"]);
+                  ASSERT_EQ("textDocument/hover", event["args"]["method"]);
+                  if (event["name"] == "message")
+                  {
+                        ASSERT_EQ("file:///a.c", event["args"]["uri"]);
+                  }
+            }
+      }
+      ASSERT_EQ((std::set<std::string>{"read", "parse", "queue", "callback", "serialize", "write", "message"}), hoverStages);
+      std::filesystem::remove(path);
+}
@@ -1,5 +1,8 @@
 #include <gtest/gtest.h>
 #include "textDocument.hpp"
+#include "PieceTable.hpp"
+#include "IdentifierIndex.hpp"
+#include <random>
 
 TEST(textDocument, getLine)
 {
@@ -29,24 +32,308 @@ TEST(textDocument, wordDelimiter)
       ASSERT_FALSE(textDocument::isWordDelimiter('A'));
       ASSERT_FALSE(textDocument::isWordDelimiter('Z'));
       ASSERT_FALSE(textDocument::isWordDelimiter('_'));
+      ASSERT_TRUE(textDocument::isWordDelimiter('\t'));
 
 }
 
 TEST(textDocument, wordUnderCursor) {
       textDocument td("Lorem ipsum dolor sit amet consectetur adipiscing elit\nConsectetur adipiscing elit quisque faucibus ex sapien vitae\n Ex sapien vitae pellentesque sem placerat in id\n Placerat in id{cursus}mi pretium tellus duis\n Pretium tellus duis convallis tempus leo eu aenean\n");
 
-      ASSERT_STREQ("dolor", td.wordUnderCursor(0, 12).c_str());
-      ASSERT_STREQ("elit", td.wordUnderCursor(1, 25).c_str());
-      ASSERT_STREQ("", td.wordUnderCursor(2, 3).c_str());
-      ASSERT_STREQ("", td.wordUnderCursor(0, 200).c_str());
-      ASSERT_STREQ("cursus", td.wordUnderCursor(3, 18).c_str());
-      ASSERT_STREQ("", td.wordUnderCursor(3, 15).c_str());
-      ASSERT_STREQ("Lorem", td.wordUnderCursor(0, 0).c_str());
-      ASSERT_STREQ("elit", td.wordUnderCursor(0, 53).c_str());
-      ASSERT_STREQ("Consectetur", td.wordUnderCursor(1, 0).c_str());
+      ASSERT_EQ("dolor", td.wordUnderCursor(0, 12, PositionEncoding::UTF8));
+      ASSERT_EQ("elit", td.wordUnderCursor(1, 25, PositionEncoding::UTF8));
+      ASSERT_EQ("", td.wordUnderCursor(2, 3, PositionEncoding::UTF8));
+      ASSERT_EQ("", td.wordUnderCursor(0, 200, PositionEncoding::UTF8));
+      ASSERT_EQ("cursus", td.wordUnderCursor(3, 18, PositionEncoding::UTF8));
+      ASSERT_EQ("", td.wordUnderCursor(3, 15, PositionEncoding::UTF8));
+      ASSERT_EQ("Lorem", td.wordUnderCursor(0, 0, PositionEncoding::UTF8));
+      ASSERT_EQ("elit", td.wordUnderCursor(0, 53, PositionEncoding::UTF8));
+      ASSERT_EQ("Consectetur", td.wordUnderCursor(1, 0, PositionEncoding::UTF8));
+
+      // "é" is two bytes but one UTF-16 and UTF-32 unit, "😀" is two UTF-16 units
+      textDocument unicode("é😀 = value;\n");
+      ASSERT_EQ("value", unicode.wordUnderCursor(0, 6, PositionEncoding::UTF16));
+      ASSERT_EQ("value", unicode.wordUnderCursor(0, 5, PositionEncoding::UTF32));
+      ASSERT_EQ("value", unicode.wordUnderCursor(0, 9, PositionEncoding::UTF8));
+      ASSERT_EQ("", unicode.wordUnderCursor(0, 4, PositionEncoding::UTF16));
+}
+
+TEST(textDocument, wordRules) {
+      textDocument td("a { margin-top: $gap; }\n");
+
+      ASSERT_EQ("margin", td.wordUnderCursor(0, 5, PositionEncoding::UTF8));
+      ASSERT_EQ("gap", td.wordUnderCursor(0, 18, PositionEncoding::UTF8));
+
+      static constexpr WordRules css = WordRules::defaults().withWordChars("-$");
+      ASSERT_EQ("margin-top", td.wordUnderCursor(0, 5, PositionEncoding::UTF8, css));
+      ASSERT_EQ("$gap", td.wordUnderCursor(0, 18, PositionEncoding::UTF8, css));
+
+      // Lines spanning several pieces are copied once, without copying the rest of the document
+      td.replace(td.length(), 0, "b { " + std::string(1000, ' ') + "}\n");
+      td.replace(4, 0, "pad");
+      td.replace(td.findPos(0, 7, PositionEncoding::UTF8), 0, "-x");
+      std::string_view line = td.lineView(0);
+      ASSERT_EQ("a { pad-xmargin-top: $gap; }", line);
+      ASSERT_EQ(line.data(), td.lineView(0).data());
+      ASSERT_EQ(1005u, td.lineView(1).size());
+      ASSERT_EQ("pad-xmargin-top", td.wordUnderCursor(0, 9, PositionEncoding::UTF8, css));
+      // A copy shares the text but none of the cached copies
+      ASSERT_LT(td.memoryUsage() - textDocument(td).memoryUsage(), 200u);
+}
+
+TEST(textDocument, findPos)
+{
+      textDocument td("line0\nline1\n\nline3");
+
+      ASSERT_EQ(0, td.findPos(0, 0, PositionEncoding::UTF8));
+      ASSERT_EQ(3, td.findPos(0, 3, PositionEncoding::UTF8));
+      ASSERT_EQ(6, td.findPos(1, 0, PositionEncoding::UTF8));
+      ASSERT_EQ(12, td.findPos(2, 0, PositionEncoding::UTF8));
+      ASSERT_EQ(13, td.findPos(3, 0, PositionEncoding::UTF8));
+      ASSERT_EQ(5, td.findPos(0, 100, PositionEncoding::UTF8));   // Clamped to end of line
+      ASSERT_EQ(18, td.findPos(10, 0, PositionEncoding::UTF8));   // Clamped to end of document
+
+      ASSERT_EQ(0u, td.positionAt(0, PositionEncoding::UTF8).line);
+      ASSERT_EQ(1u, td.positionAt(8, PositionEncoding::UTF8).line);
+      ASSERT_EQ(2u, td.positionAt(8, PositionEncoding::UTF8).character);
+      ASSERT_EQ(3u, td.positionAt(18, PositionEncoding::UTF8).line);
+      ASSERT_EQ(5u, td.positionAt(18, PositionEncoding::UTF8).character);
+}
+
+TEST(textDocument, positionEncodings)
+{
+      // "é" is 2 bytes and one UTF-16 unit, "😀" is 4 bytes and two UTF-16 units
+      textDocument td("ascii\ncaf\xc3\xa9 \xf0\x9f\x98\x80x\nend");
+      ASSERT_TRUE(td.lineIsAscii(0));
+      ASSERT_FALSE(td.lineIsAscii(1));
+      ASSERT_TRUE(td.lineIsAscii(2));
+
+      const int line1 = td.findPos(1, 0, PositionEncoding::UTF8);
+      ASSERT_EQ(line1 + 3, td.findPos(1, 3, PositionEncoding::UTF16));
+      ASSERT_EQ(line1 + 5, td.findPos(1, 4, PositionEncoding::UTF16));
+      ASSERT_EQ(line1 + 6, td.findPos(1, 5, PositionEncoding::UTF16));
+      ASSERT_EQ(line1 + 6, td.findPos(1, 6, PositionEncoding::UTF16)); // Inside the surrogate pair
+      ASSERT_EQ(line1 + 10, td.findPos(1, 7, PositionEncoding::UTF16));
+      ASSERT_EQ(line1 + 10, td.findPos(1, 6, PositionEncoding::UTF32));
+      ASSERT_EQ(line1 + 11, td.findPos(1, 100, PositionEncoding::UTF16));
+      ASSERT_EQ(line1 + 4, td.findPos(1, 4, PositionEncoding::UTF8));
+
+      ASSERT_EQ(7u, td.positionAt(line1 + 10, PositionEncoding::UTF16).character);
+      ASSERT_EQ(6u, td.positionAt(line1 + 10, PositionEncoding::UTF32).character);
+      ASSERT_EQ(10u, td.positionAt(line1 + 10, PositionEncoding::UTF8).character);
+
+      // Editing the non-ASCII text away makes the line take the fast path again
+      td.replace(line1 + 3, 7, "e ");
+      ASSERT_TRUE(td.lineIsAscii(1));
+      ASSERT_EQ("cafe x", td.getLine(1));
+}
+
+TEST(textDocument, incrementalEdits)
+{
+      textDocument td("hola0\nhola1\nhola2\nhola3");
+
+      td.replace(td.findPos(1, 0, PositionEncoding::UTF8), 0, "new\nlines\n");
+      ASSERT_EQ(6u, td.lineCount());
+      ASSERT_STREQ("new", td.getLine(1).c_str());
+      ASSERT_STREQ("lines", td.getLine(2).c_str());
+      ASSERT_STREQ("hola1", td.getLine(3).c_str());
+
+      // Join lines 2..4 into one
+      td.replace(td.findPos(2, 2, PositionEncoding::UTF8), td.findPos(4, 2, PositionEncoding::UTF8) - td.findPos(2, 2, PositionEncoding::UTF8), "");
+      ASSERT_EQ(4u, td.lineCount());
+      ASSERT_STREQ("lila2", td.getLine(2).c_str());
+      ASSERT_STREQ("hola3", td.getLine(3).c_str());
+
+      td.setContent("single line");
+      ASSERT_EQ(1u, td.lineCount());
+      ASSERT_STREQ("single line", td.getLine(0).c_str());
+
+      // Index must match a freshly built document after any sequence of edits
+      td.replace(6, 1, "\n\n\n");
+      td.replace(0, 3, "x\ny");
+      textDocument fresh(td.getContent());
+      ASSERT_EQ(fresh.lineCount(), td.lineCount());
+      for (size_t i = 0; i < td.lineCount(); i++)
+            ASSERT_EQ(fresh.findPos(i, 0, PositionEncoding::UTF8), td.findPos(i, 0, PositionEncoding::UTF8));
+}
+
+TEST(PieceTable, matchesStringUnderRandomEdits)
+{
+      std::string expected = "first line\nsecond line\n\nfourth";
+      PieceTable table(expected);
+      std::mt19937 rng(1234);
+
+      for (int i = 0; i < 3000; i++)
+      {
+            size_t offset = rng() % (expected.size() + 1);
+            size_t length = rng() % 8;
+            std::string text = std::string(rng() % 12, 'a' + i % 26);
+            if (rng() % 3 == 0)
+                  text += '\n';
+
+            expected.replace(offset, std::min(length, expected.size() - offset), text);
+            table.replace(offset, length, text);
+
+            ASSERT_EQ(expected.size(), table.length());
+            size_t probe = rng() % (expected.size() + 1);
+            ASSERT_EQ(static_cast<size_t>(std::count(expected.begin(), expected.begin() + probe, '\n')), table.lineAt(probe));
+      }
+
+      ASSERT_EQ(expected, table.toString());
+      ASSERT_EQ(expected.substr(10, 40), table.slice(10, 40));
+
+      size_t line = 0;
+      for (size_t i = 0; i <= expected.size(); i++)
+      {
+            if (i == 0 || expected[i - 1] == '\n')
+            {
+                  ASSERT_EQ(i, table.lineStart(line++));
+            }
+      }
+      ASSERT_EQ(line, table.lineCount());
+}
+
+TEST(PieceTable, tracksNonAsciiRanges)
+{
+      std::string expected = "plain\n";
+      PieceTable table(expected);
+      std::mt19937 rng(99);
+
+      for (int i = 0; i < 2000; i++)
+      {
+            size_t offset = rng() % (expected.size() + 1);
+            size_t length = rng() % 6;
+            std::string text = rng() % 5 == 0 ? "\xc3\xa9" : std::string(rng() % 10, 'a' + i % 26);
+
+            expected.replace(offset, std::min(length, expected.size() - offset), text);
+            table.replace(offset, length, text);
+
+            size_t from = rng() % (expected.size() + 1);
+            size_t count = rng() % 32;
+            std::string_view range = std::string_view(expected).substr(from, count);
+            bool ascii = std::none_of(range.begin(), range.end(), [](char c)
+                                      { return static_cast<unsigned char>(c) >= 0x80; });
+            ASSERT_EQ(ascii, table.isAscii(from, count));
+      }
+}
+
+TEST(PieceTable, copiesAreIndependent)
+{
+      PieceTable original("shared text");
+      PieceTable copy = original;
+
+      copy.replace(0, 6, "edited");
+      ASSERT_EQ("shared text", original.toString());
+      ASSERT_EQ("edited text", copy.toString());
 }
 
 int main(){
       ::testing::InitGoogleTest();
       return RUN_ALL_TESTS();
 }
+
+TEST(IdentifierIndex, findsOccurrences)
+{
+      textDocument td("int count = 0;\ncount += 2 * count;\n// 3count caf\xc3\xa9 count\n");
+      IdentifierIndex index;
+      index.rebuild(td);
+
+      auto ranges = index.occurrences("count");
+      ASSERT_EQ(4u, ranges.size());
+      ASSERT_EQ(0u, ranges[0].start.line);
+      ASSERT_EQ(4u, ranges[0].start.character);
+      ASSERT_EQ(9u, ranges[0].end.character);
+      ASSERT_EQ(1u, ranges[2].start.line);
+      ASSERT_EQ(13u, ranges[2].start.character);
+      // UTF-16 columns: "é" is one unit
+      ASSERT_EQ(2u, ranges[3].start.line);
+      ASSERT_EQ(15u, ranges[3].start.character);
+      ASSERT_TRUE(index.occurrences("3count").empty());
+      ASSERT_TRUE(index.occurrences("missing").empty());
+
+      auto locations = index.locations("int", "file:///a.c");
+      ASSERT_EQ(1u, locations.size());
+      ASSERT_EQ("file:///a.c", locations[0].uri);
+}
+
+TEST(IdentifierIndex, incrementalUpdatesMatchRebuild)
+{
+      const char *words[] = {"foo", "bar", " ", "\n", "baz9", "+", "\n\n", "qux_1"};
+      textDocument td("foo bar\nbaz\n");
+      IdentifierIndex index(defaultWordRules, PositionEncoding::UTF8);
+      index.rebuild(td);
+      std::mt19937 rng(7);
+
+      for (int i = 0; i < 1500; i++)
+      {
+            size_t start = rng() % (td.length() + 1);
+            size_t end = std::min(td.length(), start + rng() % 10);
+            std::string text;
+            for (size_t n = rng() % 4; n > 0; n--)
+                  text += words[rng() % 8];
+
+            Range range{td.positionAt(start, PositionEncoding::UTF8), td.positionAt(end, PositionEncoding::UTF8)};
+            td.replace(start, end - start, text);
+            index.update(td, range, text);
+      }
+
+      IdentifierIndex fresh(defaultWordRules, PositionEncoding::UTF8);
+      fresh.rebuild(td);
+      ASSERT_EQ(fresh.identifierCount(), index.identifierCount());
+      for (const char *word : {"foo", "bar", "baz9", "qux_1"})
+      {
+            auto expected = fresh.occurrences(word), actual = index.occurrences(word);
+            ASSERT_EQ(expected.size(), actual.size());
+            for (size_t i = 0; i < expected.size(); i++)
+            {
+                  ASSERT_EQ(expected[i].start.line, actual[i].start.line);
+                  ASSERT_EQ(expected[i].start.character, actual[i].start.character);
+                  ASSERT_EQ(expected[i].end.character, actual[i].end.character);
+            }
+      }
+}
+
+TEST(IdentifierIndex, copiesKeepTheirOccurrencesAcrossBlocks)
+{
+      // Enough lines for many blocks, and edits spanning several of them
+      std::string content;
+      for (int i = 0; i < 20000; i++)
+            content += i % 3 ? "foo bar\n" : "baz\n";
+      textDocument td(content);
+      IdentifierIndex index(defaultWordRules, PositionEncoding::UTF8);
+      index.rebuild(td);
+      const IdentifierIndex original(index);
+      std::mt19937 rng(11);
+
+      for (int i = 0; i < 300; i++)
+      {
+            size_t start = rng() % (td.length() + 1);
+            size_t end = std::min(td.length(), start + (i % 10 ? rng() % 20 : rng() % 20000));
+            std::string text = i % 4 ? "qux\nfoo" : "\n\nbar";
+            if (i % 25 == 0)
+                  for (int n = 0; n < 200; n++)
+                        text += "\nbaz foo";
+
+            Range range{td.positionAt(start, PositionEncoding::UTF8), td.positionAt(end, PositionEncoding::UTF8)};
+            td.replace(start, end - start, text);
+            index.update(td, range, text);
+      }
+
+      IdentifierIndex fresh(defaultWordRules, PositionEncoding::UTF8);
+      fresh.rebuild(td);
+      ASSERT_EQ(fresh.identifierCount(), index.identifierCount());
+      for (const char *word : {"foo", "bar", "baz", "qux"})
+      {
+            auto expected = fresh.occurrences(word), actual = index.occurrences(word);
+            ASSERT_EQ(expected.size(), actual.size());
+            for (size_t i = 0; i < expected.size(); i++)
+            {
+                  ASSERT_EQ(expected[i].start.line, actual[i].start.line);
+                  ASSERT_EQ(expected[i].start.character, actual[i].start.character);
+            }
+      }
+
+      auto baz = original.occurrences("baz");
+      ASSERT_EQ(6667u, baz.size());
+      ASSERT_EQ(19998u, baz.back().start.line);
+      ASSERT_TRUE(original.occurrences("qux").empty());
+}